@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "sr_if.h"
 #include "sr_router.h"
@@ -19,40 +20,46 @@
 #include "arp.h"
 #include "ethernet.h"
 #include "forward.h"
+#include "vclock.h"
+#include "shard.h"
+#include "neighbor.h"
+#include "probe.h"
+#include "log.h"
+#include "counter.h"
 
 /*----------------------------------------------------------------------
  * ARP Cache data structure
  *
  * stores <protocol type, sender protocol address, sender hardware address>
- * triplet's along with valid/invalid flag based on timeout
+ * triplet's along with valid/invalid flag based on timeout. worker threads
+ * share it, so every access goes through arpLock
  *---------------------------------------------------------------------*/
  struct arp_cache_entry arpCache[ARP_CACHE_SIZE];
+ static pthread_mutex_t arpLock = PTHREAD_MUTEX_INITIALIZER;
  
 /*--------------------------------------------------------------------- 
- * Method: void handleArp(struct sr_instance*, uint8_t*,
- *                          unsigned int, char* )
+ * Method: void handleArp(struct sr_instance*, struct packet_desc*,
+ *                          char* )
  *
  * decides what to do with an incoming ARP packet
  *---------------------------------------------------------------------*/
 void handleArp(
         struct sr_instance* sr,
-        uint8_t* packet,
-        unsigned int len,
+        struct packet_desc* desc,
         char* interface)
 {
-    struct sr_arphdr * arpHdr = (struct sr_arphdr*)(packet+14);
+    struct sr_arphdr * arpHdr = (struct sr_arphdr*)(desc->packet + desc->l3);
     struct sr_if * ifptr = sr->if_list;
     struct in_addr requested, replied;
-    int i;
 
     /* if we have an ARP request, loop over our list of interfaces to see if we
      have the hwaddr of the request ipaddr and send a reply if we do */
     if (ntohs(arpHdr->ar_op) == ARP_REQUEST) {
         requested.s_addr = arpHdr->ar_tip;
-        fprintf(stdout, "-> ARP Request: who has %s?\n", inet_ntoa(requested));
+        LogDebug(LOG_ARP, "-> ARP Request: who has %s?", logAddr(requested));
         while (ifptr) {
             if (ifptr->ip == arpHdr->ar_tip) {
-                arpSendReply(sr, packet, len, interface, ifptr);
+                arpSendReply(sr, desc->packet, desc->len, interface, ifptr);
                 return;
             } else {
                 ifptr = ifptr->next;
@@ -60,7 +67,7 @@ void handleArp(
         }
 
         if (!ifptr) {
-            printf("-- ARP Request: we do not have %s\n", inet_ntoa(requested));
+            LogDebug(LOG_ARP, "-- ARP Request: we do not have %s", logAddr(requested));
         }
     }
     /* if packet is an arp reply, cache it */
@@ -68,19 +75,15 @@ void handleArp(
         replied.s_addr = arpHdr->ar_sip;
 
         // log on receipt
-        printf("-> ARP Reply: %s is at ", inet_ntoa(replied));
-        for (i = 0; i < ETHER_ADDR_LEN; i++)
-            printf("%2.2x", arpHdr->ar_sha[i]);
-        printf("\n");
+        LogDebug(LOG_ARP, "-> ARP Reply: %s is at %s", logAddr(replied), logMac(arpHdr->ar_sha));
 
-        /* cache the new arp entry */
+        /* cache the new arp entry, the neighbor is alive after all */
         arpCacheEntry(arpHdr);
+        neighborUp(arpHdr->ar_sip);
+        probeHeard(arpHdr->ar_sip);
 
-        /* loop through arp cache to find matching arps for cached packets */
-        for (i = 0; i < ARP_CACHE_SIZE; i++) {
-            if (arpCache[i].valid == 1)
-                checkCachedPackets(sr, i);
-        }
+        /* send anything that was waiting on this, or any other, entry */
+        checkCachedPackets(sr);
     }
 }
 
@@ -100,7 +103,6 @@ void arpSendReply(
     struct sr_ethernet_hdr * ethernetHdr = (struct sr_ethernet_hdr*)packet;
     struct sr_arphdr * arpHdr = (struct sr_arphdr*)(packet+14);
     struct in_addr replied;
-    int i;
 
     makearp(arpHdr, arpHdr->ar_hrd, arpHdr->ar_pro, arpHdr->ar_hln, arpHdr->ar_pln, htons(ARP_REPLY),
             sr_get_interface(sr, interface)->addr, sr_get_interface(sr, interface)->ip,
@@ -110,12 +112,10 @@ void arpSendReply(
     // send our newly generated arp reply away!
     sr_send_packet(sr, packet, len, interface);
 
-    // log on send
+    // count and log on send
+    CounterInc(COUNTER_ARP_REPLIES_SENT);
     replied.s_addr = arpHdr->ar_sip;
-    fprintf(stdout, "<- ARP Reply: %s is at ", inet_ntoa(replied));
-    for (i = 0; i < ETHER_ADDR_LEN; i++) {
-        printf("%2.2x", arpHdr->ar_sha[i]);
-    } printf ("\n");
+    LogDebug(LOG_ARP, "<- ARP Reply: %s is at %s", logAddr(replied), logMac(arpHdr->ar_sha));
 }
 
 /*-----------------------------------------------------------------------------
@@ -139,7 +139,7 @@ void arpSendRequest(struct sr_instance* sr, struct sr_if* iface, uint32_t tip)
     /* allocate memory for new packet */
     uint8_t* requestPacket = malloc(42 * sizeof(uint8_t));
     if (requestPacket == NULL) {
-        fprintf(stderr, "Error: malloc could not find memory for packet storage\n");
+        LogError(LOG_ARP, "Error: malloc could not find memory for packet storage");
         return;
     }
     memset(requestPacket, 0, 42 * sizeof(uint8_t));
@@ -161,9 +161,10 @@ void arpSendRequest(struct sr_instance* sr, struct sr_if* iface, uint32_t tip)
     /* send away */
     sr_send_packet(sr, requestPacket, 42, iface->name);
 
-    // log on send
+    // count and log on send
+    CounterInc(COUNTER_ARP_REQUESTS_SENT);
     requested.s_addr = tip;
-    printf("<- ARP Request: who has %s?\n", inet_ntoa(requested));
+    LogDebug(LOG_ARP, "<- ARP Request: who has %s?", logAddr(requested));
 
     free(requestPacket);
 }
@@ -232,94 +233,144 @@ void makearp(
 void arpInitCache()
 {
     int i;
+
+    pthread_mutex_lock(&arpLock);
     for (i = 0; i < ARP_CACHE_SIZE; i++) {
         arpCache[i].valid = 0;
     }
+    pthread_mutex_unlock(&arpLock);
+
+    shardPublishArp();
 }
 
 /*-----------------------------------------------------------------------------
  * Method: void arpCacheEntry(struct sr_arphdr* arpHdr)
  *
- * stores new ARP info in network byte order in our cache
+ * stores new ARP info in network byte order in our cache. refreshes the
+ * entry if we already have one for the ip, and evicts the oldest entry if
+ * the cache is full
  *---------------------------------------------------------------------------*/
 void arpCacheEntry(struct sr_arphdr* arpHdr)
 {
-    int i,j;
+    int i, j, oldest = 0;
+
+    pthread_mutex_lock(&arpLock);
 
-    /* find first empty slot in our cache */
+    /* reuse our entry for this ip if we have one */
     for (i = 0; i < ARP_CACHE_SIZE; i++) {
-        if (arpCache[i].valid == 0) 
+        if (arpCache[i].valid == 1 && arpCache[i].ar_sip == arpHdr->ar_sip)
             break;
     }
 
+    /* otherwise find first empty slot in our cache */
+    if (i == ARP_CACHE_SIZE) {
+        for (i = 0; i < ARP_CACHE_SIZE; i++) {
+            if (arpCache[i].valid == 0)
+                break;
+            if (arpCache[i].timeCached < arpCache[oldest].timeCached)
+                oldest = i;
+        }
+    }
+    if (i == ARP_CACHE_SIZE)
+        i = oldest;
+
     /* extract ARP info from arpHdr and cache it */
     arpCache[i].ar_sip = arpHdr->ar_sip;
     for (j = 0; j < ETHER_ADDR_LEN; j++)
         arpCache[i].ar_sha[j] = arpHdr->ar_sha[j];
 
     // timestamp and make valid
-    arpCache[i].timeCached = time(NULL);
+    arpCache[i].timeCached = vclockNow();
     arpCache[i].valid = 1;
 
-    /* TODO
-     *
-     * LOOK THROUGH PACKET CACHE TO SEE IF WE CAN SEND SOMETHING WITH THE NEWLY
-     * ADDED ARP ENTRY
-     */
+    pthread_mutex_unlock(&arpLock);
+
+    /* forwarding threads cache adjacencies, make them look again */
+    shardPublishArp();
 }
 
 /*-----------------------------------------------------------------------------
- * Method: int arpSearchCache(struct ip* ipHdr)
+ * Method: int arpSearchCache(uint32_t ipaddr, uint8_t* mac)
  *
  * searches our arp cache to see if we have a valid hwaddr
- * that matches the target ipaddr we need to send to
+ * that matches the target ipaddr we need to send to. the hwaddr is copied
+ * into mac while we hold the lock, since the entry can be evicted as soon
+ * as we let go of it
  *---------------------------------------------------------------------------*/
-int arpSearchCache(uint32_t ipaddr)
+int arpSearchCache(uint32_t ipaddr, uint8_t* mac)
 {
     /* look through cache for matching proto and sip with valid flag = 0 */
     /* returns index of that entry if found, otherwise returns -1 */
     int i;
 
+    pthread_mutex_lock(&arpLock);
     for (i = 0; i < ARP_CACHE_SIZE; i++) {
         if (arpCache[i].valid == 1) {
             if (arpCache[i].ar_sip == ipaddr) {
+                memcpy(mac, arpCache[i].ar_sha, ETHER_ADDR_LEN);
+                pthread_mutex_unlock(&arpLock);
                 return i;
             }
         }
     }
+    pthread_mutex_unlock(&arpLock);
     
     return -1;
 }
 
+/*-----------------------------------------------------------------------------
+ * Method: int arpCacheCount()
+ *
+ * the number of valid entries in our arp cache
+ *---------------------------------------------------------------------------*/
+int arpCacheCount()
+{
+    int i, n = 0;
+
+    pthread_mutex_lock(&arpLock);
+    for (i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arpCache[i].valid == 1)
+            n++;
+    }
+    pthread_mutex_unlock(&arpLock);
+
+    return n;
+}
+
 /*-----------------------------------------------------------------------------
  * Method: void arpUpdateCache()
  *
- * finds stale arp entries in our cache and invalidates them
+ * finds stale arp entries in our cache and invalidates them. entries only
+ * age in whole seconds, so one thread sweeps per second and everyone else
+ * returns without touching the lock
  *---------------------------------------------------------------------------*/
 void arpUpdateCache()
 {
     /* find entries older than STALE_TIME seconds and set valid bit to 0 */
-    int i;
+    static time_t lastSweep = 0;
+    time_t last = __atomic_load_n(&lastSweep, __ATOMIC_RELAXED);
+    time_t now = vclockNow();
+    int i, expired = 0;
 
+    if (now == last ||
+            !__atomic_compare_exchange_n(&lastSweep, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+
+    pthread_mutex_lock(&arpLock);
     for (i = 0; i < ARP_CACHE_SIZE; i++) {
         /* if valid and timestamp is older than 15 seconds, mark invalid */
         if (arpCache[i].valid == 1) {
-            if (difftime(time(NULL), arpCache[i].timeCached) > ARP_STALE_TIME) {
-                printf("-- ARP: Marking ARP cache entry %d invalid\n", i);
+            if (difftime(vclockNow(), arpCache[i].timeCached) > ARP_STALE_TIME) {
+                LogInfo(LOG_ARP, "-- ARP: Marking ARP cache entry %d invalid", i);
                 arpCache[i].valid = 0;
+                expired = 1;
             }
         }
     }
-}
+    pthread_mutex_unlock(&arpLock);
 
-/*-----------------------------------------------------------------------------
- * Method: uint8_t* arpReturnEntryMac(int entry)
- *
- * returns a pointer to the arpCache[entry] source hardware address
- *---------------------------------------------------------------------------*/
-uint8_t* arpReturnEntryMac(int entry)
-{
-     return (uint8_t*)&arpCache[entry].ar_sha;
+    if (expired)
+        shardPublishArp();
 }
 
 /*-----------------------------------------------------------------------------
@@ -331,6 +382,7 @@ void arpDumpCache()
 {
     int i,j;
 
+    pthread_mutex_lock(&arpLock);
     for (i = 0; i < ARP_CACHE_SIZE; i++) {
         if (arpCache[i].valid == 1) {
             printf("CACHE ENTRY: %d\n", i);
@@ -343,6 +395,7 @@ void arpDumpCache()
             //printf("seconds: %S\n", arpCache[i].timeCached);
         }
     }
+    pthread_mutex_unlock(&arpLock);
 }
 
 /*-----------------------------------------------------------------------------
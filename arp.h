@@ -13,6 +13,7 @@
 #include <time.h>
 
 #include "sr_protocol.h"
+#include "parse.h"
 
 #define ARP_CACHE_SIZE 100
 #define ARP_STALE_TIME 15   // in seconds
@@ -25,7 +26,7 @@ struct arp_cache_entry {
 };
 
 
-void handleArp(struct sr_instance*, uint8_t*, unsigned int, char* );
+void handleArp(struct sr_instance*, struct packet_desc*, char* );
 void arpSendReply(struct sr_instance*, uint8_t*, unsigned int, char*, struct sr_if* );
 void arpSendRequest(struct sr_instance*, struct sr_if*, uint32_t );
 void makearp(
@@ -41,10 +42,10 @@ void makearp(
         uint32_t    arp_tip );
 
 void arpInitCache();
-int arpSearchCache(uint32_t );
+int arpSearchCache(uint32_t, uint8_t* );
+int arpCacheCount();
 void arpCacheEntry(struct sr_arphdr* );
 void arpUpdateCache();
-uint8_t* arpReturnEntryMac(int );
 void arpDumpCache();
 void arpDumpHeader(struct sr_arphdr* );
 
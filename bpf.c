@@ -0,0 +1,774 @@
+/*******************************************************************************
+ * file: bpf.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements classic BPF: a loader for tcpdump -ddd output, the checks a
+ * program has to pass before it may run, the interpreter, and a compiler
+ * for a subset of tcpdump's filter language:
+ *
+ *   ip  arp  icmp  tcp  udp  broadcast  proto N  less N  greater N
+ *   [src|dst] host A.B.C.D    [src|dst] net A.B.C.D/len    [src|dst] port N
+ *   not  !  and  &&  or  ||  ( )
+ *
+ * the compiler parses the expression into a tree, then walks it passing
+ * down where to jump when a test holds and when it fails. those targets
+ * always lie ahead, so every jump is forward and the program ends
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+
+#include "bpf.h"
+
+#define BPF_MAXNODES 1024
+#define BPF_MAXLABELS (2 * BPF_MAXNODES + 2)
+#define BPF_TOKLEN 64
+
+#define NODE_AND 0
+#define NODE_OR 1
+#define NODE_NOT 2
+#define NODE_TEST 3
+
+struct bpf_node {
+    int                 type;
+    struct bpf_node*    left;                   // or the only child of not
+    struct bpf_node*    right;
+    uint16_t            load;                   // BPF_LD | size | mode
+    uint32_t            offset;                 // past the ip header for BPF_IND
+    uint32_t            mask;                   // 0 for none
+    uint16_t            jump;                   // BPF_JEQ, BPF_JGT, ...
+    uint32_t            value;
+};
+
+struct bpf_compiler {
+    const char*         expr;
+    const char*         next;                   // what the lexer has not read
+    char                tok[BPF_TOKLEN];        // current token, "" at the end
+    const char*         error;
+    struct bpf_node     nodes[BPF_MAXNODES];
+    int                 nnodes;
+    struct bpf_insn     insns[BPF_MAXINSNS];
+    int                 jt[BPF_MAXINSNS];       // label each jump goes to
+    int                 jf[BPF_MAXINSNS];
+    int                 ninsns;
+    int                 labels[BPF_MAXLABELS];  // instruction each label marks
+    int                 nlabels;
+};
+
+static void bpfLex(struct bpf_compiler* );
+static struct bpf_node* bpfExpr(struct bpf_compiler* );
+static struct bpf_node* bpfTerm(struct bpf_compiler* );
+static struct bpf_node* bpfFactor(struct bpf_compiler* );
+static struct bpf_node* bpfPrimitive(struct bpf_compiler* );
+static struct bpf_node* bpfNode(struct bpf_compiler*, int, struct bpf_node*, struct bpf_node* );
+static struct bpf_node* bpfTest(struct bpf_compiler*, uint16_t, uint32_t, uint32_t, uint16_t, uint32_t );
+static int bpfNumber(struct bpf_compiler*, uint32_t*, uint32_t );
+static int bpfLabel(struct bpf_compiler* );
+static void bpfPlace(struct bpf_compiler*, int );
+static void bpfEmit(struct bpf_compiler*, uint16_t, uint32_t, int, int );
+static void bpfGen(struct bpf_compiler*, struct bpf_node*, int, int );
+
+/*-----------------------------------------------------------------------------
+ * Method: int bpfCompile(struct bpf_program* prog, const char* expr,
+ *                          uint32_t snaplen)
+ *
+ * compiles expr into prog. frames it matches keep snaplen bytes, an empty
+ * expression matches everything. returns 0 on success, -1 with a message
+ * on a bad expression
+ *---------------------------------------------------------------------------*/
+int bpfCompile(struct bpf_program* prog, const char* expr, uint32_t snaplen)
+{
+    struct bpf_compiler* c;
+    struct bpf_node* root = NULL;
+    int accept, reject, i;
+
+    c = calloc(1, sizeof(struct bpf_compiler));
+    if (c == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for filter compiler\n");
+        return -1;
+    }
+    c->expr = c->next = expr;
+
+    bpfLex(c);
+    if (c->tok[0]) {
+        root = bpfExpr(c);
+        if (root && c->tok[0])
+            c->error = "unexpected";
+    }
+    if (c->error) {
+        fprintf(stderr, "Error: filter \"%s\": %s %s%s%s\n", expr, c->error,
+                c->tok[0] ? "'" : "at the end", c->tok, c->tok[0] ? "'" : "");
+        free(c);
+        return -1;
+    }
+
+    accept = bpfLabel(c);
+    reject = bpfLabel(c);
+    if (root)
+        bpfGen(c, root, accept, reject);
+    bpfPlace(c, accept);
+    bpfEmit(c, BPF_RET | BPF_K, snaplen, -1, -1);
+    bpfPlace(c, reject);
+    bpfEmit(c, BPF_RET | BPF_K, 0, -1, -1);
+
+    /* every label is placed by now, turn them into offsets */
+    for (i = 0; i < c->ninsns && !c->error; i++) {
+        if (c->jt[i] < 0)
+            continue;
+        if (c->labels[c->jt[i]] - i - 1 > 255 || c->labels[c->jf[i]] - i - 1 > 255)
+            c->error = "filter too long";
+        c->insns[i].jt = c->labels[c->jt[i]] - i - 1;
+        c->insns[i].jf = c->labels[c->jf[i]] - i - 1;
+    }
+    if (c->error) {
+        fprintf(stderr, "Error: filter \"%s\": %s\n", expr, c->error);
+        free(c);
+        return -1;
+    }
+
+    prog->len = c->ninsns;
+    prog->insns = malloc(c->ninsns * sizeof(struct bpf_insn));
+    if (prog->insns == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for filter\n");
+        free(c);
+        return -1;
+    }
+    memcpy(prog->insns, c->insns, c->ninsns * sizeof(struct bpf_insn));
+    free(c);
+
+    return bpfValidate(prog);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int bpfLoad(struct bpf_program* prog, const char* fname)
+ *
+ * reads a program in tcpdump -ddd format, the instruction count on the first
+ * line and then one "code jt jf k" line per instruction. returns 0 on
+ * success, -1 if the file is unreadable or the program fails bpfValidate
+ *---------------------------------------------------------------------------*/
+int bpfLoad(struct bpf_program* prog, const char* fname)
+{
+    FILE* fp;
+    unsigned int code, jt, jf, k, i;
+
+    fp = fopen(fname, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: can't open filter program %s\n", fname);
+        return -1;
+    }
+
+    if (fscanf(fp, "%u", &prog->len) != 1 || prog->len == 0 || prog->len > BPF_MAXINSNS) {
+        fprintf(stderr, "Error: %s is not a tcpdump -ddd program\n", fname);
+        fclose(fp);
+        return -1;
+    }
+    prog->insns = malloc(prog->len * sizeof(struct bpf_insn));
+    if (prog->insns == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for filter\n");
+        fclose(fp);
+        return -1;
+    }
+
+    for (i = 0; i < prog->len; i++) {
+        if (fscanf(fp, "%u %u %u %u", &code, &jt, &jf, &k) != 4 ||
+                code > 0xffff || jt > 255 || jf > 255) {
+            fprintf(stderr, "Error: %s: bad instruction %u\n", fname, i);
+            fclose(fp);
+            bpfFree(prog);
+            return -1;
+        }
+        prog->insns[i].code = code;
+        prog->insns[i].jt = jt;
+        prog->insns[i].jf = jf;
+        prog->insns[i].k = k;
+    }
+    fclose(fp);
+
+    if (bpfValidate(prog) != 0) {
+        fprintf(stderr, "Error: %s is not a valid filter program\n", fname);
+        bpfFree(prog);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int bpfValidate(const struct bpf_program* prog)
+ *
+ * checks that every instruction is one we run, that jumps land inside the
+ * program, scratch memory indices exist, constant divisors and shifts are
+ * sane and the program ends in a return. jumps only go forward, so a
+ * program that passes always ends. returns 0 if prog may run, -1 if not
+ *---------------------------------------------------------------------------*/
+int bpfValidate(const struct bpf_program* prog)
+{
+    const struct bpf_insn* insn;
+    unsigned int i, left;
+
+    if (prog->len == 0 || prog->len > BPF_MAXINSNS)
+        return -1;
+
+    for (i = 0; i < prog->len; i++) {
+        insn = &prog->insns[i];
+        left = prog->len - i - 1;
+
+        switch (insn->code) {
+            case BPF_LD | BPF_W | BPF_ABS: case BPF_LD | BPF_H | BPF_ABS: case BPF_LD | BPF_B | BPF_ABS:
+            case BPF_LD | BPF_W | BPF_IND: case BPF_LD | BPF_H | BPF_IND: case BPF_LD | BPF_B | BPF_IND:
+            case BPF_LD | BPF_W | BPF_LEN: case BPF_LDX | BPF_W | BPF_LEN:
+            case BPF_LD | BPF_IMM: case BPF_LDX | BPF_IMM:
+            case BPF_LDX | BPF_B | BPF_MSH:
+            case BPF_ALU | BPF_ADD | BPF_K: case BPF_ALU | BPF_ADD | BPF_X:
+            case BPF_ALU | BPF_SUB | BPF_K: case BPF_ALU | BPF_SUB | BPF_X:
+            case BPF_ALU | BPF_MUL | BPF_K: case BPF_ALU | BPF_MUL | BPF_X:
+            case BPF_ALU | BPF_DIV | BPF_X: case BPF_ALU | BPF_MOD | BPF_X:
+            case BPF_ALU | BPF_AND | BPF_K: case BPF_ALU | BPF_AND | BPF_X:
+            case BPF_ALU | BPF_OR | BPF_K: case BPF_ALU | BPF_OR | BPF_X:
+            case BPF_ALU | BPF_XOR | BPF_K: case BPF_ALU | BPF_XOR | BPF_X:
+            case BPF_ALU | BPF_LSH | BPF_X: case BPF_ALU | BPF_RSH | BPF_X:
+            case BPF_ALU | BPF_NEG:
+            case BPF_RET | BPF_K: case BPF_RET | BPF_A:
+            case BPF_MISC | BPF_TAX: case BPF_MISC | BPF_TXA:
+                break;
+            case BPF_LD | BPF_MEM: case BPF_LDX | BPF_MEM:
+            case BPF_ST: case BPF_STX:
+                if (insn->k >= BPF_MEMWORDS)
+                    return -1;
+                break;
+            case BPF_ALU | BPF_DIV | BPF_K: case BPF_ALU | BPF_MOD | BPF_K:
+                if (insn->k == 0)
+                    return -1;
+                break;
+            case BPF_ALU | BPF_LSH | BPF_K: case BPF_ALU | BPF_RSH | BPF_K:
+                if (insn->k >= 32)
+                    return -1;
+                break;
+            case BPF_JMP | BPF_JA:
+                if (insn->k >= left)
+                    return -1;
+                break;
+            case BPF_JMP | BPF_JEQ | BPF_K: case BPF_JMP | BPF_JEQ | BPF_X:
+            case BPF_JMP | BPF_JGT | BPF_K: case BPF_JMP | BPF_JGT | BPF_X:
+            case BPF_JMP | BPF_JGE | BPF_K: case BPF_JMP | BPF_JGE | BPF_X:
+            case BPF_JMP | BPF_JSET | BPF_K: case BPF_JMP | BPF_JSET | BPF_X:
+                if (insn->jt >= left || insn->jf >= left)
+                    return -1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return BPF_CLASS(prog->insns[prog->len - 1].code) == BPF_RET ? 0 : -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: uint32_t bpfRun(const struct bpf_program* prog,
+ *                          const uint8_t* packet, unsigned int len)
+ *
+ * runs a validated prog over the frame packet. returns what the program
+ * returned, how many bytes to keep. a load past the end of the frame ends
+ * the program with 0, as does dividing by zero
+ *---------------------------------------------------------------------------*/
+uint32_t bpfRun(const struct bpf_program* prog, const uint8_t* packet, unsigned int len)
+{
+    const struct bpf_insn* pc = prog->insns;
+    uint32_t a = 0, x = 0, k;
+    uint32_t mem[BPF_MEMWORDS] = { 0 };         // as the kernel: unstored words read 0
+
+    for (;; pc++) {
+        switch (pc->code) {
+            case BPF_RET | BPF_K:
+                return pc->k;
+            case BPF_RET | BPF_A:
+                return a;
+
+            case BPF_LD | BPF_W | BPF_ABS:
+                k = pc->k;
+            load32:
+                if (k > len || len - k < 4)
+                    return 0;
+                a = (uint32_t)packet[k] << 24 | (uint32_t)packet[k + 1] << 16 |
+                    (uint32_t)packet[k + 2] << 8 | packet[k + 3];
+                continue;
+            case BPF_LD | BPF_H | BPF_ABS:
+                k = pc->k;
+            load16:
+                if (k > len || len - k < 2)
+                    return 0;
+                a = (uint32_t)packet[k] << 8 | packet[k + 1];
+                continue;
+            case BPF_LD | BPF_B | BPF_ABS:
+                k = pc->k;
+            load8:
+                if (k >= len)
+                    return 0;
+                a = packet[k];
+                continue;
+            case BPF_LD | BPF_W | BPF_IND:
+                k = x + pc->k;
+                if (k < x)
+                    return 0;
+                goto load32;
+            case BPF_LD | BPF_H | BPF_IND:
+                k = x + pc->k;
+                if (k < x)
+                    return 0;
+                goto load16;
+            case BPF_LD | BPF_B | BPF_IND:
+                k = x + pc->k;
+                if (k < x)
+                    return 0;
+                goto load8;
+            case BPF_LDX | BPF_B | BPF_MSH:
+                if (pc->k >= len)
+                    return 0;
+                x = (packet[pc->k] & 0xf) << 2;
+                continue;
+
+            case BPF_LD | BPF_W | BPF_LEN:  a = len; continue;
+            case BPF_LDX | BPF_W | BPF_LEN: x = len; continue;
+            case BPF_LD | BPF_IMM:          a = pc->k; continue;
+            case BPF_LDX | BPF_IMM:         x = pc->k; continue;
+            case BPF_LD | BPF_MEM:          a = mem[pc->k]; continue;
+            case BPF_LDX | BPF_MEM:         x = mem[pc->k]; continue;
+            case BPF_ST:                    mem[pc->k] = a; continue;
+            case BPF_STX:                   mem[pc->k] = x; continue;
+
+            case BPF_ALU | BPF_ADD | BPF_K: a += pc->k; continue;
+            case BPF_ALU | BPF_ADD | BPF_X: a += x; continue;
+            case BPF_ALU | BPF_SUB | BPF_K: a -= pc->k; continue;
+            case BPF_ALU | BPF_SUB | BPF_X: a -= x; continue;
+            case BPF_ALU | BPF_MUL | BPF_K: a *= pc->k; continue;
+            case BPF_ALU | BPF_MUL | BPF_X: a *= x; continue;
+            case BPF_ALU | BPF_DIV | BPF_K: a /= pc->k; continue;
+            case BPF_ALU | BPF_DIV | BPF_X:
+                if (x == 0)
+                    return 0;
+                a /= x;
+                continue;
+            case BPF_ALU | BPF_MOD | BPF_K: a %= pc->k; continue;
+            case BPF_ALU | BPF_MOD | BPF_X:
+                if (x == 0)
+                    return 0;
+                a %= x;
+                continue;
+            case BPF_ALU | BPF_AND | BPF_K: a &= pc->k; continue;
+            case BPF_ALU | BPF_AND | BPF_X: a &= x; continue;
+            case BPF_ALU | BPF_OR | BPF_K:  a |= pc->k; continue;
+            case BPF_ALU | BPF_OR | BPF_X:  a |= x; continue;
+            case BPF_ALU | BPF_XOR | BPF_K: a ^= pc->k; continue;
+            case BPF_ALU | BPF_XOR | BPF_X: a ^= x; continue;
+            case BPF_ALU | BPF_LSH | BPF_K: a <<= pc->k; continue;
+            case BPF_ALU | BPF_LSH | BPF_X: a = x < 32 ? a << x : 0; continue;
+            case BPF_ALU | BPF_RSH | BPF_K: a >>= pc->k; continue;
+            case BPF_ALU | BPF_RSH | BPF_X: a = x < 32 ? a >> x : 0; continue;
+            case BPF_ALU | BPF_NEG:         a = -a; continue;
+
+            case BPF_JMP | BPF_JA:          pc += pc->k; continue;
+            case BPF_JMP | BPF_JEQ | BPF_K: pc += a == pc->k ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JEQ | BPF_X: pc += a == x ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JGT | BPF_K: pc += a > pc->k ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JGT | BPF_X: pc += a > x ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JGE | BPF_K: pc += a >= pc->k ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JGE | BPF_X: pc += a >= x ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JSET | BPF_K: pc += (a & pc->k) ? pc->jt : pc->jf; continue;
+            case BPF_JMP | BPF_JSET | BPF_X: pc += (a & x) ? pc->jt : pc->jf; continue;
+
+            case BPF_MISC | BPF_TAX:        x = a; continue;
+            case BPF_MISC | BPF_TXA:        a = x; continue;
+
+            default:
+                return 0;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void bpfFree(struct bpf_program* prog)
+ *
+ * frees prog's instructions
+ *---------------------------------------------------------------------------*/
+void bpfFree(struct bpf_program* prog)
+{
+    free(prog->insns);
+    prog->insns = NULL;
+    prog->len = 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void bpfLex(struct bpf_compiler* c)
+ *
+ * reads the next token into c->tok: a parenthesis, !, && or ||, or a run of
+ * anything else up to a space or one of those
+ *---------------------------------------------------------------------------*/
+static void bpfLex(struct bpf_compiler* c)
+{
+    const char* p = c->next;
+    int n = 0;
+
+    while (isspace((unsigned char)*p))
+        p++;
+
+    if (*p == '(' || *p == ')' || *p == '!') {
+        c->tok[n++] = *p++;
+    } else if ((p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|')) {
+        c->tok[n++] = *p++;
+        c->tok[n++] = *p++;
+    } else {
+        while (*p && !isspace((unsigned char)*p) && !strchr("()!&|", *p) && n < BPF_TOKLEN - 1)
+            c->tok[n++] = *p++;
+    }
+
+    c->tok[n] = '\0';
+    c->next = p;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct bpf_node* bpfExpr(struct bpf_compiler* c)
+ *
+ * expr := term { or term }
+ *---------------------------------------------------------------------------*/
+static struct bpf_node* bpfExpr(struct bpf_compiler* c)
+{
+    struct bpf_node* node = bpfTerm(c);
+
+    while (node && (strcmp(c->tok, "or") == 0 || strcmp(c->tok, "||") == 0)) {
+        bpfLex(c);
+        node = bpfNode(c, NODE_OR, node, bpfTerm(c));
+    }
+
+    return node;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct bpf_node* bpfTerm(struct bpf_compiler* c)
+ *
+ * term := factor { and factor }
+ *---------------------------------------------------------------------------*/
+static struct bpf_node* bpfTerm(struct bpf_compiler* c)
+{
+    struct bpf_node* node = bpfFactor(c);
+
+    while (node && (strcmp(c->tok, "and") == 0 || strcmp(c->tok, "&&") == 0)) {
+        bpfLex(c);
+        node = bpfNode(c, NODE_AND, node, bpfFactor(c));
+    }
+
+    return node;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct bpf_node* bpfFactor(struct bpf_compiler* c)
+ *
+ * factor := not factor | ( expr ) | primitive
+ *---------------------------------------------------------------------------*/
+static struct bpf_node* bpfFactor(struct bpf_compiler* c)
+{
+    struct bpf_node* node;
+
+    if (strcmp(c->tok, "not") == 0 || strcmp(c->tok, "!") == 0) {
+        bpfLex(c);
+        return bpfNode(c, NODE_NOT, bpfFactor(c), NULL);
+    }
+
+    if (strcmp(c->tok, "(") == 0) {
+        bpfLex(c);
+        node = bpfExpr(c);
+        if (node && strcmp(c->tok, ")") != 0) {
+            c->error = "expected ')' instead of";
+            return NULL;
+        }
+        bpfLex(c);
+        return node;
+    }
+
+    return bpfPrimitive(c);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct bpf_node* bpfPrimitive(struct bpf_compiler* c)
+ *
+ * builds the tests for one primitive out of loads and compares on the
+ * ethernet frame. host and net look at ip and arp addresses, port at tcp
+ * and udp ports of unfragmented or first fragment packets
+ *---------------------------------------------------------------------------*/
+static struct bpf_node* bpfPrimitive(struct bpf_compiler* c)
+{
+    struct bpf_node *ip, *arp, *src, *dst, *node;
+    struct in_addr addr;
+    char* slash;
+    uint32_t n, mask = 0xffffffff;
+    int dir = 0;                                // 1 src, 2 dst, 0 either
+
+    ip = bpfTest(c, BPF_LD | BPF_H | BPF_ABS, 12, 0, BPF_JEQ, 0x0800);
+    arp = bpfTest(c, BPF_LD | BPF_H | BPF_ABS, 12, 0, BPF_JEQ, 0x0806);
+
+    if (strcmp(c->tok, "ip") == 0) {
+        bpfLex(c);
+        return ip;
+    }
+    if (strcmp(c->tok, "arp") == 0) {
+        bpfLex(c);
+        return arp;
+    }
+    if (strcmp(c->tok, "icmp") == 0 || strcmp(c->tok, "tcp") == 0 || strcmp(c->tok, "udp") == 0 ||
+            strcmp(c->tok, "proto") == 0) {
+        if (c->tok[0] == 'i')
+            n = IPPROTO_ICMP;
+        else if (c->tok[0] == 't')
+            n = IPPROTO_TCP;
+        else if (c->tok[0] == 'u')
+            n = IPPROTO_UDP;
+        else if (bpfLex(c), bpfNumber(c, &n, 255) != 0)
+            return NULL;
+        bpfLex(c);
+        return bpfNode(c, NODE_AND, ip, bpfTest(c, BPF_LD | BPF_B | BPF_ABS, 23, 0, BPF_JEQ, n));
+    }
+    if (strcmp(c->tok, "broadcast") == 0) {
+        bpfLex(c);
+        return bpfNode(c, NODE_AND,
+                bpfTest(c, BPF_LD | BPF_W | BPF_ABS, 0, 0, BPF_JEQ, 0xffffffff),
+                bpfTest(c, BPF_LD | BPF_H | BPF_ABS, 4, 0, BPF_JEQ, 0xffff));
+    }
+    if (strcmp(c->tok, "less") == 0 || strcmp(c->tok, "greater") == 0) {
+        dir = c->tok[0] == 'l';
+        bpfLex(c);
+        if (bpfNumber(c, &n, 0xffffffff) != 0)
+            return NULL;
+        bpfLex(c);
+        if (dir)
+            return bpfNode(c, NODE_NOT, bpfTest(c, BPF_LD | BPF_W | BPF_LEN, 0, 0, BPF_JGT, n), NULL);
+        return bpfTest(c, BPF_LD | BPF_W | BPF_LEN, 0, 0, BPF_JGE, n);
+    }
+
+    if (strcmp(c->tok, "src") == 0 || strcmp(c->tok, "dst") == 0) {
+        dir = c->tok[0] == 's' ? 1 : 2;
+        bpfLex(c);
+    }
+
+    if (strcmp(c->tok, "port") == 0) {
+        bpfLex(c);
+        if (bpfNumber(c, &n, 65535) != 0)
+            return NULL;
+        bpfLex(c);
+
+        src = bpfTest(c, BPF_LD | BPF_H | BPF_IND, 14, 0, BPF_JEQ, n);
+        dst = bpfTest(c, BPF_LD | BPF_H | BPF_IND, 16, 0, BPF_JEQ, n);
+        node = dir == 1 ? src : dir == 2 ? dst : bpfNode(c, NODE_OR, src, dst);
+
+        /* tcp or udp, and not a later fragment */
+        return bpfNode(c, NODE_AND,
+                bpfNode(c, NODE_AND, ip,
+                    bpfNode(c, NODE_OR,
+                        bpfTest(c, BPF_LD | BPF_B | BPF_ABS, 23, 0, BPF_JEQ, IPPROTO_TCP),
+                        bpfTest(c, BPF_LD | BPF_B | BPF_ABS, 23, 0, BPF_JEQ, IPPROTO_UDP))),
+                bpfNode(c, NODE_AND,
+                    bpfNode(c, NODE_NOT, bpfTest(c, BPF_LD | BPF_H | BPF_ABS, 20, 0, BPF_JSET, 0x1fff), NULL),
+                    node));
+    }
+
+    if (strcmp(c->tok, "host") == 0 || strcmp(c->tok, "net") == 0) {
+        if (c->tok[0] == 'n')
+            mask = 0;
+        bpfLex(c);
+    }
+
+    /* an address, the host or net keyword may be left out */
+    slash = strchr(c->tok, '/');
+    if (slash) {
+        *slash++ = '\0';
+        if (atoi(slash) < 1 || atoi(slash) > 32 || !isdigit((unsigned char)*slash)) {
+            c->error = "bad prefix length in";
+            return NULL;
+        }
+        mask = 0xffffffff << (32 - atoi(slash));
+    } else if (mask == 0) {
+        c->error = "net needs a prefix length, not";
+        return NULL;
+    }
+    if (inet_pton(AF_INET, c->tok, &addr) != 1) {
+        c->error = c->tok[0] ? "expected a primitive instead of" : "expected a primitive";
+        return NULL;
+    }
+    n = ntohl(addr.s_addr) & mask;
+    bpfLex(c);
+    if (mask == 0xffffffff)
+        mask = 0;
+
+    src = bpfNode(c, NODE_OR,
+            bpfNode(c, NODE_AND, ip, bpfTest(c, BPF_LD | BPF_W | BPF_ABS, 26, mask, BPF_JEQ, n)),
+            bpfNode(c, NODE_AND, arp, bpfTest(c, BPF_LD | BPF_W | BPF_ABS, 28, mask, BPF_JEQ, n)));
+    dst = bpfNode(c, NODE_OR,
+            bpfNode(c, NODE_AND, ip, bpfTest(c, BPF_LD | BPF_W | BPF_ABS, 30, mask, BPF_JEQ, n)),
+            bpfNode(c, NODE_AND, arp, bpfTest(c, BPF_LD | BPF_W | BPF_ABS, 38, mask, BPF_JEQ, n)));
+
+    return dir == 1 ? src : dir == 2 ? dst : bpfNode(c, NODE_OR, src, dst);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct bpf_node* bpfNode(struct bpf_compiler* c, int type,
+ *                  struct bpf_node* left, struct bpf_node* right)
+ *
+ * makes an and, or or not node. returns NULL if a child failed to parse or
+ * we are out of nodes
+ *---------------------------------------------------------------------------*/
+static struct bpf_node* bpfNode(struct bpf_compiler* c, int type,
+        struct bpf_node* left, struct bpf_node* right)
+{
+    struct bpf_node* node;
+
+    if (left == NULL || (type != NODE_NOT && right == NULL))
+        return NULL;
+    if (c->nnodes == BPF_MAXNODES) {
+        c->error = "filter too long";
+        return NULL;
+    }
+
+    node = &c->nodes[c->nnodes++];
+    node->type = type;
+    node->left = left;
+    node->right = right;
+
+    return node;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct bpf_node* bpfTest(struct bpf_compiler* c,
+ *                  uint16_t load, uint32_t offset, uint32_t mask,
+ *                  uint16_t jump, uint32_t value)
+ *
+ * makes a leaf: load, and with mask unless it is 0, and compare with value
+ *---------------------------------------------------------------------------*/
+static struct bpf_node* bpfTest(struct bpf_compiler* c, uint16_t load, uint32_t offset,
+        uint32_t mask, uint16_t jump, uint32_t value)
+{
+    struct bpf_node* node;
+
+    if (c->nnodes == BPF_MAXNODES) {
+        c->error = "filter too long";
+        return NULL;
+    }
+
+    node = &c->nodes[c->nnodes++];
+    node->type = NODE_TEST;
+    node->load = load;
+    node->offset = offset;
+    node->mask = mask;
+    node->jump = jump;
+    node->value = value;
+
+    return node;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int bpfNumber(struct bpf_compiler* c, uint32_t* n,
+ *                          uint32_t max)
+ *
+ * reads the current token as a decimal number no larger than max. returns
+ * 0 on success
+ *---------------------------------------------------------------------------*/
+static int bpfNumber(struct bpf_compiler* c, uint32_t* n, uint32_t max)
+{
+    char* end;
+    unsigned long v;
+
+    v = strtoul(c->tok, &end, 10);
+    if (c->tok[0] == '\0' || *end != '\0' || v > max) {
+        c->error = "expected a number instead of";
+        return -1;
+    }
+
+    *n = v;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int bpfLabel(struct bpf_compiler* c)
+ *
+ * returns a new label, not yet placed
+ *---------------------------------------------------------------------------*/
+static int bpfLabel(struct bpf_compiler* c)
+{
+    if (c->nlabels == BPF_MAXLABELS) {
+        c->error = "filter too long";
+        return 0;
+    }
+
+    c->labels[c->nlabels] = -1;
+    return c->nlabels++;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void bpfPlace(struct bpf_compiler* c, int label)
+ *
+ * makes label mark the next instruction emitted
+ *---------------------------------------------------------------------------*/
+static void bpfPlace(struct bpf_compiler* c, int label)
+{
+    c->labels[label] = c->ninsns;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void bpfEmit(struct bpf_compiler* c, uint16_t code,
+ *                  uint32_t k, int jt, int jf)
+ *
+ * appends an instruction, jumping to labels jt and jf unless they are -1
+ *---------------------------------------------------------------------------*/
+static void bpfEmit(struct bpf_compiler* c, uint16_t code, uint32_t k, int jt, int jf)
+{
+    if (c->ninsns == BPF_MAXINSNS) {
+        c->error = "filter too long";
+        return;
+    }
+
+    c->insns[c->ninsns].code = code;
+    c->insns[c->ninsns].k = k;
+    c->jt[c->ninsns] = jt;
+    c->jf[c->ninsns] = jf;
+    c->ninsns++;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void bpfGen(struct bpf_compiler* c, struct bpf_node* node,
+ *                  int yes, int no)
+ *
+ * emits node so that it jumps to label yes if it holds and to no if not
+ *---------------------------------------------------------------------------*/
+static void bpfGen(struct bpf_compiler* c, struct bpf_node* node, int yes, int no)
+{
+    int next;
+
+    switch (node->type) {
+        case NODE_AND:
+            next = bpfLabel(c);
+            bpfGen(c, node->left, next, no);
+            bpfPlace(c, next);
+            bpfGen(c, node->right, yes, no);
+            break;
+        case NODE_OR:
+            next = bpfLabel(c);
+            bpfGen(c, node->left, yes, next);
+            bpfPlace(c, next);
+            bpfGen(c, node->right, yes, no);
+            break;
+        case NODE_NOT:
+            bpfGen(c, node->left, no, yes);
+            break;
+        case NODE_TEST:
+            if (BPF_MODE(node->load) == BPF_IND)
+                bpfEmit(c, BPF_LDX | BPF_B | BPF_MSH, 14, -1, -1);
+            bpfEmit(c, node->load, node->offset, -1, -1);
+            if (node->mask)
+                bpfEmit(c, BPF_ALU | BPF_AND | BPF_K, node->mask, -1, -1);
+            bpfEmit(c, BPF_JMP | node->jump | BPF_K, node->value, yes, no);
+            break;
+    }
+}
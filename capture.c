@@ -0,0 +1,678 @@
+/*******************************************************************************
+ * file: capture.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the packet capture log. records go round two rings: spare
+ * holds the ones free for a forwarding thread to fill, full the ones
+ * waiting for the writer, which hands them back to spare once copied into
+ * its batch. nothing is allocated per frame and only the writer touches
+ * the files. a pcapng segment describes each interface the first time one
+ * of its frames is written there, so every segment stands on its own.
+ * filters run on the forwarding thread, before a record is even taken, so
+ * a frame nobody wants costs one pass of the filters and nothing more.
+ * compression happens as a batch is written, so it too stays on the writer
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_dumper.h"
+#include "ring.h"
+#include "vclock.h"
+#include "bpf.h"
+#include "lz4.h"
+#include "capture.h"
+
+#define PCAPNG_SHB 0x0a0d0d0a                   // section header block
+#define PCAPNG_IDB 0x00000001                   // interface description block
+#define PCAPNG_EPB 0x00000006                   // enhanced packet block
+#define PCAPNG_BYTE_ORDER 0x1a2b3c4d
+#define PCAPNG_IF_NAME 2
+#define PCAPNG_IF_MACADDR 6
+#define PCAPNG_IF_TSRESOL 9
+#define PCAPNG_EPB_FLAGS 2
+#define PCAPNG_PAD(n) (((n) + 3) & ~3)
+
+static uint32_t captureFilter(struct sr_capture*, const uint8_t*, unsigned int );
+static void* captureWriter(void* );
+static int captureOpenSegment(struct sr_capture* );
+static void captureCloseSegment(struct sr_capture* );
+static void captureAppend(struct sr_capture*, struct capture_record* );
+static int captureInterface(struct sr_capture*, const char* );
+static uint8_t* captureReserve(struct sr_capture*, size_t );
+static uint8_t* capturePut32(uint8_t*, uint32_t );
+static uint8_t* capturePutOption(uint8_t*, uint16_t, const void*, uint16_t );
+static void captureFlush(struct sr_capture* );
+
+/*-----------------------------------------------------------------------------
+ * Method: int captureConfigure(struct capture_config* config, char* opts)
+ *
+ * fills in config from opts, a comma separated list of format=pcap|pcapng,
+ * compress=none|lz4, size=<MB per segment>, time=<seconds per segment>,
+ * files=<segments kept> and prealloc. size counts bytes before compression.
+ * opts is cut up in the process. returns 0 on success, -1 on an option we
+ * do not know
+ *---------------------------------------------------------------------------*/
+int captureConfigure(struct capture_config* config, char* opts)
+{
+    char* opt;
+    char* val;
+    char* save;
+
+    for (opt = strtok_r(opts, ",", &save); opt; opt = strtok_r(NULL, ",", &save)) {
+        val = strchr(opt, '=');
+        if (val)
+            *val++ = '\0';
+
+        if (strcmp(opt, "format") == 0 && val && strcmp(val, "pcap") == 0) {
+            config->format = CAPTURE_PCAP;
+        } else if (strcmp(opt, "format") == 0 && val && strcmp(val, "pcapng") == 0) {
+            config->format = CAPTURE_PCAPNG;
+        } else if (strcmp(opt, "compress") == 0 && val && strcmp(val, "none") == 0) {
+            config->compress = 0;
+        } else if (strcmp(opt, "compress") == 0 && val && strcmp(val, "lz4") == 0) {
+            config->compress = 1;
+        } else if (strcmp(opt, "size") == 0 && val && atoi(val) > 0) {
+            config->segmentSize = (uint64_t)atoi(val) << 20;
+        } else if (strcmp(opt, "time") == 0 && val && atoi(val) > 0) {
+            config->segmentTime = atoi(val);
+        } else if (strcmp(opt, "files") == 0 && val && atoi(val) > 0) {
+            config->segments = atoi(val);
+        } else if (strcmp(opt, "prealloc") == 0 && val == NULL) {
+            config->preallocate = 1;
+        } else {
+            fprintf(stderr, "Error: bad capture option %s%s%s\n", opt, val ? "=" : "", val ? val : "");
+            return -1;
+        }
+    }
+
+    if (config->segments && !config->segmentSize && !config->segmentTime) {
+        fprintf(stderr, "Error: capture files needs a size or time to rotate on\n");
+        return -1;
+    }
+    if (config->preallocate && !config->segmentSize) {
+        fprintf(stderr, "Error: capture prealloc needs a segment size\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int captureAddFilter(struct capture_config* config,
+ *                              const char* spec)
+ *
+ * adds a filter to config. spec is an optional "snaplen N" and "sample N",
+ * then either a filter expression (see bpf.c) or @file, a program in
+ * tcpdump -ddd format. a frame is logged if any filter takes it, keeping
+ * the first such filter's snaplen, and a sampling filter takes only every
+ * Nth frame it matches. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int captureAddFilter(struct capture_config* config, const char* spec)
+{
+    struct capture_filter* filter;
+    unsigned int* field;
+    char* end;
+    unsigned long v;
+
+    if (config->nfilters == CAPTURE_MAX_FILTERS) {
+        fprintf(stderr, "Error: no room for more than %d capture filters\n", CAPTURE_MAX_FILTERS);
+        return -1;
+    }
+    filter = &config->filters[config->nfilters];
+    memset(filter, 0, sizeof(struct capture_filter));
+    filter->snaplen = PACKET_DUMP_SIZE;
+
+    for (;;) {
+        while (*spec == ' ')
+            spec++;
+        if (strncmp(spec, "snaplen ", 8) == 0)
+            field = &filter->snaplen;
+        else if (strncmp(spec, "sample ", 7) == 0)
+            field = &filter->sample;
+        else
+            break;
+
+        spec = strchr(spec, ' ');
+        v = strtoul(spec, &end, 10);
+        if (end == spec || v == 0 || v > 0xffffffff) {
+            fprintf(stderr, "Error: capture filter needs a number after %s\n",
+                    field == &filter->snaplen ? "snaplen" : "sample");
+            return -1;
+        }
+        *field = v;
+        spec = end;
+    }
+    filter->snaplen = min(filter->snaplen, PACKET_DUMP_SIZE);
+
+    if (spec[0] == '@') {
+        if (bpfLoad(&filter->prog, spec + 1) != 0)
+            return -1;
+    } else if (bpfCompile(&filter->prog, spec, filter->snaplen) != 0) {
+        return -1;
+    }
+
+    config->nfilters++;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int captureStart(struct sr_instance* sr, const char* name,
+ *                  const struct capture_config* config, int wait)
+ *
+ * starts logging to name, "-" for stdout, and starts the writer thread.
+ * segments of a rotating log are name.0, name.1 and so on. with wait set a
+ * frame waits for a free record rather than being dropped. returns 0 on
+ * success, -1 on error
+ *---------------------------------------------------------------------------*/
+int captureStart(struct sr_instance* sr, const char* name,
+        const struct capture_config* config, int wait)
+{
+    struct sr_capture* cap;
+    struct capture_record* rec;
+    int i;
+
+    cap = calloc(1, sizeof(struct sr_capture));
+    if (cap == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for capture\n");
+        return -1;
+    }
+    cap->records = malloc(CAPTURE_RECORDS * sizeof(struct capture_record));
+    cap->buf = malloc(CAPTURE_BUF_SIZE);
+    if (config->compress)
+        cap->zbuf = malloc(4 + LZ4_BOUND(CAPTURE_BUF_SIZE));
+    if (cap->records == NULL || cap->buf == NULL || (config->compress && cap->zbuf == NULL)) {
+        fprintf(stderr, "Error: malloc could not find memory for capture\n");
+        free(cap->records);
+        free(cap->buf);
+        free(cap->zbuf);
+        free(cap);
+        return -1;
+    }
+
+    if (ringInit(&cap->spare, CAPTURE_RECORDS, sizeof(struct capture_record*)) != 0 ||
+            ringInit(&cap->full, CAPTURE_RECORDS, sizeof(struct capture_record*)) != 0)
+        return -1;
+    for (i = 0; i < CAPTURE_RECORDS; i++) {
+        rec = &cap->records[i];
+        ringPush(&cap->spare, &rec);
+    }
+
+    cap->sr = sr;
+    cap->config = *config;
+    strncpy(cap->name, name, CAPTURE_NAMELEN - 1);
+    if (strcmp(name, "-") == 0) {
+        /* stdout cannot be rotated or preallocated */
+        cap->config.segmentSize = 0;
+        cap->config.segmentTime = 0;
+        cap->config.preallocate = 0;
+    }
+    cap->wait = wait;
+    cap->running = 1;
+
+    /* open the first segment now, so a bad name fails at startup */
+    if (captureOpenSegment(cap) != 0)
+        return -1;
+    captureFlush(cap);
+
+    if (pthread_create(&cap->thread, NULL, captureWriter, cap) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+
+    __atomic_store_n(&sr->capture, cap, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void captureStop(struct sr_instance* sr)
+ *
+ * lets the writer drain what is queued, closes the log and frees
+ * everything. nothing may be capturing any more
+ *---------------------------------------------------------------------------*/
+void captureStop(struct sr_instance* sr)
+{
+    struct sr_capture* cap = sr->capture;
+    int i;
+
+    if (cap == NULL)
+        return;
+
+    __atomic_store_n(&sr->capture, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&cap->running, 0, __ATOMIC_RELEASE);
+    pthread_join(cap->thread, NULL);
+
+    captureCloseSegment(cap);
+
+    printf("Capture wrote %lu frames in %u segments", cap->frames, cap->segment);
+    if (cap->config.nfilters)
+        printf(", filtered out %lu", cap->filtered);
+    if (cap->drops)
+        printf(", dropped %lu", cap->drops);
+    if (cap->lost)
+        printf(", lost %lu with no segment open", cap->lost);
+    printf("\n");
+
+    for (i = 0; i < cap->config.nfilters; i++)
+        bpfFree(&cap->config.filters[i].prog);
+
+    ringDestroy(&cap->spare);
+    ringDestroy(&cap->full);
+    free(cap->records);
+    free(cap->buf);
+    free(cap->zbuf);
+    free(cap);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void captureFrame(struct sr_instance* sr, uint8_t* packet,
+ *              unsigned int len, const char* interface, int direction)
+ *
+ * queues the first PACKET_DUMP_SIZE bytes of packet, received on or sent
+ * out of interface, for the writer. safe from any thread, and never blocks
+ * unless the capture was started to wait
+ *---------------------------------------------------------------------------*/
+void captureFrame(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+        const char* interface, int direction)
+{
+    struct sr_capture* cap = __atomic_load_n(&sr->capture, __ATOMIC_ACQUIRE);
+    struct capture_record* rec;
+    uint32_t snaplen = PACKET_DUMP_SIZE;
+
+    if (cap == NULL)
+        return;
+
+    if (cap->config.nfilters && (snaplen = captureFilter(cap, packet, len)) == 0) {
+        __atomic_add_fetch(&cap->filtered, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    while (ringPop(&cap->spare, &rec) != 0) {
+        if (!cap->wait) {
+            __atomic_add_fetch(&cap->drops, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        sched_yield();
+    }
+
+    vclockGetTimespec(&rec->ts);
+    rec->len = len;
+    rec->caplen = min(len, snaplen);
+    strncpy(rec->iface, interface, sr_IFACE_NAMELEN);
+    rec->direction = direction;
+    memcpy(rec->data, packet, rec->caplen);
+
+    /* full has a slot for every record, this cannot fail */
+    ringPush(&cap->full, &rec);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint32_t captureFilter(struct sr_capture* cap,
+ *                          const uint8_t* packet, unsigned int len)
+ *
+ * runs the filters over packet until one takes it. returns how many bytes
+ * to keep, 0 if none took it or its sampling passed it over
+ *---------------------------------------------------------------------------*/
+static uint32_t captureFilter(struct sr_capture* cap, const uint8_t* packet, unsigned int len)
+{
+    struct capture_filter* filter;
+    uint32_t keep;
+    int i;
+
+    for (i = 0; i < cap->config.nfilters; i++) {
+        filter = &cap->config.filters[i];
+        keep = bpfRun(&filter->prog, packet, len);
+        if (keep == 0)
+            continue;
+
+        if (filter->sample > 1 &&
+                __atomic_fetch_add(&filter->matches, 1, __ATOMIC_RELAXED) % filter->sample != 0)
+            return 0;
+
+        return min(keep, filter->snaplen);
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* captureWriter(void* arg)
+ *
+ * writer thread body. batches records until the buffer is full or nothing
+ * is queued, then writes the batch out in one go. exits once the capture
+ * stops and the ring is empty
+ *---------------------------------------------------------------------------*/
+static void* captureWriter(void* arg)
+{
+    struct sr_capture* cap = arg;
+    struct capture_record* rec;
+
+    for (;;) {
+        if (ringPop(&cap->full, &rec) != 0) {
+            captureFlush(cap);
+            if (!__atomic_load_n(&cap->running, __ATOMIC_ACQUIRE) && ringCount(&cap->full) == 0)
+                break;
+            usleep(CAPTURE_NAP_US);
+            continue;
+        }
+
+        captureAppend(cap, rec);
+        ringPush(&cap->spare, &rec);
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int captureOpenSegment(struct sr_capture* cap)
+ *
+ * opens the next segment and batches its file header. once files= many
+ * segments exist the oldest name is reused. a compressed segment is one lz4
+ * frame and gets .lz4 added to its name. returns 0 on success, -1 if the
+ * file could not be opened
+ *---------------------------------------------------------------------------*/
+static int captureOpenSegment(struct sr_capture* cap)
+{
+    char name[CAPTURE_NAMELEN + 16];
+    struct pcap_file_header hdr;
+    uint8_t frame[LZ4_HEADER_LEN];
+    uint8_t* p;
+
+    if (strcmp(cap->name, "-") == 0) {
+        cap->fp = stdout;
+    } else {
+        if (cap->config.segmentSize || cap->config.segmentTime)
+            snprintf(name, sizeof(name), "%s.%u", cap->name,
+                    cap->config.segments ? cap->segment % cap->config.segments : cap->segment);
+        else
+            snprintf(name, sizeof(name), "%s", cap->name);
+        if (cap->config.compress)
+            strncat(name, ".lz4", sizeof(name) - strlen(name) - 1);
+
+        cap->fp = fopen(name, "w");
+        if (cap->fp == NULL) {
+            /* a rotation that keeps failing says so once */
+            if (!cap->openFailed)
+                fprintf(stderr, "Error: can't open capture file %s\n", name);
+            return -1;
+        }
+        /* claim the whole segment now, so it does not fragment as it grows */
+        if (cap->config.preallocate)
+            posix_fallocate(fileno(cap->fp), 0, cap->config.segmentSize);
+    }
+
+    if (cap->config.compress) {
+        lz4FrameHeader(frame);
+        fwrite(frame, 1, LZ4_HEADER_LEN, cap->fp);
+    }
+
+    cap->segment++;
+    cap->segmentBytes = 0;
+    cap->segmentStart = 0;                      // the first frame's time
+    cap->nifaces = 0;
+
+    if (cap->config.format == CAPTURE_PCAPNG) {
+        p = captureReserve(cap, 28);
+        p = capturePut32(p, PCAPNG_SHB);
+        p = capturePut32(p, 28);
+        p = capturePut32(p, PCAPNG_BYTE_ORDER);
+        p = capturePut32(p, 1);                 // version 1.0
+        p = capturePut32(p, 0xffffffff);        // section length unknown
+        p = capturePut32(p, 0xffffffff);
+        capturePut32(p, 28);
+    } else {
+        hdr.magic = TCPDUMP_MAGIC;
+        hdr.version_major = PCAP_VERSION_MAJOR;
+        hdr.version_minor = PCAP_VERSION_MINOR;
+        hdr.thiszone = 0;
+        hdr.sigfigs = 0;
+        hdr.snaplen = PACKET_DUMP_SIZE;
+        hdr.linktype = LINKTYPE_ETHERNET;
+        memcpy(captureReserve(cap, sizeof(hdr)), &hdr, sizeof(hdr));
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void captureCloseSegment(struct sr_capture* cap)
+ *
+ * writes out the segment and closes it, giving back what was preallocated
+ * and not used
+ *---------------------------------------------------------------------------*/
+static void captureCloseSegment(struct sr_capture* cap)
+{
+    uint8_t end[4];
+
+    if (cap->fp == NULL)
+        return;
+
+    captureFlush(cap);
+    if (cap->config.compress) {
+        fwrite(end, 1, lz4FrameEnd(end), cap->fp);
+        fflush(cap->fp);
+    }
+
+    if (cap->fp == stdout)
+        return;
+
+    if (cap->config.preallocate && ftruncate(fileno(cap->fp), ftell(cap->fp)) != 0)
+        fprintf(stderr, "Error: can't trim capture segment\n");
+    fclose(cap->fp);
+    cap->fp = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void captureAppend(struct sr_capture* cap,
+ *                          struct capture_record* rec)
+ *
+ * adds rec to the batch, moving to the next segment first if this one is
+ * full or old enough. if the next segment cannot be opened, frames are
+ * counted as lost until the next rotation tries again
+ *---------------------------------------------------------------------------*/
+static void captureAppend(struct sr_capture* cap, struct capture_record* rec)
+{
+    struct pcap_sf_pkthdr hdr;
+    uint64_t ts;
+    uint32_t flags;
+    size_t size;
+    uint8_t* p;
+    int id = 0;
+
+    if (cap->config.format == CAPTURE_PCAPNG)
+        size = 44 + PCAPNG_PAD(rec->caplen);
+    else
+        size = sizeof(hdr) + rec->caplen;
+
+    if (cap->segmentStart == 0)
+        cap->segmentStart = rec->ts.tv_sec;
+
+    if ((cap->config.segmentSize && cap->segmentBytes + size > cap->config.segmentSize) ||
+            (cap->config.segmentTime && rec->ts.tv_sec - cap->segmentStart >= cap->config.segmentTime)) {
+        captureCloseSegment(cap);
+        if (captureOpenSegment(cap) != 0) {
+            if (!cap->openFailed)
+                fprintf(stderr, "Error: capture paused, retrying at the next rotation\n");
+            cap->openFailed = 1;
+            cap->segmentBytes = 0;
+        } else if (cap->openFailed) {
+            fprintf(stderr, "Capture resumed in segment %u, %lu frames lost\n",
+                    cap->segment - 1, cap->lost);
+            cap->openFailed = 0;
+        }
+        cap->segmentStart = rec->ts.tv_sec;
+    }
+    /* nowhere to write. its bytes still count, so a size limit brings
+     * round the next try as well as a time limit */
+    if (cap->fp == NULL) {
+        cap->segmentBytes += size;
+        cap->lost++;
+        return;
+    }
+
+    if (cap->config.format == CAPTURE_PCAPNG) {
+        id = captureInterface(cap, rec->iface);
+        ts = (uint64_t)rec->ts.tv_sec * 1000000000 + rec->ts.tv_nsec;
+        flags = rec->direction;
+
+        p = captureReserve(cap, size);
+        p = capturePut32(p, PCAPNG_EPB);
+        p = capturePut32(p, size);
+        p = capturePut32(p, id);
+        p = capturePut32(p, ts >> 32);
+        p = capturePut32(p, ts);
+        p = capturePut32(p, rec->caplen);
+        p = capturePut32(p, rec->len);
+        memcpy(p, rec->data, rec->caplen);
+        memset(p + rec->caplen, 0, PCAPNG_PAD(rec->caplen) - rec->caplen);
+        p += PCAPNG_PAD(rec->caplen);
+        p = capturePutOption(p, PCAPNG_EPB_FLAGS, &flags, 4);
+        p = capturePutOption(p, 0, NULL, 0);
+        capturePut32(p, size);
+    } else {
+        hdr.ts.tv_sec = rec->ts.tv_sec;
+        hdr.ts.tv_usec = rec->ts.tv_nsec / 1000;
+        hdr.caplen = rec->caplen;
+        hdr.len = rec->len;
+
+        p = captureReserve(cap, size);
+        memcpy(p, &hdr, sizeof(hdr));
+        memcpy(p + sizeof(hdr), rec->data, rec->caplen);
+    }
+
+    cap->frames++;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int captureInterface(struct sr_capture* cap,
+ *                          const char* name)
+ *
+ * returns the pcapng interface id of name in this segment, describing it
+ * first if it has not been seen here yet. interfaces past
+ * CAPTURE_MAX_IFACES all share the last id
+ *---------------------------------------------------------------------------*/
+static int captureInterface(struct sr_capture* cap, const char* name)
+{
+    struct sr_if* iface;
+    uint16_t linktype[2] = { LINKTYPE_ETHERNET, 0 };
+    uint8_t tsresol = 9;                        // nanoseconds
+    uint16_t namelen;
+    size_t size;
+    uint8_t* p;
+    int i;
+
+    for (i = 0; i < cap->nifaces; i++)
+        if (strncmp(cap->ifaces[i], name, sr_IFACE_NAMELEN) == 0)
+            return i;
+    if (cap->nifaces == CAPTURE_MAX_IFACES)
+        return CAPTURE_MAX_IFACES - 1;
+
+    iface = sr_get_interface(cap->sr, name);
+    namelen = strnlen(name, sr_IFACE_NAMELEN);
+    size = 20 + 4 + PCAPNG_PAD(namelen) + 4 + PCAPNG_PAD(1) + 4;
+    if (iface)
+        size += 4 + PCAPNG_PAD(ETHER_ADDR_LEN);
+
+    p = captureReserve(cap, size);
+    p = capturePut32(p, PCAPNG_IDB);
+    p = capturePut32(p, size);
+    memcpy(p, linktype, 4);                     // and two reserved bytes
+    p += 4;
+    p = capturePut32(p, PACKET_DUMP_SIZE);
+    p = capturePutOption(p, PCAPNG_IF_NAME, name, namelen);
+    if (iface)
+        p = capturePutOption(p, PCAPNG_IF_MACADDR, iface->addr, ETHER_ADDR_LEN);
+    p = capturePutOption(p, PCAPNG_IF_TSRESOL, &tsresol, 1);
+    p = capturePutOption(p, 0, NULL, 0);
+    capturePut32(p, size);
+
+    strncpy(cap->ifaces[cap->nifaces], name, sr_IFACE_NAMELEN);
+    return cap->nifaces++;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint8_t* captureReserve(struct sr_capture* cap, size_t n)
+ *
+ * returns room for n more bytes in the batch, writing the batch out first
+ * if there is not enough. n counts toward the segment's size
+ *---------------------------------------------------------------------------*/
+static uint8_t* captureReserve(struct sr_capture* cap, size_t n)
+{
+    uint8_t* p;
+
+    if (cap->buflen + n > CAPTURE_BUF_SIZE)
+        captureFlush(cap);
+
+    p = cap->buf + cap->buflen;
+    cap->buflen += n;
+    cap->segmentBytes += n;
+
+    return p;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint8_t* capturePut32(uint8_t* p, uint32_t v)
+ *
+ * stores v at p, in our byte order as pcapng allows, returns what follows
+ *---------------------------------------------------------------------------*/
+static uint8_t* capturePut32(uint8_t* p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint8_t* capturePutOption(uint8_t* p, uint16_t code,
+ *                          const void* val, uint16_t len)
+ *
+ * stores a pcapng option, padded to 32 bits, returns what follows. code 0
+ * with no value ends the options
+ *---------------------------------------------------------------------------*/
+static uint8_t* capturePutOption(uint8_t* p, uint16_t code, const void* val, uint16_t len)
+{
+    memcpy(p, &code, 2);
+    memcpy(p + 2, &len, 2);
+    p += 4;
+    if (len) {
+        memcpy(p, val, len);
+        memset(p + len, 0, PCAPNG_PAD(len) - len);
+    }
+
+    return p + PCAPNG_PAD(len);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void captureFlush(struct sr_capture* cap)
+ *
+ * writes out the batch, as one lz4 block if compressing
+ *---------------------------------------------------------------------------*/
+static void captureFlush(struct sr_capture* cap)
+{
+    uint8_t* out = cap->buf;
+    size_t len = cap->buflen;
+
+    if (cap->buflen == 0 || cap->fp == NULL)
+        return;
+
+    if (cap->config.compress) {
+        len = lz4FrameBlock(cap->buf, cap->buflen, cap->zbuf);
+        out = cap->zbuf;
+    }
+
+    if (fwrite(out, 1, len, cap->fp) != len)
+        fprintf(stderr, "Error: short write to capture file\n");
+    fflush(cap->fp);
+    cap->buflen = 0;
+}
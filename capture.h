@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * file: capture.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the packet capture log (-l). forwarding threads copy
+ * each frame into a free record and queue it, a writer thread batches the
+ * records into large sequential writes. when no record is free the frame is
+ * counted as dropped instead of stalling forwarding. the log is classic
+ * pcap or pcapng, where every frame keeps its interface and direction, and
+ * can be split into segments by size or age and compressed with lz4 (-c).
+ * BPF filters (-f) pick which frames are worth copying at all
+ ******************************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "ring.h"
+#include "bpf.h"
+
+#define CAPTURE_RECORDS 4096                    // frames in flight, power of two
+#define CAPTURE_BUF_SIZE (1 << 20)              // bytes per write, one lz4 block
+#define CAPTURE_NAP_US 1000                     // writer sleep when idle
+#define CAPTURE_MAX_IFACES 32                   // pcapng interfaces per segment
+#define CAPTURE_NAMELEN 256
+#define CAPTURE_MAX_FILTERS 8
+
+#define CAPTURE_PCAP 0
+#define CAPTURE_PCAPNG 1
+
+#define CAPTURE_IN 1                            // pcapng epb_flags direction
+#define CAPTURE_OUT 2
+
+struct capture_filter {
+    struct bpf_program  prog;
+    uint32_t            snaplen;                // bytes kept, at most PACKET_DUMP_SIZE
+    unsigned int        sample;                 // keep 1 in sample matches, 0 for all
+    unsigned long       matches;
+};
+
+struct capture_config {
+    int             format;                     // CAPTURE_PCAP or CAPTURE_PCAPNG
+    uint64_t        segmentSize;                // bytes per segment, 0 for no limit
+    int             segmentTime;                // seconds per segment, 0 for no limit
+    int             segments;                   // segments kept, 0 for all
+    int             preallocate;                // reserve segmentSize up front
+    int             compress;                   // each segment one lz4 frame
+    struct capture_filter filters[CAPTURE_MAX_FILTERS];
+    int             nfilters;                   // none keeps every frame
+};
+
+struct capture_record {
+    struct timespec ts;
+    unsigned int    len;                        // on the wire
+    unsigned int    caplen;                     // saved, at most PACKET_DUMP_SIZE
+    char            iface[sr_IFACE_NAMELEN];
+    int             direction;                  // CAPTURE_IN or CAPTURE_OUT
+    uint8_t         data[PACKET_DUMP_SIZE];
+};
+
+struct sr_capture {
+    struct sr_instance*     sr;
+    struct capture_config   config;
+    char                    name[CAPTURE_NAMELEN];
+    struct capture_record*  records;
+    struct sr_ring          spare;              // records nobody is using
+    struct sr_ring          full;               // records for the writer
+    pthread_t               thread;
+    int                     running;
+    int                     wait;               // never drop, for offline replay
+    uint8_t*                buf;                // writer's batch
+    uint8_t*                zbuf;               // the batch compressed
+    size_t                  buflen;
+    FILE*                   fp;                 // current segment
+    unsigned int            segment;            // segments opened so far
+    uint64_t                segmentBytes;
+    time_t                  segmentStart;
+    char                    ifaces[CAPTURE_MAX_IFACES][sr_IFACE_NAMELEN];
+    int                     nifaces;            // described in this segment
+    unsigned long           frames;             // written
+    unsigned long           drops;              // no free record
+    unsigned long           lost;               // no segment open
+    int                     openFailed;         // last rotation could not open
+    unsigned long           filtered;           // no filter wanted it
+};
+
+int captureConfigure(struct capture_config*, char* );
+int captureAddFilter(struct capture_config*, const char* );
+int captureStart(struct sr_instance*, const char*, const struct capture_config*, int );
+void captureStop(struct sr_instance* );
+void captureFrame(struct sr_instance*, uint8_t*, unsigned int, const char*, int );
+
+#endif
@@ -2,27 +2,265 @@
  * file: checksum.c
  * date: 10/13/10
  * Andrew Krawchyk
- * 
+ *
  * Description:
- * implements internet checksum algorithm defined by rfc1071
+ * implements internet checksum algorithm defined by rfc1071. the ones
+ * complement sum does not care about byte order or about the order of the
+ * words, so the vector versions widen 16 bit words into 32 bit lanes and
+ * fold once at the end. the best one the cpu runs is picked on first use
  *****************************************************************************/
 
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86
+#endif
+
+#include "checksum.h"
+
+#define CHECKSUM_SIMD_MIN 64        // headers are faster summed a word at a time
+#define CHECKSUM_AVX2_MIN 256       // shorter packets are faster with sse2
+
+static uint16_t checksumResolve(uint16_t* , int );
+static uint16_t checksumScalar(uint16_t* , int );
+static uint64_t checksumSum(const uint8_t* , int );
+static uint16_t checksumFold(uint64_t );
+static int checksumAlways();
+#ifdef CHECKSUM_X86
+static uint16_t checksumSse2(uint16_t* , int );
+static uint16_t checksumAvx2(uint16_t* , int );
+static int checksumHasSse2();
+static int checksumHasAvx2();
+#endif /* CHECKSUM_X86 */
+
+/* fastest first, scalar last */
+static const struct checksum_impl checksumTable[] = {
+#ifdef CHECKSUM_X86
+    { "avx2",   checksumAvx2,   checksumHasAvx2 },
+    { "sse2",   checksumSse2,   checksumHasSse2 },
+#endif /* CHECKSUM_X86 */
+    { "scalar", checksumScalar, checksumAlways },
+};
+
+static uint16_t (*checksumImpl)(uint16_t* , int ) = checksumResolve;
 
 uint16_t in_checksum(uint16_t* addr, int count)
 {
-    register uint32_t sum = 0;
+    /* ip and icmp headers, the common case, skip the indirect call too */
+    if (count < CHECKSUM_SIMD_MIN)
+        return checksumScalar(addr, count);
+
+    return checksumImpl(addr, count);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: uint16_t checksumUpdate16(uint16_t sum, uint16_t old, uint16_t new)
+ *
+ * returns checksum sum after a 16 bit word of what it covers changes from
+ * old to new, without looking at the rest. this is eqn. 3 of rfc1624,
+ * which unlike rfc1141 never turns a checksum into 0xffff. all three are
+ * in the order they sit in the packet
+ *---------------------------------------------------------------------------*/
+uint16_t checksumUpdate16(uint16_t sum, uint16_t old, uint16_t new)
+{
+    return checksumFold((uint64_t)(uint16_t)~sum + (uint16_t)~old + new);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int checksumImpls(const struct checksum_impl** impls)
+ *
+ * points impls at every implementation this cpu can run, fastest first,
+ * and returns how many there are. the scalar one is always last
+ *---------------------------------------------------------------------------*/
+int checksumImpls(const struct checksum_impl** impls)
+{
+    int i, n = sizeof(checksumTable) / sizeof(checksumTable[0]);
+
+    for (i = 0; !checksumTable[i].supported(); i++)
+        ;
+    *impls = &checksumTable[i];
+
+    return n - i;
+}
 
-    while (count > 1) {
-        sum += *addr++;
+/*-----------------------------------------------------------------------------
+ * Method: static uint16_t checksumResolve(uint16_t* addr, int count)
+ *
+ * first call of in_checksum, picks the implementation for good. threads
+ * racing through here all pick the same one
+ *---------------------------------------------------------------------------*/
+static uint16_t checksumResolve(uint16_t* addr, int count)
+{
+    const struct checksum_impl* impls;
+
+    checksumImpls(&impls);
+    __atomic_store_n(&checksumImpl, impls[0].fn, __ATOMIC_RELAXED);
+
+    return impls[0].fn(addr, count);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint16_t checksumScalar(uint16_t* addr, int count)
+ *
+ * portable version
+ *---------------------------------------------------------------------------*/
+static uint16_t checksumScalar(uint16_t* addr, int count)
+{
+    return checksumFold(checksumSum((const uint8_t*)addr, count));
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t checksumSum(const uint8_t* p, int count)
+ *
+ * adds up count bytes as native order 16 bit words, 32 bits at a time into
+ * a 64 bit sum. an odd last byte is padded with zero
+ *---------------------------------------------------------------------------*/
+static uint64_t checksumSum(const uint8_t* p, int count)
+{
+    uint64_t sum = 0;
+    uint32_t word;
+    uint16_t half;
+
+    while (count >= 4) {
+        memcpy(&word, p, 4);
+        sum += word;
+        p += 4;
+        count -= 4;
+    }
+    if (count >= 2) {
+        memcpy(&half, p, 2);
+        sum += half;
+        p += 2;
         count -= 2;
     }
-
     if (count > 0)
-        sum += *((uint8_t*)addr);
+        sum += *p;
 
+    return sum;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint16_t checksumFold(uint64_t sum)
+ *
+ * folds a wide sum down to the 16 bit checksum
+ *---------------------------------------------------------------------------*/
+static uint16_t checksumFold(uint64_t sum)
+{
     while (sum >> 16)
         sum = (sum & 0xffff) + (sum >> 16);
 
-    return(~sum);
+    return ~sum;
 }
+
+static int checksumAlways()
+{
+    return 1;
+}
+
+#ifdef CHECKSUM_X86
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint16_t checksumSse2(uint16_t* addr, int count)
+ *
+ * 32 bytes per iteration. a lane gets two words per iteration, so it
+ * cannot overflow on anything shorter than 1 MB
+ *---------------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static uint16_t checksumSse2(uint16_t* addr, int count)
+{
+    const uint8_t* p = (const uint8_t*)addr;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero, b = zero, v, w;
+    uint32_t lanes[4];
+
+    if (count < CHECKSUM_SIMD_MIN)
+        return checksumScalar(addr, count);
+
+    while (count >= 32) {
+        v = _mm_loadu_si128((const __m128i*)p);
+        w = _mm_loadu_si128((const __m128i*)(p + 16));
+        a = _mm_add_epi32(a, _mm_unpacklo_epi16(v, zero));
+        b = _mm_add_epi32(b, _mm_unpackhi_epi16(v, zero));
+        a = _mm_add_epi32(a, _mm_unpacklo_epi16(w, zero));
+        b = _mm_add_epi32(b, _mm_unpackhi_epi16(w, zero));
+        p += 32;
+        count -= 32;
+    }
+    if (count >= 16) {
+        v = _mm_loadu_si128((const __m128i*)p);
+        a = _mm_add_epi32(a, _mm_unpacklo_epi16(v, zero));
+        b = _mm_add_epi32(b, _mm_unpackhi_epi16(v, zero));
+        p += 16;
+        count -= 16;
+    }
+
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi32(a, b));
+
+    /* at most 15 bytes left */
+    return checksumFold((uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+            checksumSum(p, count));
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint16_t checksumAvx2(uint16_t* addr, int count)
+ *
+ * checksumSse2 at twice the width, 64 bytes per iteration. switching the
+ * cpu into 256 bit mode costs more than it saves on short packets
+ *---------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static uint16_t checksumAvx2(uint16_t* addr, int count)
+{
+    const uint8_t* p = (const uint8_t*)addr;
+    __m256i zero, a, b, v, w;
+    uint32_t lanes[8];
+    uint64_t sum = 0;
+    int i;
+
+    /* before touching a 256 bit register */
+    if (count < CHECKSUM_AVX2_MIN)
+        return checksumSse2(addr, count);
+
+    zero = a = b = _mm256_setzero_si256();
+
+    while (count >= 64) {
+        v = _mm256_loadu_si256((const __m256i*)p);
+        w = _mm256_loadu_si256((const __m256i*)(p + 32));
+        a = _mm256_add_epi32(a, _mm256_unpacklo_epi16(v, zero));
+        b = _mm256_add_epi32(b, _mm256_unpackhi_epi16(v, zero));
+        a = _mm256_add_epi32(a, _mm256_unpacklo_epi16(w, zero));
+        b = _mm256_add_epi32(b, _mm256_unpackhi_epi16(w, zero));
+        p += 64;
+        count -= 64;
+    }
+    if (count >= 32) {
+        v = _mm256_loadu_si256((const __m256i*)p);
+        a = _mm256_add_epi32(a, _mm256_unpacklo_epi16(v, zero));
+        b = _mm256_add_epi32(b, _mm256_unpackhi_epi16(v, zero));
+        p += 32;
+        count -= 32;
+    }
+
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi32(a, b));
+    for (i = 0; i < 8; i++)
+        sum += lanes[i];
+
+    /* sse code after dirty upper halves is slow on some cpus */
+    _mm256_zeroupper();
+
+    /* at most 31 bytes left */
+    return checksumFold(sum + checksumSum(p, count));
+}
+
+static int checksumHasSse2()
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+static int checksumHasAvx2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif /* CHECKSUM_X86 */
@@ -2,16 +2,24 @@
  * file: checksum.h
  * date: 10/13/10
  * Andrew Krawchyk
- * 
+ *
  * Description:
  * contains headers for internet checksum calculation algorithm
  ******************************************************************************/
- 
+
 #ifndef CHECKSUM_H
 #define CHECKSUM_H
- 
+
 #include <stdint.h>
- 
+
+struct checksum_impl {
+    const char*     name;
+    uint16_t        (*fn)(uint16_t* , int );
+    int             (*supported)();
+};
+
 uint16_t in_checksum(uint16_t* addr, int count);
+uint16_t checksumUpdate16(uint16_t, uint16_t, uint16_t );
+int checksumImpls(const struct checksum_impl** );
 
 #endif
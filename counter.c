@@ -0,0 +1,323 @@
+/*******************************************************************************
+ * file: counter.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the counter registry. a thread's first increment allocates
+ * its block, after that counting is a load and a store to a cache line no
+ * other thread writes. totals are only ever added up when someone asks.
+ * the socket thread answers every connection with the totals and hangs
+ * up. a client that starts with an HTTP GET gets an HTTP reply, so curl
+ * --unix-socket works as well as nc -U
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "counter.h"
+
+#define COUNTER_TEXT_MAX 65536
+#define COUNTER_REQUEST_MS 100                  // how long a client has to say GET
+
+struct counter_desc {
+    const char*     metric;
+    const char*     labels;
+    const char*     help;
+};
+
+__thread struct counter_block* counterLocal = NULL;
+
+static const struct counter_desc counterDescs[COUNTER_GLOBALS] = {
+    { "sr_forwarded_packets_total", "", "Packets forwarded to a next hop" },
+    { "sr_arp_lookups_total", "result=\"hit\"", "Next hop hardware address lookups" },
+    { "sr_arp_lookups_total", "result=\"miss\"", NULL },
+    { "sr_arp_sent_total", "op=\"request\"", "ARP packets sent" },
+    { "sr_arp_sent_total", "op=\"reply\"", NULL },
+    { "sr_held_packets_total", "", "Packets that waited in the packet cache for ARP" },
+    { "sr_drops_total", "reason=\"parse\"", "Packets dropped" },
+    { "sr_drops_total", "reason=\"ttl\"", NULL },
+    { "sr_drops_total", "reason=\"no_route\"", NULL },
+    { "sr_drops_total", "reason=\"hold_full\"", NULL },
+    { "sr_drops_total", "reason=\"rx_queue\"", NULL },
+    { "sr_drops_total", "reason=\"tx_queue\"", NULL },
+    { "sr_icmp_sent_total", "type=\"echo_reply\"", "ICMP messages sent" },
+    { "sr_icmp_sent_total", "type=\"time_exceeded\"", NULL },
+    { "sr_icmp_sent_total", "type=\"net_unreachable\"", NULL },
+    { "sr_icmp_sent_total", "type=\"host_unreachable\"", NULL },
+    { "sr_icmp_sent_total", "type=\"port_unreachable\"", NULL },
+};
+
+static const struct counter_desc counterIfaceDescs[COUNTER_PER_IFACE] = {
+    { "sr_rx_packets_total", NULL, "Frames received" },
+    { "sr_rx_bytes_total", NULL, "Bytes received" },
+    { "sr_tx_packets_total", NULL, "Frames sent" },
+    { "sr_tx_bytes_total", NULL, "Bytes sent" },
+};
+
+static struct counter_block* counterBlocks[COUNTER_MAX_THREADS];
+static unsigned int counterThreads = 0;
+static __thread int counterNoRoom = 0;
+
+static struct sr_instance* counterSr;
+static char counterPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static int counterFd = -1;
+
+static void* counterThread(void* );
+static void counterAnswer(int, char* );
+
+/*-----------------------------------------------------------------------------
+ * Method: struct counter_block* counterRegister()
+ *
+ * gives the calling thread its block, NULL once COUNTER_MAX_THREADS have
+ * one. CounterAdd calls this the first time a thread counts anything
+ *---------------------------------------------------------------------------*/
+struct counter_block* counterRegister()
+{
+    struct counter_block* block;
+    unsigned int slot;
+
+    if (counterNoRoom)
+        return NULL;
+
+    slot = __atomic_fetch_add(&counterThreads, 1, __ATOMIC_ACQ_REL);
+    if (slot >= COUNTER_MAX_THREADS) {
+        counterNoRoom = 1;
+        return NULL;
+    }
+
+    if (posix_memalign((void**)&block, COUNTER_CACHE_LINE, sizeof(struct counter_block)) != 0) {
+        fprintf(stderr, "Error: posix_memalign could not find memory for counters\n");
+        counterNoRoom = 1;
+        return NULL;
+    }
+    memset(block, 0, sizeof(struct counter_block));
+
+    __atomic_store_n(&counterBlocks[slot], block, __ATOMIC_RELEASE);
+    counterLocal = block;
+
+    return block;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void counterSum(uint64_t* values)
+ *
+ * adds every thread's block into values, which has COUNTER_SLOTS entries
+ *---------------------------------------------------------------------------*/
+void counterSum(uint64_t* values)
+{
+    struct counter_block* block;
+    unsigned int nthreads, i, j;
+
+    memset(values, 0, COUNTER_SLOTS * sizeof(uint64_t));
+
+    nthreads = __atomic_load_n(&counterThreads, __ATOMIC_ACQUIRE);
+    if (nthreads > COUNTER_MAX_THREADS)
+        nthreads = COUNTER_MAX_THREADS;
+
+    for (i = 0; i < nthreads; i++) {
+        block = __atomic_load_n(&counterBlocks[i], __ATOMIC_ACQUIRE);
+        if (block == NULL)
+            continue;
+        for (j = 0; j < COUNTER_SLOTS; j++)
+            values[j] += __atomic_load_n(&block->values[j], __ATOMIC_RELAXED);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int counterFormat(struct sr_instance* sr, char* buf, size_t size)
+ *
+ * writes the totals into buf in the Prometheus text format. returns the
+ * length, or -1 if it did not fit
+ *---------------------------------------------------------------------------*/
+int counterFormat(struct sr_instance* sr, char* buf, size_t size)
+{
+    uint64_t values[COUNTER_SLOTS];
+    const struct counter_desc* d;
+    struct sr_if* iface;
+    size_t len = 0;
+    int i, n;
+
+    counterSum(values);
+
+    /* each metric's help and type come before its first series */
+    for (i = 0; i < COUNTER_GLOBALS; i++) {
+        d = &counterDescs[i];
+        n = 0;
+        if (d->help)
+            n = snprintf(buf + len, size - len, "# HELP %s %s\n# TYPE %s counter\n",
+                    d->metric, d->help, d->metric);
+        if (n < 0 || (size_t)n >= size - len)
+            return -1;
+        len += n;
+
+        n = snprintf(buf + len, size - len, "%s%s%s%s %llu\n", d->metric,
+                d->labels[0] ? "{" : "", d->labels, d->labels[0] ? "}" : "",
+                (unsigned long long)values[i]);
+        if (n < 0 || (size_t)n >= size - len)
+            return -1;
+        len += n;
+    }
+
+    for (i = 0; i < COUNTER_PER_IFACE; i++) {
+        d = &counterIfaceDescs[i];
+        n = snprintf(buf + len, size - len, "# HELP %s %s\n# TYPE %s counter\n",
+                d->metric, d->help, d->metric);
+        if (n < 0 || (size_t)n >= size - len)
+            return -1;
+        len += n;
+
+        for (iface = sr->if_list; iface && iface->index < COUNTER_MAX_IFACES; iface = iface->next) {
+            n = snprintf(buf + len, size - len, "%s{interface=\"%s\"} %llu\n", d->metric,
+                    iface->name, (unsigned long long)values[COUNTER_IFACE(iface->index, i)]);
+            if (n < 0 || (size_t)n >= size - len)
+                return -1;
+            len += n;
+        }
+    }
+
+    return len;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int counterServe(struct sr_instance* sr, const char* path)
+ *
+ * listens on the unix socket path, replacing whatever was there, and
+ * starts the thread that answers. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int counterServe(struct sr_instance* sr, const char* path)
+{
+    struct sockaddr_un addr;
+    pthread_t thread;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: counter socket name %s is too long\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((counterFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(counterFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(counterFd, 8) != 0) {
+        perror(path);
+        close(counterFd);
+        counterFd = -1;
+        return -1;
+    }
+
+    counterSr = sr;
+    strcpy(counterPath, path);
+
+    if (pthread_create(&thread, NULL, counterThread, NULL) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    pthread_detach(thread);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void counterStop()
+ *
+ * stops answering and removes the socket
+ *---------------------------------------------------------------------------*/
+void counterStop()
+{
+    int fd = __atomic_exchange_n(&counterFd, -1, __ATOMIC_ACQ_REL);
+
+    if (fd < 0)
+        return;
+
+    /* wakes the thread out of accept, and it goes */
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+    unlink(counterPath);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* counterThread(void* arg)
+ *
+ * answers connections until counterStop
+ *---------------------------------------------------------------------------*/
+static void* counterThread(void* arg)
+{
+    char* buf = malloc(COUNTER_TEXT_MAX);
+    int fd, client;
+
+    if (buf == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for counter text\n");
+        return NULL;
+    }
+
+    while ((fd = __atomic_load_n(&counterFd, __ATOMIC_ACQUIRE)) >= 0) {
+        client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        counterAnswer(client, buf);
+        close(client);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void counterAnswer(int client, char* buf)
+ *
+ * writes the totals to client, as an HTTP reply if it asked with GET. a
+ * client that hangs up early gets EPIPE, not a SIGPIPE that kills the router
+ *---------------------------------------------------------------------------*/
+static void counterAnswer(int client, char* buf)
+{
+    struct pollfd pfd;
+    char request[512];
+    char header[128];
+    ssize_t n = 0;
+    int len, http = 0;
+
+    /* nc -U sends nothing, so do not wait long for a request */
+    pfd.fd = client;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, COUNTER_REQUEST_MS) > 0) {
+        /* readable with nothing to read: the client has already gone */
+        if ((n = read(client, request, sizeof(request) - 1)) <= 0)
+            return;
+    }
+    if (n >= 4 && strncmp(request, "GET ", 4) == 0)
+        http = 1;
+
+    len = counterFormat(counterSr, buf, COUNTER_TEXT_MAX);
+    if (len < 0) {
+        fprintf(stderr, "Error: counters do not fit in %d bytes\n", COUNTER_TEXT_MAX);
+        return;
+    }
+
+    if (http) {
+        n = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n", len);
+        if (send(client, header, n, MSG_NOSIGNAL) != n)
+            return;
+    }
+    if (send(client, buf, len, MSG_NOSIGNAL) != len)
+        fprintf(stderr, "Error: short write of counters\n");
+}
@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * file: counter.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the counter registry. every counter has a fixed
+ * slot: the router-wide ones first, then a run of COUNTER_PER_IFACE for
+ * each interface, found by its sr_if index. each thread adds into its own
+ * cache line aligned block with plain stores, and readers sum the blocks.
+ * with -M the totals are served on a unix socket in the Prometheus text
+ * format, to anything that connects
+ ******************************************************************************/
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <stdint.h>
+
+#include "sr_if.h"
+
+#define COUNTER_MAX_THREADS 64
+#define COUNTER_MAX_IFACES 32
+#define COUNTER_CACHE_LINE 64
+
+/* router-wide */
+#define COUNTER_FORWARDED 0
+#define COUNTER_ARP_HITS 1
+#define COUNTER_ARP_MISSES 2
+#define COUNTER_ARP_REQUESTS_SENT 3
+#define COUNTER_ARP_REPLIES_SENT 4
+#define COUNTER_HELD 5                          // waited in the packet cache
+#define COUNTER_DROP_PARSE 6
+#define COUNTER_DROP_TTL 7
+#define COUNTER_DROP_NO_ROUTE 8
+#define COUNTER_DROP_HOLD_FULL 9
+#define COUNTER_DROP_RX_QUEUE 10                // pipeline rings full
+#define COUNTER_DROP_TX_QUEUE 11
+#define COUNTER_ICMP_ECHO_REPLY 12
+#define COUNTER_ICMP_TIME_EXCEEDED 13
+#define COUNTER_ICMP_NET_UNREACHABLE 14
+#define COUNTER_ICMP_HOST_UNREACHABLE 15
+#define COUNTER_ICMP_PORT_UNREACHABLE 16
+#define COUNTER_GLOBALS 17
+
+/* per interface, added to COUNTER_IFACE(index, 0) */
+#define COUNTER_RX_PACKETS 0
+#define COUNTER_RX_BYTES 1
+#define COUNTER_TX_PACKETS 2
+#define COUNTER_TX_BYTES 3
+#define COUNTER_PER_IFACE 4
+
+#define COUNTER_IFACE(index, which) (COUNTER_GLOBALS + (index) * COUNTER_PER_IFACE + (which))
+#define COUNTER_SLOTS (COUNTER_GLOBALS + COUNTER_MAX_IFACES * COUNTER_PER_IFACE)
+
+struct counter_block {
+    uint64_t        values[COUNTER_SLOTS];
+} __attribute__((aligned(COUNTER_CACHE_LINE)));
+
+/* -- only the owning thread writes its block, so no locked add is needed,
+ *    the atomics just keep readers from seeing a torn value -- */
+#define CounterAdd(slot, n) \
+    do { \
+        struct counter_block* block_ = counterLocal; \
+        if (block_ != NULL || (block_ = counterRegister()) != NULL) \
+            __atomic_store_n(&block_->values[slot], \
+                    __atomic_load_n(&block_->values[slot], __ATOMIC_RELAXED) + (n), \
+                    __ATOMIC_RELAXED); \
+    } while (0)
+
+#define CounterInc(slot) CounterAdd(slot, 1)
+
+/* -- iface is a struct sr_if*, interfaces past COUNTER_MAX_IFACES go uncounted -- */
+#define CounterIfaceAdd(iface, which, n) \
+    do { \
+        if ((iface) != NULL && (iface)->index < COUNTER_MAX_IFACES) \
+            CounterAdd(COUNTER_IFACE((iface)->index, which), n); \
+    } while (0)
+
+extern __thread struct counter_block* counterLocal;
+
+struct counter_block* counterRegister();
+void counterSum(uint64_t* );
+int counterFormat(struct sr_instance*, char*, size_t );
+int counterServe(struct sr_instance*, const char* );
+void counterStop();
+
+#endif
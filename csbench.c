@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * file: csbench.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * checks every checksum implementation this cpu can run against the scalar
+ * one, then times each of them over a range of packet sizes. the first one
+ * listed is the one in_checksum uses from CHECKSUM_SIMD_MIN bytes up,
+ * shorter buffers are always summed by the scalar one
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "checksum.h"
+
+#define CSBENCH_BYTES (256 * 1024 * 1024)       // checksummed per size and impl
+#define CSBENCH_MAXLEN 65536
+#define CSBENCH_MAXIMPLS 8
+
+static const int sizes[] = { 20, 64, 128, 576, 1500, 9000, 65535 };
+
+static double elapsedNs(struct timespec* );
+
+int main(int argc, char** argv)
+{
+    const struct checksum_impl* impls;
+    struct timespec start;
+    uint8_t* buf;
+    volatile uint16_t sink = 0;
+    double ns[CSBENCH_MAXIMPLS];
+    int nimpls, i, j, len, off, iters, k;
+
+    nimpls = checksumImpls(&impls);
+    if (nimpls > CSBENCH_MAXIMPLS)
+        nimpls = CSBENCH_MAXIMPLS;
+
+    buf = malloc(CSBENCH_MAXLEN + 64);
+    if (buf == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for the buffer\n");
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < CSBENCH_MAXLEN + 64; i++)
+        buf[i] = rand();
+
+    /* every length near the vector widths, at every alignment */
+    for (i = 0; i < nimpls - 1; i++) {
+        for (len = 0; len < 300; len++) {
+            for (off = 0; off < 64; off++) {
+                if (impls[i].fn((uint16_t*)(buf + off), len) !=
+                        impls[nimpls-1].fn((uint16_t*)(buf + off), len)) {
+                    fprintf(stderr, "Error: %s disagrees with %s at length %d offset %d\n",
+                            impls[i].name, impls[nimpls-1].name, len, off);
+                    return 1;
+                }
+            }
+        }
+        if (impls[i].fn((uint16_t*)buf, CSBENCH_MAXLEN - 1) !=
+                impls[nimpls-1].fn((uint16_t*)buf, CSBENCH_MAXLEN - 1)) {
+            fprintf(stderr, "Error: %s disagrees with %s on a full size packet\n",
+                    impls[i].name, impls[nimpls-1].name);
+            return 1;
+        }
+    }
+
+    printf("%8s", "bytes");
+    for (i = 0; i < nimpls; i++)
+        printf(" %15s", impls[i].name);
+    printf("\n");
+
+    for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+        iters = CSBENCH_BYTES / sizes[j];
+        if (argc > 1)
+            iters /= atoi(argv[1]) > 0 ? atoi(argv[1]) : 1;
+
+        for (i = 0; i < nimpls; i++) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (k = 0; k < iters; k++)
+                sink += impls[i].fn((uint16_t*)buf, sizes[j]);
+            ns[i] = elapsedNs(&start) / iters;
+        }
+
+        /* speedup is against scalar, which is always last */
+        printf("%8d", sizes[j]);
+        for (i = 0; i < nimpls; i++)
+            printf(" %7.1fns %4.1fx", ns[i], ns[nimpls-1] / ns[i]);
+        printf("\n");
+    }
+
+    free(buf);
+
+    return 0;
+}
+
+static double elapsedNs(struct timespec* start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
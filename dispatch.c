@@ -0,0 +1,265 @@
+/*******************************************************************************
+ * file: dispatch.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements protocol dispatch. a key maps straight to a handler slot,
+ * through a byte per possible ethertype and per ip protocol, so dispatch
+ * costs the same however many handlers there are. handlers are registered
+ * at startup, before any packet arrives, and never removed
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "sr_router.h"
+#include "dispatch.h"
+
+struct dispatch_table {
+    const char*             name;
+    uint8_t*                slots;      // key -> handler index + 1, 0 for none
+    unsigned int            nkeys;
+    int                     nhandlers;
+    struct dispatch_handler handlers[DISPATCH_MAX_HANDLERS];
+};
+
+static uint8_t etherSlots[65536];
+static uint8_t ipSlots[256];
+
+static struct dispatch_table dispatchTables[DISPATCH_TABLES] = {
+    { "ethertype",      etherSlots,     65536 },
+    { "ip protocol",    ipSlots,        256 },
+};
+
+static struct dispatch_block* dispatchBlocks[DISPATCH_MAX_THREADS];
+static unsigned int dispatchThreads = 0;
+static __thread struct dispatch_block* dispatchLocal = NULL;
+static __thread int dispatchNoRoom = 0;
+
+static int dispatchRun(int, uint16_t, struct sr_instance*, struct packet_desc*, char* );
+static struct dispatch_block* dispatchBlock();
+static void dispatchAdd(uint64_t*, uint64_t );
+
+/*-----------------------------------------------------------------------------
+ * Method: int dispatchRegister(int table, uint16_t key, const char* name,
+ *                                  dispatch_fn fn)
+ *
+ * makes fn the handler for key in table, DISPATCH_ETHER or DISPATCH_IP.
+ * only call this before packets start flowing. returns 0 on success, -1 if
+ * the key is taken or the table is full
+ *---------------------------------------------------------------------------*/
+int dispatchRegister(int table, uint16_t key, const char* name, dispatch_fn fn)
+{
+    struct dispatch_table* t = &dispatchTables[table];
+    struct dispatch_handler* h;
+
+    if (key >= t->nkeys || t->slots[key]) {
+        fprintf(stderr, "Error: %s %4.4x already has a handler\n", t->name, key);
+        return -1;
+    }
+    if (t->nhandlers == DISPATCH_MAX_HANDLERS) {
+        fprintf(stderr, "Error: no room for another %s handler\n", t->name);
+        return -1;
+    }
+
+    h = &t->handlers[t->nhandlers];
+    h->name = name;
+    h->fn = fn;
+    h->key = key;
+    t->slots[key] = ++t->nhandlers;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int dispatchEther(struct sr_instance* sr, struct packet_desc* desc,
+ *                              char* interface)
+ *
+ * hands a parsed frame to the handler for its ethertype. returns 0 if there
+ * was one, -1 if the frame was not handled
+ *---------------------------------------------------------------------------*/
+int dispatchEther(struct sr_instance* sr, struct packet_desc* desc, char* interface)
+{
+    return dispatchRun(DISPATCH_ETHER, desc->ethertype, sr, desc, interface);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int dispatchIp(struct sr_instance* sr, struct packet_desc* desc,
+ *                          char* interface)
+ *
+ * hands an ip packet addressed to us to the handler for its protocol.
+ * returns 0 if there was one, -1 if the packet was not handled
+ *---------------------------------------------------------------------------*/
+int dispatchIp(struct sr_instance* sr, struct packet_desc* desc, char* interface)
+{
+    return dispatchRun(DISPATCH_IP, desc->proto, sr, desc, interface);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void dispatchCharge(int table, uint16_t key, unsigned long packets,
+ *                              uint64_t start)
+ *
+ * charges the handler for key with packets handled since start, a
+ * dispatchCycles reading. for frames a burst handled without going through
+ * the table
+ *---------------------------------------------------------------------------*/
+void dispatchCharge(int table, uint16_t key, unsigned long packets, uint64_t start)
+{
+    struct dispatch_block* block;
+    uint8_t slot = dispatchTables[table].slots[key];
+
+    if (slot == 0 || (block = dispatchBlock()) == NULL)
+        return;
+
+    dispatchAdd(&block->handlers[table][slot - 1].cycles, dispatchCycles() - start);
+    dispatchAdd(&block->handlers[table][slot - 1].packets, packets);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void dispatchDump()
+ *
+ * prints every handler's counters to stdout, summed over every thread
+ *---------------------------------------------------------------------------*/
+void dispatchDump()
+{
+    struct dispatch_block total;
+    struct dispatch_block* block;
+    struct dispatch_table* t;
+    struct dispatch_handler* h;
+    unsigned int nthreads, n;
+    uint64_t packets;
+    int i, j;
+
+    memset(&total, 0, sizeof(total));
+
+    nthreads = __atomic_load_n(&dispatchThreads, __ATOMIC_ACQUIRE);
+    if (nthreads > DISPATCH_MAX_THREADS)
+        nthreads = DISPATCH_MAX_THREADS;
+
+    for (n = 0; n < nthreads; n++) {
+        if ((block = __atomic_load_n(&dispatchBlocks[n], __ATOMIC_ACQUIRE)) == NULL)
+            continue;
+        for (i = 0; i < DISPATCH_TABLES; i++) {
+            for (j = 0; j < DISPATCH_MAX_HANDLERS; j++) {
+                total.handlers[i][j].packets += __atomic_load_n(&block->handlers[i][j].packets, __ATOMIC_RELAXED);
+                total.handlers[i][j].cycles += __atomic_load_n(&block->handlers[i][j].cycles, __ATOMIC_RELAXED);
+            }
+            total.unhandled[i] += __atomic_load_n(&block->unhandled[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    for (i = 0; i < DISPATCH_TABLES; i++) {
+        t = &dispatchTables[i];
+        for (j = 0; j < t->nhandlers; j++) {
+            h = &t->handlers[j];
+            packets = total.handlers[i][j].packets;
+            printf("Dispatch %s %4.4x %s: %lu packets, %.0f cycles/packet\n",
+                    t->name, h->key, h->name, (unsigned long)packets,
+                    packets ? (double)total.handlers[i][j].cycles / packets : 0.0);
+        }
+        if (total.unhandled[i] != 0)
+            printf("Dispatch %s: %lu packets nobody handled\n", t->name,
+                    (unsigned long)total.unhandled[i]);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int dispatchRun(int table, uint16_t key,
+ *              struct sr_instance* sr, struct packet_desc* desc,
+ *              char* interface)
+ *
+ * calls the handler for key and charges it for the time it took. an ip
+ * handler runs inside the ethertype handler, so ip time is counted twice,
+ * once as ip and once as that protocol
+ *---------------------------------------------------------------------------*/
+static int dispatchRun(int table, uint16_t key, struct sr_instance* sr,
+        struct packet_desc* desc, char* interface)
+{
+    struct dispatch_block* block = dispatchBlock();
+    uint64_t start;
+    uint8_t slot = dispatchTables[table].slots[key];
+
+    if (slot == 0) {
+        if (block)
+            dispatchAdd(&block->unhandled[table], 1);
+        return -1;
+    }
+
+    start = dispatchCycles();
+    dispatchTables[table].handlers[slot - 1].fn(sr, desc, interface);
+    if (block) {
+        dispatchAdd(&block->handlers[table][slot - 1].cycles, dispatchCycles() - start);
+        dispatchAdd(&block->handlers[table][slot - 1].packets, 1);
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct dispatch_block* dispatchBlock()
+ *
+ * the calling thread's counters, made the first time it dispatches. NULL
+ * once DISPATCH_MAX_THREADS have a block, that thread then goes uncounted
+ *---------------------------------------------------------------------------*/
+static struct dispatch_block* dispatchBlock()
+{
+    struct dispatch_block* block;
+    unsigned int slot;
+
+    if (dispatchLocal != NULL || dispatchNoRoom)
+        return dispatchLocal;
+
+    slot = __atomic_fetch_add(&dispatchThreads, 1, __ATOMIC_ACQ_REL);
+    if (slot >= DISPATCH_MAX_THREADS) {
+        dispatchNoRoom = 1;
+        return NULL;
+    }
+
+    if (posix_memalign((void**)&block, DISPATCH_CACHE_LINE, sizeof(struct dispatch_block)) != 0) {
+        fprintf(stderr, "Error: posix_memalign could not find memory for dispatch counters\n");
+        dispatchNoRoom = 1;
+        return NULL;
+    }
+    memset(block, 0, sizeof(struct dispatch_block));
+
+    __atomic_store_n(&dispatchBlocks[slot], block, __ATOMIC_RELEASE);
+    dispatchLocal = block;
+
+    return block;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void dispatchAdd(uint64_t* count, uint64_t n)
+ *
+ * adds n to a count in the calling thread's block. only this thread writes
+ * it, so no locked add, the atomics just keep dispatchDump from a torn read
+ *---------------------------------------------------------------------------*/
+static void dispatchAdd(uint64_t* count, uint64_t n)
+{
+    __atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: uint64_t dispatchCycles()
+ *
+ * returns the cycle counter, or nanoseconds where there is none
+ *---------------------------------------------------------------------------*/
+uint64_t dispatchCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ * file: dispatch.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for protocol dispatch. handlers register for an
+ * ethertype, or for an ip protocol of packets addressed to us, and every
+ * packet reaches its handler through one table lookup. each handler counts
+ * the packets it saw and the cycles it spent on them, in a block of the
+ * calling thread's own, and the blocks are only summed for dispatchDump
+ ******************************************************************************/
+
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <stdint.h>
+
+#include "parse.h"
+
+#define DISPATCH_ETHER 0                // keyed by ethertype
+#define DISPATCH_IP 1                   // keyed by ip protocol, local delivery
+#define DISPATCH_TABLES 2
+#define DISPATCH_MAX_HANDLERS 32        // per table
+#define DISPATCH_MAX_THREADS 64
+#define DISPATCH_CACHE_LINE 64
+
+struct sr_instance;
+
+typedef void (*dispatch_fn)(struct sr_instance*, struct packet_desc*, char* );
+
+struct dispatch_handler {
+    const char*     name;
+    dispatch_fn     fn;
+    uint16_t        key;
+};
+
+struct dispatch_count {
+    uint64_t        packets;
+    uint64_t        cycles;
+};
+
+/* -- one per thread, written only by that thread -- */
+struct dispatch_block {
+    struct dispatch_count   handlers[DISPATCH_TABLES][DISPATCH_MAX_HANDLERS];
+    uint64_t                unhandled[DISPATCH_TABLES];
+} __attribute__((aligned(DISPATCH_CACHE_LINE)));
+
+int dispatchRegister(int, uint16_t, const char*, dispatch_fn );
+int dispatchEther(struct sr_instance*, struct packet_desc*, char* );
+int dispatchIp(struct sr_instance*, struct packet_desc*, char* );
+void dispatchCharge(int, uint16_t, unsigned long, uint64_t );
+uint64_t dispatchCycles();
+void dispatchDump();
+
+#endif
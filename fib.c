@@ -0,0 +1,1053 @@
+/*******************************************************************************
+ * file: fib.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the forwarding table. prefixes are sorted by mask, longest
+ * first, and each mask gets an open addressed hash table keyed on the
+ * masked destination. a lookup probes one table per mask in use and stops
+ * at the first hit, which is the longest match. the match is a group of
+ * equal cost paths, fibSelect picks one by flow hash.
+ *
+ * the current table is published through an rcu protected pointer. lookups
+ * must happen inside rcuReadLock/rcuReadUnlock and never write shared
+ * memory. fibPublish swaps in a new table and frees the old one once no
+ * reader can still be using it
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "sr_rt.h"
+#include "flow.h"
+#include "rcu.h"
+#include "neighbor.h"
+#include "fib.h"
+
+#define FIB_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+
+struct fib_route {
+    uint32_t        dest;
+    uint32_t        mask;
+    uint32_t        plen;
+    uint32_t        order;                      // position in the rtable file
+    struct sr_rt*   rt;
+};
+
+static struct fib* currentFib = NULL;
+static unsigned long fibGeneration = 0;
+static pthread_mutex_t fibWriteLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int fibValidate(const struct fib_hdr*, uint64_t, const char* );
+static struct fib_shm_ctl* fibShmControl(const char*, int );
+static int fibCompareRoutes(const void*, const void* );
+static uint32_t fibNexthopIndex(struct fib_nexthop*, uint32_t*, uint32_t*,
+        uint32_t, struct sr_rt* );
+static uint32_t fibGroupIndex(struct fib_group*, uint32_t*, uint32_t*, uint32_t*,
+        uint32_t*, uint32_t, const uint32_t*, uint32_t );
+static int fibGroupAdds(const struct fib_group*, const uint32_t*, uint32_t, uint32_t );
+static const struct fib_prefix* fibProbe(const struct fib_hdr*, const struct fib_level*, uint32_t );
+static const struct fib_nexthop* fibPickLive(const struct fib*, const struct fib_group* , uint32_t );
+
+/*-----------------------------------------------------------------------------
+ * Method: struct fib* fibBuild(struct sr_rt* rt)
+ *
+ * compiles the routing table list into a new, unpublished table. every
+ * route of a prefix goes into its group, in file order, up to
+ * FIB_MAX_PATHS of them. returns 0 on error
+ *---------------------------------------------------------------------------*/
+struct fib* fibBuild(struct sr_rt* rt)
+{
+    struct fib_route* routes = NULL;
+    struct fib_prefix* prefixes = NULL;
+    struct fib_group* groups = NULL;
+    struct fib_nexthop* nexthops = NULL;
+    uint32_t* members = NULL;
+    uint32_t* nhslots = NULL;
+    uint32_t* grslots = NULL;
+    struct fib_hdr* hdr = NULL;
+    struct fib_level* level;
+    struct fib* fib = NULL;
+    struct sr_rt* walker;
+    uint32_t* slots;
+    uint32_t path[FIB_MAX_PATHS];
+    uint32_t n = 0, nprefixes = 0, ngroups = 0, nmembers = 0, nnexthops = 0, nslots = 0;
+    const struct fib_prefix* cover;
+    uint32_t nlevels = 0, hsize, npaths, i, j, k, l, s;
+    uint64_t size;
+
+    for (walker = rt; walker; walker = walker->next)
+        n++;
+
+    /* scratch space, every array is at most one entry per route */
+    for (hsize = 16; hsize < 2 * n; hsize <<= 1)
+        ;
+    routes = malloc((n ? n : 1) * sizeof(struct fib_route));
+    prefixes = malloc((n ? n : 1) * sizeof(struct fib_prefix));
+    groups = malloc((n ? n : 1) * sizeof(struct fib_group));
+    members = malloc((n ? n : 1) * sizeof(uint32_t));
+    nexthops = calloc((n ? n : 1), sizeof(struct fib_nexthop));
+    nhslots = calloc(hsize, sizeof(uint32_t));
+    grslots = calloc(hsize, sizeof(uint32_t));
+    fib = calloc(1, sizeof(struct fib));
+    if (!routes || !prefixes || !groups || !members || !nexthops || !nhslots || !grslots || !fib) {
+        fprintf(stderr, "Error: malloc could not find memory for fib\n");
+        goto fail;
+    }
+
+    /* canonicalize and sort longest mask first */
+    for (walker = rt, i = 0; walker; walker = walker->next, i++) {
+        routes[i].mask = walker->mask.s_addr;
+        routes[i].dest = walker->dest.s_addr & walker->mask.s_addr;
+        routes[i].plen = __builtin_popcount(walker->mask.s_addr);
+        routes[i].order = i;
+        routes[i].rt = walker;
+    }
+    qsort(routes, n, sizeof(struct fib_route), fibCompareRoutes);
+
+    /* one prefix per run of equal routes, its routes make up its group */
+    for (i = 0; i < n; i = j) {
+        npaths = 0;
+        for (j = i; j < n && routes[j].mask == routes[i].mask && routes[j].dest == routes[i].dest; j++) {
+            s = fibNexthopIndex(nexthops, &nnexthops, nhslots, hsize, routes[j].rt);
+            for (k = 0; k < npaths && path[k] != s; k++)
+                ;
+            if (k < npaths)
+                continue;
+            if (npaths == FIB_MAX_PATHS) {
+                fprintf(stderr, "Warning: more than %d paths to %8.8x/%u, ignoring the rest\n",
+                        FIB_MAX_PATHS, ntohl(routes[i].dest), routes[i].plen);
+                continue;
+            }
+            path[npaths++] = s;
+        }
+
+        prefixes[nprefixes].dest = routes[i].dest;
+        prefixes[nprefixes].mask = routes[i].mask;
+        prefixes[nprefixes].group = fibGroupIndex(groups, &ngroups, members, &nmembers,
+                grslots, hsize, path, npaths);
+        prefixes[nprefixes].backup = 0;
+        routes[nprefixes++] = routes[i];
+    }
+
+    /* one hash table per mask, twice as many slots as prefixes */
+    fib->hdr = hdr = calloc(1, sizeof(struct fib_hdr));
+    if (hdr == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for fib\n");
+        goto fail;
+    }
+    for (i = 0; i < nprefixes; i = j) {
+        if (nlevels == FIB_MAX_LEVELS) {
+            fprintf(stderr, "Error: fib supports at most %d distinct masks\n", FIB_MAX_LEVELS);
+            goto fail;
+        }
+        for (j = i; j < nprefixes && routes[j].mask == routes[i].mask; j++)
+            ;
+        level = &hdr->levels[nlevels++];
+        level->mask = routes[i].mask;
+        level->plen = routes[i].plen;
+        level->slot = nslots;
+        for (level->nslots = 1; level->nslots < 2 * (j - i); level->nslots <<= 1)
+            ;
+        nslots += level->nslots;
+    }
+
+    /* lay out the image: header, prefixes, groups, members, nexthops, then
+     * the hash slots */
+    hdr->prefixOff = FIB_ALIGN(sizeof(struct fib_hdr));
+    hdr->groupOff = FIB_ALIGN(hdr->prefixOff + (uint64_t)nprefixes * sizeof(struct fib_prefix));
+    hdr->memberOff = FIB_ALIGN(hdr->groupOff + (uint64_t)ngroups * sizeof(struct fib_group));
+    hdr->nexthopOff = FIB_ALIGN(hdr->memberOff + (uint64_t)nmembers * sizeof(uint32_t));
+    hdr->slotOff = FIB_ALIGN(hdr->nexthopOff + (uint64_t)nnexthops * sizeof(struct fib_nexthop));
+    size = FIB_ALIGN(hdr->slotOff + (uint64_t)nslots * sizeof(uint32_t));
+
+    fib->hdr = hdr = realloc(hdr, size);
+    if (hdr == NULL) {
+        fprintf(stderr, "Error: realloc could not find memory for fib\n");
+        goto fail;
+    }
+    memset((uint8_t*)hdr + sizeof(struct fib_hdr), 0, size - sizeof(struct fib_hdr));
+
+    memcpy((uint8_t*)hdr + hdr->prefixOff, prefixes, nprefixes * sizeof(struct fib_prefix));
+    memcpy((uint8_t*)hdr + hdr->groupOff, groups, ngroups * sizeof(struct fib_group));
+    memcpy((uint8_t*)hdr + hdr->memberOff, members, nmembers * sizeof(uint32_t));
+    memcpy((uint8_t*)hdr + hdr->nexthopOff, nexthops, nnexthops * sizeof(struct fib_nexthop));
+    slots = (uint32_t*)((uint8_t*)hdr + hdr->slotOff);
+
+    /* hash each prefix into its level */
+    for (i = 0, level = hdr->levels; i < nprefixes; i++) {
+        if (prefixes[i].mask != level->mask)
+            level++;
+
+        s = flowMix(prefixes[i].dest) & (level->nslots - 1);
+        while (slots[level->slot + s])
+            s = (s + 1) & (level->nslots - 1);
+        slots[level->slot + s] = i + 1;
+    }
+
+    /* precompute backups: the closest shorter prefix covering each prefix
+     * that has a path the prefix itself does not. that is where its traffic
+     * would go if the prefix were withdrawn, so it cannot loop back to us
+     * any more than the covering route already could. lookups need the
+     * level count, the rest of the header is filled in below */
+    hdr->nlevels = nlevels;
+    for (i = 0, l = 0; i < nprefixes; i++) {
+        if (prefixes[i].mask != hdr->levels[l].mask)
+            l++;
+
+        for (k = l + 1; k < nlevels; k++) {
+            cover = fibProbe(hdr, &hdr->levels[k], prefixes[i].dest & hdr->levels[k].mask);
+            if (cover && fibGroupAdds(groups, members, prefixes[i].group, cover->group)) {
+                ((struct fib_prefix*)((uint8_t*)hdr + hdr->prefixOff))[i].backup = cover->group + 1;
+                break;
+            }
+        }
+    }
+
+    hdr->magic = FIB_MAGIC;
+    hdr->version = FIB_VERSION;
+    hdr->size = size;
+    hdr->nprefixes = nprefixes;
+    hdr->ngroups = ngroups;
+    hdr->nmembers = nmembers;
+    hdr->nnexthops = nnexthops;
+    hdr->nslots = nslots;
+
+    free(routes);
+    free(prefixes);
+    free(groups);
+    free(members);
+    free(nexthops);
+    free(nhslots);
+    free(grslots);
+
+    return fib;
+
+fail:
+    free(routes);
+    free(prefixes);
+    free(groups);
+    free(members);
+    free(nexthops);
+    free(nhslots);
+    free(grslots);
+    if (fib)
+        free(fib->hdr);
+    free(fib);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: struct fib* fibMap(const char* path)
+ *
+ * loads a snapshot written by fibSave. the file is mapped, not read, so
+ * even a full table is ready as soon as its header has been checked. the
+ * file must be replaced by rename, never rewritten in place, while a
+ * router has it mapped. returns 0 on error
+ *---------------------------------------------------------------------------*/
+struct fib* fibMap(const char* path)
+{
+    struct fib* fib;
+    struct stat st;
+    void* map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct fib_hdr)) {
+        fprintf(stderr, "Error: %s is not a fib snapshot\n", path);
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    if (fibValidate(map, st.st_size, path) != 0) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    fib = calloc(1, sizeof(struct fib));
+    if (fib == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for fib\n");
+        munmap(map, st.st_size);
+        return 0;
+    }
+    fib->hdr = map;
+    fib->mapped = 1;
+
+    return fib;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int fibSave(const struct fib* fib, const char* path)
+ *
+ * writes the image of fib to path. the data goes to a temporary file that
+ * is renamed over path, so a router mapping the old file is not disturbed.
+ * returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int fibSave(const struct fib* fib, const char* path)
+{
+    char tmp[BUFSIZ];
+    const uint8_t* p = (const uint8_t*)fib->hdr;
+    uint64_t left = fib->hdr->size;
+    ssize_t n;
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror(tmp);
+        return -1;
+    }
+
+    while (left > 0) {
+        if ((n = write(fd, p, left)) <= 0) {
+            perror(tmp);
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        p += n;
+        left -= n;
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: struct fib* fibShmAttach(const char* name)
+ *
+ * maps the current generation of the shared fib called name, read-only.
+ * every process attached to the same generation shares one copy of the
+ * table, and a new process finds it already in memory. returns 0 on error
+ *---------------------------------------------------------------------------*/
+struct fib* fibShmAttach(const char* name)
+{
+    char seg[BUFSIZ];
+    struct fib* fib;
+    struct stat st;
+    uint64_t gen;
+    void* map;
+    int fd, tries;
+
+    /* the publisher unlinks a generation as soon as it replaces it, so we
+     * may lose a race with it. just look again */
+    for (tries = 0; ; tries++) {
+        if ((gen = fibShmGeneration(name)) == 0) {
+            fprintf(stderr, "Error: no shared fib called %s\n", name);
+            return 0;
+        }
+        snprintf(seg, sizeof(seg), FIB_SHM_PREFIX "%s.%llu", name, (unsigned long long)gen);
+        if ((fd = shm_open(seg, O_RDONLY, 0)) >= 0)
+            break;
+        if (errno != ENOENT || tries == 3) {
+            perror(seg);
+            return 0;
+        }
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct fib_hdr)) {
+        fprintf(stderr, "Error: %s is not a fib snapshot\n", seg);
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    if (fibValidate(map, st.st_size, seg) != 0) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    fib = calloc(1, sizeof(struct fib));
+    if (fib == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for fib\n");
+        munmap(map, st.st_size);
+        return 0;
+    }
+    fib->hdr = map;
+    fib->mapped = 1;
+    fib->shared = gen;
+
+    return fib;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int fibShmPublish(const struct fib* fib, const char* name)
+ *
+ * copies fib into a new generation of the shared fib called name, creating
+ * it if needed. the image is complete before the generation is bumped, so
+ * an attaching process never sees a partial table. returns 0 on success,
+ * -1 on error
+ *---------------------------------------------------------------------------*/
+int fibShmPublish(const struct fib* fib, const char* name)
+{
+    char seg[BUFSIZ];
+    struct fib_shm_ctl* ctl;
+    uint64_t gen;
+    void* map;
+    int fd, lockfd;
+
+    snprintf(seg, sizeof(seg), FIB_SHM_PREFIX "%s", name);
+    if ((lockfd = shm_open(seg, O_RDWR | O_CREAT, 0644)) < 0) {
+        perror(seg);
+        return -1;
+    }
+    /* one publisher at a time */
+    flock(lockfd, LOCK_EX);
+
+    if ((ctl = fibShmControl(name, 1)) == NULL) {
+        close(lockfd);
+        return -1;
+    }
+    gen = ctl->generation + 1;
+
+    snprintf(seg, sizeof(seg), FIB_SHM_PREFIX "%s.%llu", name, (unsigned long long)gen);
+    shm_unlink(seg);
+    if ((fd = shm_open(seg, O_RDWR | O_CREAT | O_EXCL, 0444)) < 0 ||
+            ftruncate(fd, fib->hdr->size) != 0) {
+        perror(seg);
+        goto fail;
+    }
+    map = mmap(NULL, fib->hdr->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    fd = -1;
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        goto fail;
+    }
+    memcpy(map, fib->hdr, fib->hdr->size);
+    munmap(map, fib->hdr->size);
+
+    __atomic_store_n(&ctl->generation, gen, __ATOMIC_RELEASE);
+
+    /* processes still using the old generation keep their mapping */
+    snprintf(seg, sizeof(seg), FIB_SHM_PREFIX "%s.%llu", name, (unsigned long long)(gen - 1));
+    shm_unlink(seg);
+
+    munmap(ctl, sizeof(struct fib_shm_ctl));
+    close(lockfd);
+
+    return 0;
+
+fail:
+    if (fd >= 0)
+        close(fd);
+    shm_unlink(seg);
+    munmap(ctl, sizeof(struct fib_shm_ctl));
+    close(lockfd);
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: uint64_t fibShmGeneration(const char* name)
+ *
+ * returns the current generation of the shared fib called name, 0 if it
+ * does not exist or has never been published
+ *---------------------------------------------------------------------------*/
+uint64_t fibShmGeneration(const char* name)
+{
+    struct fib_shm_ctl* ctl;
+    uint64_t gen;
+
+    if ((ctl = fibShmControl(name, 0)) == NULL)
+        return 0;
+    gen = __atomic_load_n(&ctl->generation, __ATOMIC_ACQUIRE);
+    munmap(ctl, sizeof(struct fib_shm_ctl));
+
+    return gen;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void fibRelease(struct fib* fib)
+ *
+ * frees a table that is not published, or no longer visible to readers
+ *---------------------------------------------------------------------------*/
+void fibRelease(struct fib* fib)
+{
+    if (fib == NULL)
+        return;
+
+    if (fib->mapped)
+        munmap(fib->hdr, fib->hdr->size);
+    else
+        free(fib->hdr);
+    free(fib->weights);
+    free(fib);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void fibPublish(struct fib* fib)
+ *
+ * makes fib the table every lookup uses from now on. readers never wait on
+ * this, we wait for them: the old table is freed only after every read
+ * section that might have seen it is done
+ *---------------------------------------------------------------------------*/
+void fibPublish(struct fib* fib)
+{
+    struct fib* old;
+
+    pthread_mutex_lock(&fibWriteLock);
+
+    fib->generation = ++fibGeneration;
+    old = __atomic_exchange_n(&currentFib, fib, __ATOMIC_ACQ_REL);
+
+    /* shards caching nexthops of old see the new generation on their next
+     * lookup and drop them */
+    rcuSynchronize();
+    fibRelease(old);
+
+    /* next hops that left with old give up their neighbor slots */
+    neighborPrune(fib->hdr);
+
+    pthread_mutex_unlock(&fibWriteLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: struct fib* fibCurrent()
+ *
+ * returns the published table. only valid inside a read section, or on the
+ * thread that publishes
+ *---------------------------------------------------------------------------*/
+struct fib* fibCurrent()
+{
+    return __atomic_load_n(&currentFib, __ATOMIC_ACQUIRE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void fibSetWeights(struct fib* fib, uint32_t* weights)
+ *
+ * gives fib a weight for each of its nexthops, fibSelect then splits flows
+ * in proportion. fib takes ownership of weights, 0 goes back to equal
+ * cost. fib may be published, readers are never blocked
+ *---------------------------------------------------------------------------*/
+void fibSetWeights(struct fib* fib, uint32_t* weights)
+{
+    uint32_t* old;
+
+    old = __atomic_exchange_n(&fib->weights, weights, __ATOMIC_ACQ_REL);
+    if (old) {
+        rcuSynchronize();
+        free(old);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_prefix* fibLookup(const struct fib* fib,
+ *                                              uint32_t dst)
+ *
+ * longest prefix match on dst, network order. returns 0 if nothing matches.
+ * the result belongs to fib and is only valid until rcuReadUnlock
+ *---------------------------------------------------------------------------*/
+const struct fib_prefix* fibLookup(const struct fib* fib, uint32_t dst)
+{
+    const struct fib_hdr* hdr;
+    const struct fib_prefix* prefix;
+    uint32_t l;
+
+    if (fib == NULL)
+        return 0;
+
+    hdr = fib->hdr;
+    for (l = 0; l < hdr->nlevels; l++) {
+        if ((prefix = fibProbe(hdr, &hdr->levels[l], dst & hdr->levels[l].mask)) != NULL)
+            return prefix;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_nexthop* fibSelect(const struct fib* fib,
+ *                              const struct fib_prefix* prefix, uint32_t hash)
+ *
+ * picks the path of prefix, a prefix of fib, that carries the flow with
+ * this hash. the same flow always gets the same path while its neighbors
+ * are alive. if its path is dead the flow moves to a live path of the
+ * same prefix, then to the backup. with nothing alive we stay on the
+ * primary, arp will keep trying it
+ *---------------------------------------------------------------------------*/
+const struct fib_nexthop* fibSelect(const struct fib* fib, const struct fib_prefix* prefix, uint32_t hash)
+{
+    const struct fib_nexthop* nexthops = fibNexthops(fib->hdr);
+    const struct fib_group* group = &fibGroups(fib->hdr)[prefix->group];
+    const uint32_t* members = fibMembers(fib->hdr) + group->member;
+    const struct fib_nexthop* nexthop;
+    const struct fib_nexthop* alt;
+    const uint32_t* weights;
+    uint64_t total = 0, pick;
+    uint32_t i;
+
+    if (group->count == 1) {
+        nexthop = &nexthops[members[0]];
+    } else {
+        /* the pipeline picked a worker with hash % nworkers, remix so every
+         * worker still uses every path */
+        hash = flowMix(hash);
+
+        weights = __atomic_load_n(&fib->weights, __ATOMIC_ACQUIRE);
+        if (weights) {
+            for (i = 0; i < group->count; i++)
+                total += weights[members[i]];
+        }
+        if (total == 0) {
+            nexthop = &nexthops[members[hash % group->count]];
+        } else {
+            pick = hash % total;
+            for (i = 0; pick >= weights[members[i]]; i++)
+                pick -= weights[members[i]];
+            nexthop = &nexthops[members[i]];
+        }
+    }
+
+    /* the common case, every neighbor is up */
+    if (!neighborIsDead(nexthop->gw))
+        return nexthop;
+
+    if ((alt = fibPickLive(fib, group, hash)) != NULL)
+        return alt;
+    if (prefix->backup && (alt = fibPickLive(fib, &fibGroups(fib->hdr)[prefix->backup - 1], hash)) != NULL)
+        return alt;
+
+    return nexthop;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_prefix* fibFind(const struct fib_hdr* hdr,
+ *                                      uint32_t dest, uint32_t mask)
+ *
+ * exact match on a prefix of any table, for comparing two tables. returns
+ * 0 if hdr has no route for dest/mask
+ *---------------------------------------------------------------------------*/
+const struct fib_prefix* fibFind(const struct fib_hdr* hdr, uint32_t dest, uint32_t mask)
+{
+    uint32_t l;
+
+    for (l = 0; l < hdr->nlevels; l++) {
+        if (hdr->levels[l].mask == mask)
+            return fibProbe(hdr, &hdr->levels[l], dest);
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int fibSameGroup(const struct fib_hdr* ha, const struct fib_group* a,
+ *                          const struct fib_hdr* hb, const struct fib_group* b)
+ *
+ * returns 1 if group a of ha and group b of hb have the same members in the
+ * same order, which means they hash flows the same way
+ *---------------------------------------------------------------------------*/
+int fibSameGroup(const struct fib_hdr* ha, const struct fib_group* a,
+        const struct fib_hdr* hb, const struct fib_group* b)
+{
+    const struct fib_nexthop* na;
+    const struct fib_nexthop* nb;
+    uint32_t i;
+
+    if (a->count != b->count)
+        return 0;
+
+    for (i = 0; i < a->count; i++) {
+        na = &fibNexthops(ha)[fibMembers(ha)[a->member + i]];
+        nb = &fibNexthops(hb)[fibMembers(hb)[b->member + i]];
+        if (na->gw != nb->gw || strncmp(na->interface, nb->interface, sr_IFACE_NAMELEN) != 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_nexthop* fibNexthops(const struct fib_hdr* hdr)
+ *
+ * returns the nexthop array of an image
+ *---------------------------------------------------------------------------*/
+const struct fib_nexthop* fibNexthops(const struct fib_hdr* hdr)
+{
+    return (const struct fib_nexthop*)((const uint8_t*)hdr + hdr->nexthopOff);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_prefix* fibPrefixes(const struct fib_hdr* hdr)
+ *
+ * returns the prefix array of an image
+ *---------------------------------------------------------------------------*/
+const struct fib_prefix* fibPrefixes(const struct fib_hdr* hdr)
+{
+    return (const struct fib_prefix*)((const uint8_t*)hdr + hdr->prefixOff);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_group* fibGroups(const struct fib_hdr* hdr)
+ *
+ * returns the group array of an image
+ *---------------------------------------------------------------------------*/
+const struct fib_group* fibGroups(const struct fib_hdr* hdr)
+{
+    return (const struct fib_group*)((const uint8_t*)hdr + hdr->groupOff);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const uint32_t* fibMembers(const struct fib_hdr* hdr)
+ *
+ * returns the member array of an image, nexthop indexes of every group
+ *---------------------------------------------------------------------------*/
+const uint32_t* fibMembers(const struct fib_hdr* hdr)
+{
+    return (const uint32_t*)((const uint8_t*)hdr + hdr->memberOff);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int fibValidate(const struct fib_hdr* hdr, uint64_t size,
+ *                                  const char* path)
+ *
+ * checks that an image read from disk cannot send a lookup outside of it.
+ * every index is checked, which is linear but far cheaper than a rebuild.
+ * returns 0 if the image is usable
+ *---------------------------------------------------------------------------*/
+static int fibValidate(const struct fib_hdr* hdr, uint64_t size, const char* path)
+{
+    const struct fib_prefix* prefixes;
+    const struct fib_group* groups;
+    const uint32_t* members;
+    const struct fib_nexthop* nexthops;
+    const uint32_t* slots;
+    uint32_t i, l, s, used, nslots = 0;
+
+    if (hdr->magic != FIB_MAGIC) {
+        fprintf(stderr, "Error: %s is not a fib snapshot\n", path);
+        return -1;
+    }
+    if (hdr->version != FIB_VERSION) {
+        fprintf(stderr, "Error: %s is fib snapshot version %u, we read version %u\n",
+                path, hdr->version, FIB_VERSION);
+        return -1;
+    }
+
+    if (hdr->size != size || hdr->nlevels > FIB_MAX_LEVELS ||
+            hdr->prefixOff < sizeof(struct fib_hdr) ||
+            hdr->prefixOff + (uint64_t)hdr->nprefixes * sizeof(struct fib_prefix) > hdr->groupOff ||
+            hdr->groupOff + (uint64_t)hdr->ngroups * sizeof(struct fib_group) > hdr->memberOff ||
+            hdr->memberOff + (uint64_t)hdr->nmembers * sizeof(uint32_t) > hdr->nexthopOff ||
+            hdr->nexthopOff + (uint64_t)hdr->nnexthops * sizeof(struct fib_nexthop) > hdr->slotOff ||
+            hdr->slotOff + (uint64_t)hdr->nslots * sizeof(uint32_t) > size)
+        goto corrupt;
+
+    for (i = 0; i < hdr->nlevels; i++) {
+        if (hdr->levels[i].nslots == 0 ||
+                (hdr->levels[i].nslots & (hdr->levels[i].nslots - 1)) != 0 ||
+                hdr->levels[i].slot != nslots)
+            goto corrupt;
+        nslots += hdr->levels[i].nslots;
+    }
+    if (nslots != hdr->nslots)
+        goto corrupt;
+
+    prefixes = fibPrefixes(hdr);
+    groups = fibGroups(hdr);
+    members = fibMembers(hdr);
+    nexthops = fibNexthops(hdr);
+    slots = (const uint32_t*)((const uint8_t*)hdr + hdr->slotOff);
+
+    for (i = 0; i < hdr->nprefixes; i++) {
+        if (prefixes[i].group >= hdr->ngroups || prefixes[i].backup > hdr->ngroups)
+            goto corrupt;
+    }
+    for (i = 0; i < hdr->ngroups; i++) {
+        if (groups[i].count == 0 || groups[i].count > FIB_MAX_PATHS ||
+                (uint64_t)groups[i].member + groups[i].count > hdr->nmembers)
+            goto corrupt;
+    }
+    for (i = 0; i < hdr->nmembers; i++) {
+        if (members[i] >= hdr->nnexthops)
+            goto corrupt;
+    }
+    for (i = 0; i < hdr->nnexthops; i++) {
+        if (memchr(nexthops[i].interface, '\0', sr_IFACE_NAMELEN) == NULL)
+            goto corrupt;
+    }
+    /* a level with no empty slot would make a miss probe forever */
+    for (l = 0; l < hdr->nlevels; l++) {
+        for (i = 0, used = 0; i < hdr->levels[l].nslots; i++) {
+            s = slots[hdr->levels[l].slot + i];
+            if (s > hdr->nprefixes)
+                goto corrupt;
+            used += (s != 0);
+        }
+        if (used == hdr->levels[l].nslots)
+            goto corrupt;
+    }
+
+    return 0;
+
+corrupt:
+    fprintf(stderr, "Error: fib snapshot %s is corrupt\n", path);
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct fib_shm_ctl* fibShmControl(const char* name,
+ *                                                  int writable)
+ *
+ * maps the control segment of the shared fib called name. a writer creates
+ * it if needed. returns 0 on error, or if it does not exist and we only
+ * want to read it
+ *---------------------------------------------------------------------------*/
+static struct fib_shm_ctl* fibShmControl(const char* name, int writable)
+{
+    char seg[BUFSIZ];
+    struct fib_shm_ctl* ctl;
+    struct stat st;
+    int fd;
+
+    snprintf(seg, sizeof(seg), FIB_SHM_PREFIX "%s", name);
+    if ((fd = shm_open(seg, writable ? O_RDWR : O_RDONLY, 0)) < 0) {
+        if (writable || errno != ENOENT)
+            perror(seg);
+        return 0;
+    }
+
+    if (fstat(fd, &st) != 0 || (st.st_size < sizeof(struct fib_shm_ctl) &&
+                (!writable || ftruncate(fd, sizeof(struct fib_shm_ctl)) != 0))) {
+        /* a reader may come along before the first publish sized it */
+        if (writable)
+            perror(seg);
+        close(fd);
+        return 0;
+    }
+
+    ctl = mmap(NULL, sizeof(struct fib_shm_ctl),
+            writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ctl == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    if (ctl->magic == 0) {
+        if (!writable) {
+            munmap(ctl, sizeof(struct fib_shm_ctl));
+            return 0;
+        }
+        ctl->magic = FIB_MAGIC;
+        ctl->version = FIB_VERSION;
+    }
+    if (ctl->magic != FIB_MAGIC || ctl->version != FIB_VERSION) {
+        fprintf(stderr, "Error: %s is not a shared fib of version %u\n", seg, FIB_VERSION);
+        munmap(ctl, sizeof(struct fib_shm_ctl));
+        return 0;
+    }
+
+    return ctl;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int fibCompareRoutes(const void* a, const void* b)
+ *
+ * qsort order: longest mask first, then by mask, destination and file order
+ *---------------------------------------------------------------------------*/
+static int fibCompareRoutes(const void* a, const void* b)
+{
+    const struct fib_route* ra = a;
+    const struct fib_route* rb = b;
+
+    if (ra->plen != rb->plen)
+        return (ra->plen > rb->plen) ? -1 : 1;
+    if (ra->mask != rb->mask)
+        return (ra->mask < rb->mask) ? -1 : 1;
+    if (ra->dest != rb->dest)
+        return (ra->dest < rb->dest) ? -1 : 1;
+    if (ra->order != rb->order)
+        return (ra->order < rb->order) ? -1 : 1;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint32_t fibNexthopIndex(struct fib_nexthop* nexthops,
+ *              uint32_t* nnexthops, uint32_t* nhslots, uint32_t nhsize,
+ *              struct sr_rt* rt)
+ *
+ * returns the index of rt's gateway and interface in nexthops, adding it if
+ * this is the first route through it. nhslots is a scratch hash of indexes
+ *---------------------------------------------------------------------------*/
+static uint32_t fibNexthopIndex(struct fib_nexthop* nexthops, uint32_t* nnexthops,
+        uint32_t* nhslots, uint32_t nhsize, struct sr_rt* rt)
+{
+    uint32_t h = rt->gw.s_addr;
+    const char* c;
+    uint32_t s, i;
+
+    for (c = rt->interface; *c && c < rt->interface + sr_IFACE_NAMELEN; c++)
+        h = h * 31 + *c;
+
+    s = flowMix(h) & (nhsize - 1);
+    while ((i = nhslots[s]) != 0) {
+        if (nexthops[i-1].gw == rt->gw.s_addr &&
+                strncmp(nexthops[i-1].interface, rt->interface, sr_IFACE_NAMELEN) == 0)
+            return i - 1;
+        s = (s + 1) & (nhsize - 1);
+    }
+
+    i = (*nnexthops)++;
+    nexthops[i].gw = rt->gw.s_addr;
+    strncpy(nexthops[i].interface, rt->interface, sr_IFACE_NAMELEN);
+    nhslots[s] = i + 1;
+
+    return i;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint32_t fibGroupIndex(struct fib_group* groups,
+ *              uint32_t* ngroups, uint32_t* members, uint32_t* nmembers,
+ *              uint32_t* grslots, uint32_t grsize, const uint32_t* path,
+ *              uint32_t npaths)
+ *
+ * returns the index of the group with exactly these nexthops, adding it if
+ * this is the first prefix using them. grslots is a scratch hash of indexes
+ *---------------------------------------------------------------------------*/
+static uint32_t fibGroupIndex(struct fib_group* groups, uint32_t* ngroups,
+        uint32_t* members, uint32_t* nmembers, uint32_t* grslots, uint32_t grsize,
+        const uint32_t* path, uint32_t npaths)
+{
+    uint32_t h = npaths;
+    uint32_t s, i;
+
+    for (i = 0; i < npaths; i++)
+        h = h * 31 + path[i];
+
+    s = flowMix(h) & (grsize - 1);
+    while ((i = grslots[s]) != 0) {
+        if (groups[i-1].count == npaths &&
+                memcmp(&members[groups[i-1].member], path, npaths * sizeof(uint32_t)) == 0)
+            return i - 1;
+        s = (s + 1) & (grsize - 1);
+    }
+
+    i = (*ngroups)++;
+    groups[i].member = *nmembers;
+    groups[i].count = npaths;
+    memcpy(&members[*nmembers], path, npaths * sizeof(uint32_t));
+    *nmembers += npaths;
+    grslots[s] = i + 1;
+
+    return i;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int fibGroupAdds(const struct fib_group* groups,
+ *              const uint32_t* members, uint32_t group, uint32_t other)
+ *
+ * returns 1 if group other has a nexthop that group does not
+ *---------------------------------------------------------------------------*/
+static int fibGroupAdds(const struct fib_group* groups, const uint32_t* members,
+        uint32_t group, uint32_t other)
+{
+    uint32_t i, j;
+
+    for (i = 0; i < groups[other].count; i++) {
+        for (j = 0; j < groups[group].count; j++) {
+            if (members[groups[other].member + i] == members[groups[group].member + j])
+                break;
+        }
+        if (j == groups[group].count)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static const struct fib_prefix* fibProbe(const struct fib_hdr* hdr,
+ *                              const struct fib_level* level, uint32_t key)
+ *
+ * looks up the masked destination key in the hash table of one level
+ *---------------------------------------------------------------------------*/
+static const struct fib_prefix* fibProbe(const struct fib_hdr* hdr,
+        const struct fib_level* level, uint32_t key)
+{
+    const struct fib_prefix* prefixes = fibPrefixes(hdr);
+    const uint32_t* slots = (const uint32_t*)((const uint8_t*)hdr + hdr->slotOff) + level->slot;
+    uint32_t s, i;
+
+    s = flowMix(key) & (level->nslots - 1);
+    while ((i = slots[s]) != 0) {
+        if (prefixes[i-1].dest == key)
+            return &prefixes[i-1];
+        s = (s + 1) & (level->nslots - 1);
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static const struct fib_nexthop* fibPickLive(const struct fib* fib,
+ *                              const struct fib_group* group, uint32_t hash)
+ *
+ * returns a member of group whose neighbor is not dead, chosen by hash so
+ * flows off a dead path spread over the live ones, in proportion to their
+ * weights if fib has them. 0 if all are dead
+ *---------------------------------------------------------------------------*/
+static const struct fib_nexthop* fibPickLive(const struct fib* fib,
+        const struct fib_group* group, uint32_t hash)
+{
+    const struct fib_nexthop* nexthops = fibNexthops(fib->hdr);
+    const uint32_t* members = fibMembers(fib->hdr) + group->member;
+    const uint32_t* weights = __atomic_load_n(&fib->weights, __ATOMIC_ACQUIRE);
+    uint64_t total = 0, pick;
+    uint32_t i, m;
+
+    /* the same weighted pick as fibSelect, over the live members only */
+    if (weights) {
+        for (i = 0; i < group->count; i++) {
+            if (!neighborIsDead(nexthops[members[i]].gw))
+                total += weights[members[i]];
+        }
+        pick = total ? hash % total : 0;
+        for (i = 0; i < group->count && total; i++) {
+            m = members[i];
+            if (neighborIsDead(nexthops[m].gw))
+                continue;
+            if (pick < weights[m])
+                return &nexthops[m];
+            pick -= weights[m];
+        }
+    }
+
+    for (i = 0; i < group->count; i++) {
+        m = members[(hash + i) % group->count];
+        if (!neighborIsDead(nexthops[m].gw))
+            return &nexthops[m];
+    }
+
+    return 0;
+}
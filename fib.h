@@ -0,0 +1,120 @@
+/*******************************************************************************
+ * file: fib.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the forwarding table. the routing table list is
+ * compiled into a single read-only image with a longest prefix match
+ * structure. a prefix listed more than once becomes an equal cost group,
+ * and fibSelect spreads flows over its members. each prefix also carries
+ * a backup group, the paths of the closest shorter prefix covering it,
+ * which fibSelect falls back to when the neighbor table says every path
+ * of the prefix is dead. the image holds offsets rather than pointers so
+ * it can live anywhere in memory. readers find the current image with one
+ * load and writers replace it with one pointer swap. the same image,
+ * written to a file with fibSave, is the binary snapshot format that
+ * fibMap loads, and placed in shared memory with fibShmPublish it is one
+ * table any number of router processes can map read-only with
+ * fibShmAttach
+ ******************************************************************************/
+
+#ifndef FIB_H
+#define FIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sr_if.h"
+
+#define FIB_MAGIC 0x53524642                    // "SRFB"
+#define FIB_VERSION 3
+#define FIB_MAX_LEVELS 33                       // one per prefix length
+#define FIB_MAX_PATHS 16                        // next hops in one ecmp group
+
+struct fib_nexthop {
+    uint32_t        gw;                         // gateway ip, network order
+    char            interface[sr_IFACE_NAMELEN];
+};
+
+struct fib_prefix {
+    uint32_t        dest;                       // network order, masked
+    uint32_t        mask;                       // network order
+    uint32_t        group;                      // index into the groups
+    uint32_t        backup;                     // group index + 1, 0 for none
+};
+
+/* every route of a prefix, equal cost. prefixes with the same paths share
+ * one group */
+struct fib_group {
+    uint32_t        member;                     // first index into the members
+    uint32_t        count;                      // 1 to FIB_MAX_PATHS
+};
+
+struct fib_level {
+    uint32_t        mask;                       // network order
+    uint32_t        plen;                       // bits set in mask
+    uint32_t        slot;                       // first hash slot of this level
+    uint32_t        nslots;                     // power of two
+};
+
+struct fib_hdr {
+    uint32_t            magic;
+    uint32_t            version;
+    uint64_t            size;                   // bytes in the whole image
+    uint32_t            nprefixes;
+    uint32_t            ngroups;
+    uint32_t            nmembers;               // nexthop indexes of the groups
+    uint32_t            nnexthops;
+    uint32_t            nlevels;                // longest mask first
+    uint32_t            nslots;
+    uint64_t            prefixOff;              // byte offsets from the header
+    uint64_t            groupOff;
+    uint64_t            memberOff;
+    uint64_t            nexthopOff;
+    uint64_t            slotOff;
+    struct fib_level    levels[FIB_MAX_LEVELS];
+};
+
+struct fib {
+    struct fib_hdr*     hdr;                    // the image
+    unsigned long       generation;             // set when published
+    int                 mapped;                 // munmap, not free
+    uint64_t            shared;                 // shm generation, 0 if private
+    uint32_t*           weights;                // per nexthop, 0 for equal cost
+};
+
+/* a shared fib called name lives in two posix shm segments: the control
+ * segment /sr-fib-<name> holds the current generation, and the image of
+ * each generation is in /sr-fib-<name>.<generation> */
+#define FIB_SHM_PREFIX "/sr-fib-"
+
+struct fib_shm_ctl {
+    uint32_t            magic;
+    uint32_t            version;
+    uint64_t            generation;             // 0 until the first publish
+};
+
+struct sr_rt;
+
+struct fib* fibBuild(struct sr_rt* );
+struct fib* fibMap(const char* );
+int fibSave(const struct fib*, const char* );
+struct fib* fibShmAttach(const char* );
+int fibShmPublish(const struct fib*, const char* );
+uint64_t fibShmGeneration(const char* );
+void fibRelease(struct fib* );
+void fibPublish(struct fib* );
+struct fib* fibCurrent();
+void fibSetWeights(struct fib*, uint32_t* );
+const struct fib_prefix* fibLookup(const struct fib*, uint32_t );
+const struct fib_nexthop* fibSelect(const struct fib*, const struct fib_prefix*, uint32_t );
+const struct fib_prefix* fibFind(const struct fib_hdr*, uint32_t, uint32_t );
+int fibSameGroup(const struct fib_hdr*, const struct fib_group*,
+        const struct fib_hdr*, const struct fib_group* );
+const struct fib_nexthop* fibNexthops(const struct fib_hdr* );
+const struct fib_prefix* fibPrefixes(const struct fib_hdr* );
+const struct fib_group* fibGroups(const struct fib_hdr* );
+const uint32_t* fibMembers(const struct fib_hdr* );
+
+#endif
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * file: flow.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements a symmetric hash over the IPv4 5-tuple of an ethernet frame.
+ * addresses and ports are put in a canonical order before mixing, so a
+ * packet and its reply always pick the same worker or the same path
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "sr_protocol.h"
+#include "flow.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: uint32_t flowMix(uint32_t h)
+ *
+ * murmur3 finalizer, spreads every input bit over the whole word
+ *---------------------------------------------------------------------------*/
+uint32_t flowMix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: uint32_t flowHash(const uint8_t* packet, unsigned int len)
+ *
+ * hashes the ip addresses, protocol and, for tcp and udp, the ports. arp
+ * hashes on the sender and target ip so it stays with the traffic it
+ * resolves. anything else hashes to zero
+ *---------------------------------------------------------------------------*/
+uint32_t flowHash(const uint8_t* packet, unsigned int len)
+{
+    const struct sr_ethernet_hdr* ethernetHdr = (const struct sr_ethernet_hdr*)packet;
+    const struct ip* ipHdr;
+    const struct sr_arphdr* arpHdr;
+    const uint8_t* l4;
+    uint32_t a, b, lo, hi, ports = 0;
+    uint16_t sport, dport;
+
+    if (len < sizeof(struct sr_ethernet_hdr))
+        return 0;
+
+    if (ethernetHdr->ether_type == htons(ETHERTYPE_ARP)) {
+        if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arphdr))
+            return 0;
+        arpHdr = (const struct sr_arphdr*)(packet + sizeof(struct sr_ethernet_hdr));
+        return flowMix(arpHdr->ar_sip ^ arpHdr->ar_tip);
+    }
+
+    if (ethernetHdr->ether_type != htons(ETHERTYPE_IP) ||
+            len < sizeof(struct sr_ethernet_hdr) + sizeof(struct ip))
+        return 0;
+
+    ipHdr = (const struct ip*)(packet + sizeof(struct sr_ethernet_hdr));
+    a = ipHdr->ip_src.s_addr;
+    b = ipHdr->ip_dst.s_addr;
+    lo = (a < b) ? a : b;
+    hi = (a < b) ? b : a;
+
+    /* ports only mean something on the first fragment */
+    l4 = (const uint8_t*)ipHdr + ipHdr->ip_hl * 4;
+    if ((ipHdr->ip_p == IPPROTO_TCP || ipHdr->ip_p == IPPROTO_UDP) &&
+            (ntohs(ipHdr->ip_off) & IP_OFFMASK) == 0 &&
+            l4 + 4 <= packet + len) {
+        sport = (l4[0] << 8) | l4[1];
+        dport = (l4[2] << 8) | l4[3];
+        ports = (sport < dport) ? ((uint32_t)sport << 16 | dport) : ((uint32_t)dport << 16 | sport);
+    }
+
+    return flowMix(flowMix(flowMix(lo) ^ hi) ^ ports ^ ipHdr->ip_p);
+}
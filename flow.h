@@ -0,0 +1,19 @@
+/*******************************************************************************
+ * file: flow.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for flow hashing. the hash is symmetric, so both
+ * directions of a conversation hash to the same value
+ ******************************************************************************/
+
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stdint.h>
+
+uint32_t flowHash(const uint8_t*, unsigned int );
+uint32_t flowMix(uint32_t );
+
+#endif
@@ -8,8 +8,10 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "sr_if.h"
 #include "sr_rt.h"
@@ -20,86 +22,226 @@
 #include "icmp.h"
 #include "ip.h"
 #include "forward.h"
+#include "shard.h"
+#include "vclock.h"
+#include "fib.h"
+#include "rcu.h"
+#include "flow.h"
+#include "neighbor.h"
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
+#include "counter.h"
 
-/* length of zero signifies empty spot in cache */
+/* length of zero signifies empty spot in cache. worker threads share it, so
+ * every access goes through packetLock. when both locks are needed, take
+ * packetLock before the arp cache lock */
 struct packet_cache_entry packetCache[PACKET_CACHE_SIZE];
+static pthread_mutex_t packetLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int reroutePacket(struct sr_instance*, struct fib*, int );
+static void cacheSendUnreachable(struct sr_instance*, int, uint8_t );
+static void forwardLog(uint8_t* );
 
 /*-----------------------------------------------------------------------------
  * Method: void handleForward
  *
- * determines what interface to send a packet out of
+ * determines what interface to send a packet out of. the longest matching
+ * prefix wins, the default route is just the 0.0.0.0/0 entry. when the
+ * prefix has several paths, the flow hash keeps each flow on one of them.
+ * packets out of hops get time exceeded
  *---------------------------------------------------------------------------*/
 void handleForward(
         struct sr_instance* sr,
-        uint8_t* packet,
-        unsigned int len,
+        struct packet_desc* desc,
         char* interface )
 {
-    struct ip* ipHdr = (struct ip*)(packet+14);
-    struct sr_rt* rtptr = sr->routing_table;
-    int cachedEntry;
+    uint8_t* packet = desc->packet;
+    unsigned int len = desc->len;
+    struct ip* ipHdr = (struct ip*)(packet + desc->l3);
+    const struct fib_nexthop* nexthop;
+    struct sr_if* out;
+    uint8_t desthwaddr[ETHER_ADDR_LEN];
+    uint64_t start;
+    int found;
 
-    /* loop through rtable for the next hop with the packet's destination ip */
-    while (rtptr) {
-        if (rtptr->dest.s_addr == ipHdr->ip_dst.s_addr)
-            break;
-        else
-            rtptr = rtptr->next;
+    /* a packet with no hops left dies here */
+    if (ipHdr->ip_ttl <= 1) {
+        Trace(TRACE_DROP, sr_get_interface(sr, interface), len, desc->dst, TRACE_DROP_TTL);
+        CounterInc(COUNTER_DROP_TTL);
+        icmpSendError(sr, desc, interface, ICMP_TIME_EXCEEDED, ICMP_TTL_EXCEEDED);
+        return;
     }
 
-    /* if not in our rtable, send it out eth0 to the intarwebz */
-    if (!rtptr) {
-        rtptr = sr->routing_table;          // eth0
-        if ((cachedEntry = arpSearchCache(rtptr->gw.s_addr)) > -1) {
-            forwardPacket(sr, packet, len, rtptr->interface, arpReturnEntryMac(cachedEntry));
-        } else {
-            cachePacket(sr, packet, len, rtptr);
-        }
+    /* find the next hop, from this thread's route cache if we can */
+    start = LatencyStart();
+    nexthop = shardLookupRoute(desc->dst, flowHash(packet, len));
+    LatencyEnd(LATENCY_ROUTE, start);
+    if (!nexthop) {
+        Trace(TRACE_DROP, sr_get_interface(sr, interface), len, desc->dst, TRACE_DROP_NO_ROUTE);
+        CounterInc(COUNTER_DROP_NO_ROUTE);
+        icmpSendUnreachable(sr, desc, interface, ICMP_NET_UNREACHABLE);
+        return;
     }
+    out = sr_get_interface(sr, nexthop->interface);
+    Trace(TRACE_ROUTE, out, len, desc->dst, nexthop->gw);
+
+    /* the one hop we are, once, before it can wait in the packet cache */
+    ipSetTtl(ipHdr, ipHdr->ip_ttl - 1);
     
     /* look through arp cache for mac matching the ip destination. if we have it,
      * forward our packet. otherwise, cache the packet and wait for an arp reply
      * to tell us the correct mac address */
-    if ((cachedEntry = arpSearchCache(rtptr->gw.s_addr)) > -1) {
-        forwardPacket(sr, packet, len, rtptr->interface, arpReturnEntryMac(cachedEntry));       
+    start = LatencyStart();
+    found = shardLookupAdjacency(nexthop->gw, desthwaddr);
+    LatencyEnd(LATENCY_ADJACENCY, start);
+    if (found) {
+        Trace(TRACE_ARP_HIT, out, len, nexthop->gw, 0);
+        CounterInc(COUNTER_ARP_HITS);
+        forwardPacket(sr, packet, len, out, desthwaddr);
     } else {
-        cachePacket(sr, packet, len, rtptr);
+        Trace(TRACE_ARP_MISS, out, len, nexthop->gw, 0);
+        CounterInc(COUNTER_ARP_MISSES);
+        cachePacket(sr, packet, len, nexthop);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void handleForwardBurst(struct sr_instance* sr,
+ *                  struct packet_desc** descs, char** interfaces, int n)
+ *
+ * handleForward for a burst of at most SR_BURST_MAX transit packets, run
+ * one stage at a time over all of them: route lookups, ttl, adjacencies,
+ * ethernet rewrites and finally the sends. a packet that drops out at a
+ * stage is skipped by the ones after it
+ *---------------------------------------------------------------------------*/
+void handleForwardBurst(
+        struct sr_instance* sr,
+        struct packet_desc** descs,
+        char** interfaces,
+        int n )
+{
+    const struct fib_nexthop* nexthops[SR_BURST_MAX];
+    struct sr_if* outs[SR_BURST_MAX];
+    uint8_t desthwaddrs[SR_BURST_MAX][ETHER_ADDR_LEN];
+    struct packet_desc* desc;
+    struct ip* ipHdr;
+    uint64_t start;
+    int i, found;
+
+    /* routes, prefetching the header the next lookup hashes */
+    for (i = 0; i < n; i++) {
+        if (i + 1 < n)
+            __builtin_prefetch(descs[i + 1]->packet + descs[i + 1]->l3);
+
+        desc = descs[i];
+        ipHdr = (struct ip*)(desc->packet + desc->l3);
+        nexthops[i] = NULL;
+
+        if (ipHdr->ip_ttl <= 1) {
+            Trace(TRACE_DROP, sr_get_interface(sr, interfaces[i]), desc->len, desc->dst, TRACE_DROP_TTL);
+            CounterInc(COUNTER_DROP_TTL);
+            icmpSendError(sr, desc, interfaces[i], ICMP_TIME_EXCEEDED, ICMP_TTL_EXCEEDED);
+            continue;
+        }
+
+        start = LatencyStart();
+        nexthops[i] = shardLookupRoute(desc->dst, flowHash(desc->packet, desc->len));
+        LatencyEnd(LATENCY_ROUTE, start);
+        if (!nexthops[i]) {
+            Trace(TRACE_DROP, sr_get_interface(sr, interfaces[i]), desc->len, desc->dst,
+                    TRACE_DROP_NO_ROUTE);
+            CounterInc(COUNTER_DROP_NO_ROUTE);
+            icmpSendUnreachable(sr, desc, interfaces[i], ICMP_NET_UNREACHABLE);
+            continue;
+        }
+        outs[i] = sr_get_interface(sr, nexthops[i]->interface);
+        Trace(TRACE_ROUTE, outs[i], desc->len, desc->dst, nexthops[i]->gw);
+    }
+
+    /* ttl, before anything can wait in the packet cache */
+    for (i = 0; i < n; i++) {
+        if (!nexthops[i])
+            continue;
+        ipHdr = (struct ip*)(descs[i]->packet + descs[i]->l3);
+        ipSetTtl(ipHdr, ipHdr->ip_ttl - 1);
+    }
+
+    /* adjacencies, misses wait for arp */
+    for (i = 0; i < n; i++) {
+        if (!nexthops[i])
+            continue;
+        start = LatencyStart();
+        found = shardLookupAdjacency(nexthops[i]->gw, desthwaddrs[i]);
+        LatencyEnd(LATENCY_ADJACENCY, start);
+        if (!found) {
+            Trace(TRACE_ARP_MISS, outs[i], descs[i]->len, nexthops[i]->gw, 0);
+            CounterInc(COUNTER_ARP_MISSES);
+            cachePacket(sr, descs[i]->packet, descs[i]->len, nexthops[i]);
+            nexthops[i] = NULL;
+            continue;
+        }
+        Trace(TRACE_ARP_HIT, outs[i], descs[i]->len, nexthops[i]->gw, 0);
+        CounterInc(COUNTER_ARP_HITS);
+    }
+
+    /* ethernet rewrites */
+    for (i = 0; i < n; i++) {
+        if (!nexthops[i])
+            continue;
+        makeethernet((struct sr_ethernet_hdr*)descs[i]->packet, ETHERTYPE_IP,
+                outs[i]->addr, desthwaddrs[i]);
+    }
+
+    /* and out they go */
+    for (i = 0; i < n; i++) {
+        if (!nexthops[i])
+            continue;
+        sr_send_packet(sr, descs[i]->packet, descs[i]->len, nexthops[i]->interface);
+        forwardLog(descs[i]->packet);
     }
 }
 
 /*-----------------------------------------------------------------------------
  * Method: void forwardPacket
  *
- * builds the headers to forward the tcp/udp data
+ * builds the headers to forward the tcp/udp data out of iface
  *---------------------------------------------------------------------------*/
 void forwardPacket(
         struct sr_instance* sr,
         uint8_t* packet,
         unsigned int len,
-        char* interface,
+        struct sr_if* iface,
         uint8_t* desthwaddr )
 {
     struct sr_ethernet_hdr* ethernetHdr = (struct sr_ethernet_hdr*)packet;
-    struct ip* ipHdr = (struct ip*)(packet+14);
-    struct in_addr forwarded;
-    int i;
     
-    makeethernet(ethernetHdr, ntohs(ethernetHdr->ether_type),
-            sr_get_interface(sr, interface)->addr, desthwaddr);
+    makeethernet(ethernetHdr, ntohs(ethernetHdr->ether_type), iface->addr, desthwaddr);
 
-    sr_send_packet(sr, packet, len, interface);
+    sr_send_packet(sr, packet, len, iface->name);
 
-    // log on send
-    forwarded.s_addr = ipHdr->ip_dst.s_addr;
-    printf("<- Forwarded packet with ip_dst %s to ", inet_ntoa(forwarded));
-    for (i = 0; i < ETHER_ADDR_LEN; i++)
-        printf("%2.2x", ethernetHdr->ether_dhost[i]);
-    printf("\n");
+    forwardLog(packet);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void forwardLog(uint8_t* packet)
+ *
+ * counts and logs a forwarded packet once it is sent
+ *---------------------------------------------------------------------------*/
+static void forwardLog(uint8_t* packet)
+{
+    struct sr_ethernet_hdr* ethernetHdr = (struct sr_ethernet_hdr*)packet;
+    struct ip* ipHdr = (struct ip*)(packet+14);
+
+    CounterInc(COUNTER_FORWARDED);
+
+    LogDebug(LOG_FORWARD, "<- Forwarded packet with ip_dst %s to %s",
+            logAddr(ipHdr->ip_dst), logMac(ethernetHdr->ether_dhost));
 }
 
 /*-----------------------------------------------------------------------------
  * Method: void cachePacket(struct sr_instance* sr, uint8_t* packet,
- *                              unsigned int len, struct sr_rt* rtptr)
+ *                      unsigned int len, const struct fib_nexthop* nexthop)
  *
  * sends a request for the hwaddr of the ipaddr we have, stores our packet
  * until we have an arp entry that matches the ip, then sends the packet
@@ -108,13 +250,17 @@ void cachePacket(
         struct sr_instance* sr,
         uint8_t* packet,
         unsigned int len,
-        struct sr_rt* rtptr)
+        const struct fib_nexthop* nexthop)
 {
     struct ip* ipHdr = (struct ip*)(packet+14);
+    struct sr_if* out = sr_get_interface(sr, nexthop->interface);
+    uint8_t desthwaddr[ETHER_ADDR_LEN];
     int i;
 
     /* request arp for the unidentified packet */
-    arpSendRequest(sr, sr_get_interface(sr, rtptr->interface), rtptr->gw.s_addr);
+    arpSendRequest(sr, out, nexthop->gw);
+
+    pthread_mutex_lock(&packetLock);
 
     /* look through packet cache for the first empty entry */
     for (i = 0; i < PACKET_CACHE_SIZE; i++) {
@@ -122,17 +268,39 @@ void cachePacket(
             break;
     }
 
+    /* nowhere to put it, drop it */
+    if (i == PACKET_CACHE_SIZE || len > sizeof(packetCache[i].packet)) {
+        pthread_mutex_unlock(&packetLock);
+        LogError(LOG_FORWARD, "Error: packet cache full, dropping packet");
+        Trace(TRACE_DROP, out, len, nexthop->gw, TRACE_DROP_HOLD_FULL);
+        CounterInc(COUNTER_DROP_HOLD_FULL);
+        return;
+    }
+    Trace(TRACE_HOLD, out, len, nexthop->gw, i);
+    CounterInc(COUNTER_HELD);
+
     /* copy packet data to cache */
     memcpy(&packetCache[i].packet, packet, len);
-    packetCache[i].nexthop = rtptr;
+    packetCache[i].nexthop = *nexthop;
     packetCache[i].tip = ipHdr->ip_dst.s_addr;
     packetCache[i].len = len;
     packetCache[i].arps = 1;
-    packetCache[i].timeCached = time(NULL);
+    packetCache[i].timeCached = vclockNow();
+    packetCache[i].heldAt = LatencyStart();
+
+    /* the reply may have been handled between our miss and taking the lock,
+     * in which case nobody would look at this entry again until it times out */
+    if (arpSearchCache(nexthop->gw, desthwaddr) > -1) {
+        LatencyEnd(LATENCY_HOLD, packetCache[i].heldAt);
+        forwardPacket(sr, (uint8_t*)&packetCache[i].packet, packetCache[i].len, out, desthwaddr);
+        packetCache[i].len = 0;
+    }
+
+    pthread_mutex_unlock(&packetLock);
 
     /* dump cache
     uint8_t* ptr = packetCache[i].packet;
-    printf("\nnexthop: %s\n", inet_ntoa(packetCache[i].nexthop->gw));
+    printf("\nnexthop: %8.8x\n", packetCache[i].nexthop.gw);
     printf("tip: %8.8x\n", packetCache[i].tip);
     printf("len: %d\n", packetCache[i].len);
     printf("arps: %d\n", packetCache[i].arps);
@@ -143,45 +311,130 @@ void cachePacket(
 }
 
 /*-----------------------------------------------------------------------------
- * Method: void checkCachedPackets(struct sr_instance* sr, int cachedArp)
+ * Method: void checkCachedPackets(struct sr_instance* sr)
  *
- * searches our packet cache for a matching ip in arpCache[cachedArp]. if we 
+ * searches our packet cache for next hops that now have an arp cache entry. if we 
  * find a match, we forward the packet. if we do not find a match we need an
  * arp cache entry for it. make sure we have been waiting at least 3 seconds
  * before we send the src icmp unreachable packets. this does not drop the 
  * packet, it just looks every 3rd second to see if we have a response. every
- * time we look, we try to increment the arp counter
+ * time we look, we try to increment the arp counter. a next hop that runs out
+ * of arps is declared dead, and its packets move to another path or the
+ * backup before we give up on them. the caller must hold rcuReadLock
  *---------------------------------------------------------------------------*/
-void checkCachedPackets(struct sr_instance* sr, int cachedArp)
+void checkCachedPackets(struct sr_instance* sr)
 {
-    int i, arpMatch;
+    uint8_t desthwaddr[ETHER_ADDR_LEN];
+    struct fib* fib = fibCurrent();
+    int i, died = 0;
+
+    pthread_mutex_lock(&packetLock);
     for (i = 0; i < PACKET_CACHE_SIZE; i++) {
         if (packetCache[i].len > 0) {
             // if we have a packet waiting
             if (packetCache[i].arps <= 5) {
                 // and we have not sent 5 arps for this packet yet
-                if ((arpMatch = arpSearchCache(packetCache[i].tip)) > -1) {
+                if (arpSearchCache(packetCache[i].nexthop.gw, desthwaddr) > -1) {
                     // and we have an arp match for our packet's next hop
+                    LatencyEnd(LATENCY_HOLD, packetCache[i].heldAt);
                     forwardPacket(sr, (uint8_t*)&packetCache[i].packet, packetCache[i].len,
                             // send it along
-                            packetCache[i].nexthop->interface, arpReturnEntryMac(arpMatch));
+                            sr_get_interface(sr, packetCache[i].nexthop.interface), desthwaddr);
                     packetCache[i].len = 0;
                 } else {
                     /* wait three seconds between each arp request */
-                    if ((int)(difftime(time(NULL), packetCache[i].timeCached))%3 < 1) {
-                        arpSendRequest(sr, sr_get_interface(sr, packetCache[i].nexthop->interface),
-                                packetCache[i].nexthop->gw.s_addr);
+                    if ((int)(difftime(vclockNow(), packetCache[i].timeCached))%3 < 1) {
+                        arpSendRequest(sr, sr_get_interface(sr, packetCache[i].nexthop.interface),
+                                packetCache[i].nexthop.gw);
                         packetCache[i].arps++;
                     }
                 }
             } else {
-                /* then */
-                icmpSendUnreachable(sr, (uint8_t*)&packetCache[i].packet, packetCache[i].len,
-                        packetCache[i].nexthop->interface, ICMP_HOST_UNREACHABLE);
-                packetCache[i].len = 0;
+                /* the next hop is gone, try the way around it first */
+                if (packetCache[i].nexthop.gw) {
+                    neighborDown(packetCache[i].nexthop.gw);
+                    died = 1;
+                }
+                if (reroutePacket(sr, fib, i) == 0) {
+                    cacheSendUnreachable(sr, i, ICMP_HOST_UNREACHABLE);
+                    packetCache[i].len = 0;
+                }
             }
         }
     }
+
+    /* everything else waiting on a dead next hop can move now rather than
+     * after its own arps run out */
+    if (died) {
+        for (i = 0; i < PACKET_CACHE_SIZE; i++) {
+            if (packetCache[i].len > 0 && neighborIsDead(packetCache[i].nexthop.gw))
+                reroutePacket(sr, fib, i);
+        }
+    }
+    pthread_mutex_unlock(&packetLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void requeueCachedPackets(struct sr_instance* sr)
+ *
+ * called after the routing table changes. every packet still waiting on arp
+ * is routed again: no route means net unreachable, a new next hop means we
+ * start over asking for the new gateway (or send it now if we know it)
+ *---------------------------------------------------------------------------*/
+void requeueCachedPackets(struct sr_instance* sr)
+{
+    struct fib* fib;
+    int i, moved = 0, dropped = 0;
+
+    rcuReadLock();
+    fib = fibCurrent();
+    pthread_mutex_lock(&packetLock);
+    for (i = 0; i < PACKET_CACHE_SIZE; i++) {
+        if (packetCache[i].len == 0)
+            continue;
+
+        switch (reroutePacket(sr, fib, i)) {
+            case -1:    dropped++; break;
+            case 1:     moved++; break;
+        }
+    }
+    pthread_mutex_unlock(&packetLock);
+    rcuReadUnlock();
+
+    if (moved || dropped)
+        LogInfo(LOG_FORWARD, "-- Rerouted %d waiting packets, dropped %d without a route", moved, dropped);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void forwardWeighNexthops(struct sr_instance* sr, struct fib* fib)
+ *
+ * when the router was asked to, weights every nexthop of fib by the speed
+ * of its interface, so a faster uplink gets a bigger share of the flows.
+ * interfaces that never reported a speed count as 1
+ *---------------------------------------------------------------------------*/
+void forwardWeighNexthops(struct sr_instance* sr, struct fib* fib)
+{
+    const struct fib_nexthop* nexthops;
+    struct sr_if* iface;
+    uint32_t* weights;
+    uint32_t i;
+
+    if (!sr->ecmp_weighted || fib == NULL)
+        return;
+
+    nexthops = fibNexthops(fib->hdr);
+    weights = malloc((fib->hdr->nnexthops ? fib->hdr->nnexthops : 1) * sizeof(uint32_t));
+    if (weights == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for nexthop weights\n");
+        return;
+    }
+
+    for (i = 0; i < fib->hdr->nnexthops; i++) {
+        iface = sr_get_interface(sr, nexthops[i].interface);
+        weights[i] = (iface && iface->speed) ? iface->speed : 1;
+    }
+
+    fibSetWeights(fib, weights);
 }
 
 /*-----------------------------------------------------------------------------
@@ -193,6 +446,87 @@ void checkCachedPackets(struct sr_instance* sr, int cachedArp)
 void initPacketCache()
 {
     int i;
+
+    pthread_mutex_lock(&packetLock);
     for (i = 0; i < PACKET_CACHE_SIZE; i++)
         packetCache[i].len = 0;
+    pthread_mutex_unlock(&packetLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method int packetCacheCount()
+ *
+ * the number of packets waiting in the packet cache for arp
+ *---------------------------------------------------------------------------*/
+int packetCacheCount()
+{
+    int i, n = 0;
+
+    pthread_mutex_lock(&packetLock);
+    for (i = 0; i < PACKET_CACHE_SIZE; i++) {
+        if (packetCache[i].len > 0)
+            n++;
+    }
+    pthread_mutex_unlock(&packetLock);
+
+    return n;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int reroutePacket(struct sr_instance* sr, struct fib* fib,
+ *                                      int i)
+ *
+ * routes cached packet i again through fib, which skips dead next hops. no
+ * route sends net unreachable and frees the entry. a new next hop starts
+ * over asking for the new gateway (or sends it now if we know it). returns
+ * -1 if dropped, 1 if it moved, 0 if it is still on the same next hop.
+ * needs packetLock
+ *---------------------------------------------------------------------------*/
+static int reroutePacket(struct sr_instance* sr, struct fib* fib, int i)
+{
+    uint8_t desthwaddr[ETHER_ADDR_LEN];
+    const struct fib_prefix* prefix;
+    const struct fib_nexthop* nexthop;
+
+    prefix = fibLookup(fib, packetCache[i].tip);
+    if (!prefix) {
+        cacheSendUnreachable(sr, i, ICMP_NET_UNREACHABLE);
+        packetCache[i].len = 0;
+        return -1;
+    }
+    nexthop = fibSelect(fib, prefix, flowHash(packetCache[i].packet, packetCache[i].len));
+    if (nexthop->gw == packetCache[i].nexthop.gw &&
+            strncmp(nexthop->interface, packetCache[i].nexthop.interface, sr_IFACE_NAMELEN) == 0)
+        return 0;
+
+    packetCache[i].nexthop = *nexthop;
+    packetCache[i].arps = 1;
+    packetCache[i].timeCached = vclockNow();
+
+    if (arpSearchCache(nexthop->gw, desthwaddr) > -1) {
+        LatencyEnd(LATENCY_HOLD, packetCache[i].heldAt);
+        forwardPacket(sr, (uint8_t*)&packetCache[i].packet, packetCache[i].len,
+                sr_get_interface(sr, nexthop->interface), desthwaddr);
+        packetCache[i].len = 0;
+    } else {
+        arpSendRequest(sr, sr_get_interface(sr, nexthop->interface), nexthop->gw);
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void cacheSendUnreachable(struct sr_instance* sr, int i,
+ *                                      uint8_t code)
+ *
+ * sends destination unreachable about cached packet i. the cache keeps only
+ * the frame, so it is parsed again for the error to quote. needs packetLock
+ *---------------------------------------------------------------------------*/
+static void cacheSendUnreachable(struct sr_instance* sr, int i, uint8_t code)
+{
+    struct packet_desc desc;
+
+    if (parsePacket(&desc, (uint8_t*)&packetCache[i].packet, packetCache[i].len) != 0)
+        return;
+    icmpSendUnreachable(sr, &desc, packetCache[i].nexthop.interface, code);
 }
@@ -14,22 +14,29 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "fib.h"
+#include "parse.h"
 
 #define PACKET_CACHE_SIZE 256
 
 struct packet_cache_entry {
     uint8_t         packet[1514];                   // max expected size of packet
-    struct sr_rt*   nexthop;                        // pointer to next hop entry
+    struct fib_nexthop nexthop;                     // copy, the fib may change
     uint32_t        tip;                            // target ip of packet
     unsigned int    len;                            // actual length of packet
     int             arps;                           // number of times requested info for mac
     time_t          timeCached;
+    uint64_t        heldAt;                         // LatencyStart() when cached
 };
 
-void handleForward(struct sr_instance*, uint8_t*, unsigned int, char* );
-void forwardPacket(struct sr_instance*, uint8_t*, unsigned int, char*, uint8_t* );
-void cachePacket(struct sr_instance*, uint8_t*, unsigned int, struct sr_rt* );
-void checkCachedPackets(struct sr_instance*, int );
+void handleForward(struct sr_instance*, struct packet_desc*, char* );
+void handleForwardBurst(struct sr_instance*, struct packet_desc**, char**, int );
+void forwardPacket(struct sr_instance*, uint8_t*, unsigned int, struct sr_if*, uint8_t* );
+void cachePacket(struct sr_instance*, uint8_t*, unsigned int, const struct fib_nexthop* );
+void checkCachedPackets(struct sr_instance* );
+void requeueCachedPackets(struct sr_instance* );
+void forwardWeighNexthops(struct sr_instance*, struct fib* );
 void initPacketCache();
+int packetCacheCount();
 
 #endif
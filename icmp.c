@@ -23,105 +23,161 @@
 #include "ip.h"
 #include "icmp.h"
 #include "checksum.h"
+#include "log.h"
+#include "counter.h"
 
 /*---------------------------------------------------------------------------------
-* Method: void handleIcmp(struct sr_instance*, uint8_t*, unsigned int, char*);
+* Method: void handleIcmp(struct sr_instance*, struct packet_desc*, char*);
 *
 * Determines what kind of ICMP packet we received and responds accordingly
 *------------------------------------------------------------------------------------*/
 void handleIcmp(struct sr_instance* sr,
-          uint8_t* packet,
-          unsigned int len,
+          struct packet_desc* desc,
           char* interface)
 {
-    struct icmp_hdr * icmpHdr = (struct icmp_hdr*)(packet+34);
+    struct icmp_hdr * icmpHdr = (struct icmp_hdr*)(desc->packet + desc->l4);
+
+    if (!parseCheckL4(desc)) {
+        LogInfo(LOG_ICMP, "--> ICMP: dropping truncated or corrupt message");
+        return;
+    }
 
     if (icmpHdr->icmp_type == ICMP_ECHO_REQUEST) {
-        fprintf(stdout, "--> ICMP Type: %2.2x -> ECHO \n", icmpHdr->icmp_type);
-        icmpSendEchoReply(sr, packet, len, interface);
+        LogDebug(LOG_ICMP, "--> ICMP Type: %2.2x -> ECHO", icmpHdr->icmp_type);
+        icmpSendEchoReply(sr, desc, interface);
     }
 }
 
 /*-----------------------------------------------------------------------------
- * Method: void icmpSendEchoReply(struct sr_instance* sr, uint8_t* packet,
- *                                  unsigned int len, char* interface )
+ * Method: void icmpSendEchoReply(struct sr_instance* sr,
+ *                          struct packet_desc* desc, char* interface )
  *
- * sends a reply to incoming icmp echo request
+ * sends a reply to incoming icmp echo request. the request becomes the
+ * reply in place: swapping the addresses does not change the ip checksum,
+ * and the ttl and icmp type words are fixed up incrementally, so neither
+ * checksum is summed again no matter how much data the ping carries
  *---------------------------------------------------------------------------*/
 void icmpSendEchoReply(
         struct sr_instance* sr,
-        uint8_t* packet, 
-        unsigned int len,
+        struct packet_desc* desc,
         char* interface)
 {
     /* organize our packet */
-    struct sr_ethernet_hdr* ethernetHdr = (struct sr_ethernet_hdr*)packet;
-    struct ip* ipHdr = (struct ip*)(packet+14);
-    struct icmp_hdr* icmpHdr = (struct icmp_hdr*)(packet+34);
+    struct sr_ethernet_hdr* ethernetHdr = (struct sr_ethernet_hdr*)desc->packet;
+    struct ip* ipHdr = (struct ip*)(desc->packet + desc->l3);
+    struct icmp_hdr* icmpHdr = (struct icmp_hdr*)(desc->packet + desc->l4);
+    struct in_addr addr;
+    uint16_t old, new;
 
     /* modify packet in place to be sent back to pinger */
-    makeicmp(icmpHdr, ICMP_ECHO_REPLY, 0, 64);
-    makeip(ipHdr, len-14, IP_DF, 64, IPPROTO_ICMP, 
-                sr_get_interface(sr, interface)->ip, ipHdr->ip_src.s_addr);
+    addr = ipHdr->ip_src;
+    ipHdr->ip_src = ipHdr->ip_dst;
+    ipHdr->ip_dst = addr;
+    ipSetTtl(ipHdr, 64);
+
+    memcpy(&old, icmpHdr, 2);
+    icmpHdr->icmp_type = ICMP_ECHO_REPLY;
+    icmpHdr->icmp_code = 0;
+    memcpy(&new, icmpHdr, 2);
+    icmpHdr->icmp_checksum = checksumUpdate16(icmpHdr->icmp_checksum, old, new);
+
     makeethernet(ethernetHdr, ETHERTYPE_IP, 
                 sr_get_interface(sr, interface)->addr, ethernetHdr->ether_shost);
 
     // send away
-    sr_send_packet(sr, packet, len, interface);
+    sr_send_packet(sr, desc->packet, desc->len, interface);
     
-    // log on send
-    printf("<-- ICMP ECHO reply sent to %s\n", inet_ntoa(ipHdr->ip_dst));
+    // count and log on send
+    CounterInc(COUNTER_ICMP_ECHO_REPLY);
+    LogDebug(LOG_ICMP, "<-- ICMP ECHO reply sent to %s", logAddr(ipHdr->ip_dst));
 }
 
 /*-----------------------------------------------------------------------------
- * Method: void icmpSendEchoReply(struct sr_instance* sr, uint8_t* packet,
- *                                  unsigned int len, char* interface )
+ * Method: void icmpSendUnreachable(struct sr_instance* sr,
+ *                      struct packet_desc* desc, char* interface, uint8_t type)
  *
- * sends a reply to incoming icmp echo request
+ * sends a destination unreachable error, type is the unreachable code
  *---------------------------------------------------------------------------*/
 void icmpSendUnreachable(
         struct sr_instance* sr,
-        uint8_t* packet, 
-        unsigned int len,
+        struct packet_desc* desc,
         char* interface,
         uint8_t type)
 {
+    icmpSendError(sr, desc, interface, ICMP_DST_UNREACHABLE, type);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void icmpSendError(struct sr_instance* sr, struct packet_desc* desc,
+ *              char* interface, uint8_t type, uint8_t code)
+ *
+ * sends an icmp error about the packet in desc back to its source, quoting
+ * its whole ip header, options included, and up to 8 bytes after it
+ *---------------------------------------------------------------------------*/
+void icmpSendError(
+        struct sr_instance* sr,
+        struct packet_desc* desc,
+        char* interface,
+        uint8_t type,
+        uint8_t code)
+{
+    unsigned int quote, len;
+    uint8_t* icmpPacket;
+
+    /* nothing to quote without a whole ip header */
+    if (!(desc->flags & PARSE_IP))
+        return;
+    quote = desc->ihl + (desc->l4len < 8 ? desc->l4len : 8);
+    len = sizeof(struct sr_ethernet_hdr) + sizeof(struct ip) + sizeof(struct icmp_hdr) + quote;
+
     /* allocate memory for our new packet */
-    uint8_t* icmpPacket = malloc(70 * sizeof(uint8_t));
+    icmpPacket = malloc(len);
     if (icmpPacket == NULL) {
-        fprintf(stderr, "Error: malloc could not find memory for packet storage\n");
+        LogError(LOG_ICMP, "Error: malloc could not find memory for packet storage");
         return;
     }
-    memset(icmpPacket, 0, 70 * sizeof(uint8_t));
+    memset(icmpPacket, 0, len);
 
     /* organize our src packet */
-    struct sr_ethernet_hdr* srcethernetHdr = (struct sr_ethernet_hdr*)packet;
-    struct ip* srcipHdr = (struct ip*)(packet+14);
+    struct sr_ethernet_hdr* srcethernetHdr = (struct sr_ethernet_hdr*)desc->packet;
+    struct ip* srcipHdr = (struct ip*)(desc->packet + desc->l3);
 
     /* organize pointers for our new packet */
     struct sr_ethernet_hdr* newEthHdr = (struct sr_ethernet_hdr*)icmpPacket;
-    struct ip* newipHdr = (struct ip*)(icmpPacket+14);
-    struct icmp_hdr* newicmpHdr = (struct icmp_hdr*)(icmpPacket+34);
-    uint8_t* newicmpData = (uint8_t*)(icmpPacket+42);
+    struct ip* newipHdr = (struct ip*)(newEthHdr + 1);
+    struct icmp_hdr* newicmpHdr = (struct icmp_hdr*)(newipHdr + 1);
+    uint8_t* newicmpData = (uint8_t*)(newicmpHdr + 1);
 
     /* copy src ip header + tcp/udp ports to icmp data */
-    memcpy(newicmpData, srcipHdr, 28);
+    memcpy(newicmpData, srcipHdr, quote);
 
     /* create icmp, ip and ethernet headers on our new packet */
-    makeicmp(newicmpHdr, ICMP_DST_UNREACHABLE, type, 36);
-    makeip(newipHdr, 70-14, IP_DF, 64, IPPROTO_ICMP,
+    makeicmp(newicmpHdr, type, code, sizeof(struct icmp_hdr) + quote);
+    makeip(newipHdr, len - sizeof(struct sr_ethernet_hdr), IP_DF, 64, IPPROTO_ICMP,
             sr_get_interface(sr, interface)->ip, srcipHdr->ip_src.s_addr);
     makeethernet(newEthHdr, ETHERTYPE_IP,
             sr_get_interface(sr, interface)->addr, srcethernetHdr->ether_shost);
         
     /* send away */
-    sr_send_packet(sr, icmpPacket, 70, interface);
+    sr_send_packet(sr, icmpPacket, len, interface);
 
-    // log on send
-    if (type == ICMP_PORT_UNREACHABLE)
-        printf("<-- ICMP Destination Port Unreachable sent to %s\n", inet_ntoa(newipHdr->ip_dst));
-    if (type == ICMP_HOST_UNREACHABLE)
-        printf("<-- ICMP Destination Host Unreachable sent to %s\n", inet_ntoa(newipHdr->ip_dst));
+    // count and log on send
+    if (type == ICMP_TIME_EXCEEDED) {
+        CounterInc(COUNTER_ICMP_TIME_EXCEEDED);
+        LogInfo(LOG_ICMP, "<-- ICMP Time Exceeded sent to %s", logAddr(newipHdr->ip_dst));
+    }
+    if (type == ICMP_DST_UNREACHABLE && code == ICMP_NET_UNREACHABLE) {
+        CounterInc(COUNTER_ICMP_NET_UNREACHABLE);
+        LogInfo(LOG_ICMP, "<-- ICMP Destination Net Unreachable sent to %s", logAddr(newipHdr->ip_dst));
+    }
+    if (type == ICMP_DST_UNREACHABLE && code == ICMP_PORT_UNREACHABLE) {
+        CounterInc(COUNTER_ICMP_PORT_UNREACHABLE);
+        LogInfo(LOG_ICMP, "<-- ICMP Destination Port Unreachable sent to %s", logAddr(newipHdr->ip_dst));
+    }
+    if (type == ICMP_DST_UNREACHABLE && code == ICMP_HOST_UNREACHABLE) {
+        CounterInc(COUNTER_ICMP_HOST_UNREACHABLE);
+        LogInfo(LOG_ICMP, "<-- ICMP Destination Host Unreachable sent to %s", logAddr(newipHdr->ip_dst));
+    }
 
     free(icmpPacket);
 }
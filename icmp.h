@@ -13,12 +13,16 @@
 #include <stdint.h>
 
 #include "sr_protocol.h"
+#include "parse.h"
 
 #define ICMP_ECHO_REPLY 0
 #define ICMP_ECHO_REQUEST 8
 #define ICMP_DST_UNREACHABLE 3
+#define ICMP_NET_UNREACHABLE 0
 #define ICMP_HOST_UNREACHABLE 1
 #define ICMP_PORT_UNREACHABLE 3
+#define ICMP_TIME_EXCEEDED 11
+#define ICMP_TTL_EXCEEDED 0
 
 struct icmp_hdr
 {
@@ -29,9 +33,10 @@ struct icmp_hdr
     uint16_t        icmp_seq;
 };
 
-void handleIcmp(struct sr_instance*, uint8_t*, unsigned int, char* );
-void icmpSendEchoReply(struct sr_instance*, uint8_t*, unsigned int, char*);
-void icmpSendUnreachable(struct sr_instance*, uint8_t*, unsigned int, char*, uint8_t );
+void handleIcmp(struct sr_instance*, struct packet_desc*, char* );
+void icmpSendEchoReply(struct sr_instance*, struct packet_desc*, char*);
+void icmpSendUnreachable(struct sr_instance*, struct packet_desc*, char*, uint8_t );
+void icmpSendError(struct sr_instance*, struct packet_desc*, char*, uint8_t, uint8_t );
 void makeicmp(struct icmp_hdr*, uint8_t, uint8_t, int );
 void icmpDumpHeader(struct icmp_hdr* );
 
@@ -9,6 +9,7 @@
  ******************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -20,35 +21,35 @@
 #include "ip.h"
 #include "icmp.h"
 #include "checksum.h"
+#include "dispatch.h"
+#include "log.h"
 
 /*--------------------------------------------------------------------- 
- * Method: void handleIp(struct sr_instance*, uint8_t*,
- *                          unsigned int, char* )
+ * Method: void handleIp(struct sr_instance*, struct packet_desc*,
+ *                          char* )
  *
- * decides what to do with an incoming IP packet
+ * hands an incoming IP packet addressed to us to its protocol handler
  *---------------------------------------------------------------------*/
  void handleIp(
          struct sr_instance* sr, 
-         uint8_t* packet,
-         unsigned int len,
+         struct packet_desc* desc,
          char* interface)
 {
-    struct ip* ipHdr = (struct ip*)(packet+14);
+    LogDebug(LOG_IP, "-> IP Protocol: %2.2x", desc->proto);
 
-    if (ipHdr->ip_p == IPPROTO_ICMP) {
-        fprintf(stdout, "-> IP Protocol: %2.2x -> ICMP\n", ipHdr->ip_p);
-        handleIcmp(sr, packet, len, interface);
-    }
-
-    if (ipHdr->ip_p == IPPROTO_TCP) {
-        fprintf(stdout, "-> IP Protocol: %2.2x -> TCP\n", ipHdr->ip_p);
-        icmpSendUnreachable(sr, packet, len, interface, ICMP_PORT_UNREACHABLE);
-    }
+    /* protocols nobody registered for are ignored */
+    dispatchIp(sr, desc, interface);
+}
 
-    if (ipHdr->ip_p == IPPROTO_UDP) {
-        fprintf(stdout, "-> IP Protocol: %2.2x -> UDP\n", ipHdr->ip_p);
-        icmpSendUnreachable(sr, packet, len, interface, ICMP_PORT_UNREACHABLE);
-    }
+/*-----------------------------------------------------------------------------
+ * Method: void ipPortUnreachable(struct sr_instance* sr,
+ *                      struct packet_desc* desc, char* interface)
+ *
+ * handler for tcp and udp addressed to us, we have no ports open
+ *---------------------------------------------------------------------------*/
+void ipPortUnreachable(struct sr_instance* sr, struct packet_desc* desc, char* interface)
+{
+    icmpSendUnreachable(sr, desc, interface, ICMP_PORT_UNREACHABLE);
 }
 
 /*-----------------------------------------------------------------------------
@@ -87,6 +88,24 @@ void makeip(
     ipHdr->ip_sum = in_checksum((uint16_t*)ipHdr, 20);
 }
 
+/*-----------------------------------------------------------------------------
+ * Method: void ipSetTtl(struct ip* ipHdr, uint8_t ttl)
+ *
+ * changes the ttl of a finished header, fixing the checksum up for the one
+ * word that changed instead of summing the whole header again
+ *---------------------------------------------------------------------------*/
+void ipSetTtl(struct ip* ipHdr, uint8_t ttl)
+{
+    uint16_t old, new;
+
+    /* ttl shares its word with the protocol */
+    memcpy(&old, &ipHdr->ip_ttl, 2);
+    ipHdr->ip_ttl = ttl;
+    memcpy(&new, &ipHdr->ip_ttl, 2);
+
+    ipHdr->ip_sum = checksumUpdate16(ipHdr->ip_sum, old, new);
+}
+
 /*--------------------------------------------------------------------- 
  * Method: void ipDumpHeader(struct ip* )
  *
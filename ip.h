@@ -15,9 +15,12 @@
 #include <stdint.h>
 
 #include "sr_protocol.h"
+#include "parse.h"
 
-void handleIp(struct sr_instance*, uint8_t*, unsigned int, char* );
+void handleIp(struct sr_instance*, struct packet_desc*, char* );
+void ipPortUnreachable(struct sr_instance*, struct packet_desc*, char* );
 void makeip(struct ip*, unsigned int, uint16_t, unsigned char, unsigned char, uint32_t, uint32_t );
+void ipSetTtl(struct ip*, uint8_t );
 void ipDumpHeader(struct ip* );
 
 #endif
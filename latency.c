@@ -0,0 +1,304 @@
+/*******************************************************************************
+ * file: latency.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the latency histograms. a thread's first sample allocates its
+ * block of histograms, after which recording is a few plain adds to memory
+ * only that thread writes. a dump adds every block up as it finds it, so
+ * one taken while packets flow can be off by the samples in flight. the
+ * SIGUSR1 handler only writes a byte to a pipe, a thread does the printing
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "dispatch.h"
+#include "latency.h"
+
+int latencyEnabled = 0;
+
+static struct latency_block* latencyBlocks[LATENCY_MAX_THREADS];
+static unsigned int latencyThreads = 0;
+static uint64_t latencyCyclesStart;
+static uint64_t latencyNsStart;
+static int latencyPipe[2];
+static pthread_mutex_t latencyDumpLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct latency_block* latencyLocal = NULL;
+static __thread int latencyNoRoom = 0;
+
+static const char* latencyStages[LATENCY_STAGES] = { "read", "handle", "route", "adjacency", "hold", "send" };
+
+static struct latency_block* latencyRegister();
+static unsigned int latencyBucket(uint64_t );
+static uint64_t latencyBucketMax(unsigned int );
+static uint64_t latencyPercentile(const struct latency_histogram*, unsigned int );
+static uint64_t latencyNs();
+static void latencySignal(int );
+static void* latencyThread(void* );
+
+/*-----------------------------------------------------------------------------
+ * Method: int latencyStart()
+ *
+ * turns the histograms on and installs the SIGUSR1 handler that dumps
+ * them. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int latencyStart()
+{
+    struct sigaction sa;
+    pthread_t thread;
+
+    if (pipe(latencyPipe) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = latencySignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGUSR1, &sa, NULL) != 0) {
+        perror("sigaction");
+        return -1;
+    }
+
+    if (pthread_create(&thread, NULL, latencyThread, NULL) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    pthread_detach(thread);
+
+    latencyCyclesStart = dispatchCycles();
+    latencyNsStart = latencyNs();
+    __atomic_store_n(&latencyEnabled, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void latencyRecord(int stage, uint64_t cycles, unsigned int n)
+ *
+ * counts n samples of cycles / n each against stage. use the Latency
+ * macros, which skip this while the histograms are off
+ *---------------------------------------------------------------------------*/
+void latencyRecord(int stage, uint64_t cycles, unsigned int n)
+{
+    struct latency_block* block = latencyLocal;
+    struct latency_histogram* h;
+    uint64_t v = cycles / n;
+
+    if (block == NULL && (block = latencyRegister()) == NULL)
+        return;
+
+    h = &block->stages[stage];
+    h->counts[latencyBucket(v)] += n;
+    h->total += n;
+    h->sum += cycles;
+    if (v > h->max)
+        h->max = v;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void latencyDump()
+ *
+ * prints every stage's sample count, mean, p50, p99, p99.9 and max in
+ * nanoseconds, over every thread, to stdout
+ *---------------------------------------------------------------------------*/
+void latencyDump()
+{
+    static struct latency_histogram sum;
+    struct latency_block* block;
+    struct latency_histogram* h;
+    double nsPerCycle = 1.0;
+    uint64_t cycles, ns;
+    unsigned int nthreads, i, j, b;
+
+    if (!__atomic_load_n(&latencyEnabled, __ATOMIC_ACQUIRE))
+        return;
+
+    /* calibrate the cycle counter against the clock over the whole run */
+    cycles = dispatchCycles() - latencyCyclesStart;
+    ns = latencyNs() - latencyNsStart;
+    if (cycles > 0 && ns > 0)
+        nsPerCycle = (double)ns / cycles;
+
+    nthreads = __atomic_load_n(&latencyThreads, __ATOMIC_ACQUIRE);
+    if (nthreads > LATENCY_MAX_THREADS)
+        nthreads = LATENCY_MAX_THREADS;
+
+    pthread_mutex_lock(&latencyDumpLock);
+    printf("Latency ns %10s %12s %10s %10s %10s %10s %10s\n", "", "samples", "mean", "p50", "p99", "p99.9", "max");
+    for (i = 0; i < LATENCY_STAGES; i++) {
+        memset(&sum, 0, sizeof(sum));
+        for (j = 0; j < nthreads; j++) {
+            block = __atomic_load_n(&latencyBlocks[j], __ATOMIC_ACQUIRE);
+            if (block == NULL)
+                continue;
+            h = &block->stages[i];
+            for (b = 0; b < LATENCY_BUCKETS; b++)
+                sum.counts[b] += h->counts[b];
+            sum.total += h->total;
+            sum.sum += h->sum;
+            if (h->max > sum.max)
+                sum.max = h->max;
+        }
+        if (sum.total == 0)
+            continue;
+
+        printf("  %-19s %12llu %10.0f %10.0f %10.0f %10.0f %10.0f\n", latencyStages[i],
+                (unsigned long long)sum.total,
+                (double)sum.sum / sum.total * nsPerCycle,
+                latencyPercentile(&sum, 50000) * nsPerCycle,
+                latencyPercentile(&sum, 99000) * nsPerCycle,
+                latencyPercentile(&sum, 99900) * nsPerCycle,
+                sum.max * nsPerCycle);
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&latencyDumpLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct latency_block* latencyRegister()
+ *
+ * gives the calling thread its histograms, NULL once LATENCY_MAX_THREADS
+ * have them
+ *---------------------------------------------------------------------------*/
+static struct latency_block* latencyRegister()
+{
+    struct latency_block* block;
+    unsigned int slot;
+
+    if (latencyNoRoom)
+        return NULL;
+
+    slot = __atomic_fetch_add(&latencyThreads, 1, __ATOMIC_ACQ_REL);
+    if (slot >= LATENCY_MAX_THREADS) {
+        latencyNoRoom = 1;
+        return NULL;
+    }
+
+    block = calloc(1, sizeof(struct latency_block));
+    if (block == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for latency histograms\n");
+        latencyNoRoom = 1;
+        return NULL;
+    }
+
+    __atomic_store_n(&latencyBlocks[slot], block, __ATOMIC_RELEASE);
+    latencyLocal = block;
+
+    return block;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static unsigned int latencyBucket(uint64_t v)
+ *
+ * values below LATENCY_SUB_BUCKETS get a bucket each. above that the top
+ * LATENCY_SUB_BITS + 1 bits pick the bucket, and each power of two gets
+ * LATENCY_SUB_BUCKETS of them
+ *---------------------------------------------------------------------------*/
+static unsigned int latencyBucket(uint64_t v)
+{
+    int msb, shift;
+
+    if (v < LATENCY_SUB_BUCKETS)
+        return v;
+
+    msb = 63 - __builtin_clzll(v);
+    shift = msb - LATENCY_SUB_BITS;
+
+    return shift * LATENCY_SUB_BUCKETS + (v >> shift);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t latencyBucketMax(unsigned int b)
+ *
+ * the largest value that lands in bucket b
+ *---------------------------------------------------------------------------*/
+static uint64_t latencyBucketMax(unsigned int b)
+{
+    unsigned int shift;
+
+    if (b < LATENCY_SUB_BUCKETS)
+        return b;
+
+    shift = b / LATENCY_SUB_BUCKETS - 1;
+
+    return (((uint64_t)(b % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS)) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t latencyPercentile(const struct latency_histogram* h,
+ *                  unsigned int per100k)
+ *
+ * the value per100k / 100000 of the samples are at or below, as the top of
+ * its bucket but never above the largest sample
+ *---------------------------------------------------------------------------*/
+static uint64_t latencyPercentile(const struct latency_histogram* h, unsigned int per100k)
+{
+    uint64_t want = (h->total * per100k + 99999) / 100000;
+    uint64_t seen = 0;
+    unsigned int b;
+
+    if (want == 0)
+        want = 1;
+
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= want)
+            return latencyBucketMax(b) < h->max ? latencyBucketMax(b) : h->max;
+    }
+
+    return h->max;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t latencyNs()
+ *
+ * monotonic nanoseconds
+ *---------------------------------------------------------------------------*/
+static uint64_t latencyNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void latencySignal(int sig)
+ *
+ * SIGUSR1 handler, wakes up the dump thread
+ *---------------------------------------------------------------------------*/
+static void latencySignal(int sig)
+{
+    char c = 'u';
+
+    if (write(latencyPipe[1], &c, 1) != 1)
+        return;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* latencyThread(void* arg)
+ *
+ * dumps the histograms each time SIGUSR1 comes in
+ *---------------------------------------------------------------------------*/
+static void* latencyThread(void* arg)
+{
+    char buf[64];
+
+    for (;;) {
+        if (read(latencyPipe[0], buf, sizeof(buf)) > 0)
+            latencyDump();
+    }
+
+    return NULL;
+}
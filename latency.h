@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * file: latency.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for per-stage latency histograms (-H). each stage of the
+ * packet path is timed with dispatchCycles into a log-linear histogram:
+ * every power of two is split into LATENCY_SUB_BUCKETS equal buckets, so
+ * any value is kept to within about 3% from a few cycles up to minutes.
+ * every thread records into its own histograms. SIGUSR1 prints them, as
+ * does exit
+ ******************************************************************************/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include "dispatch.h"
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+#define LATENCY_MAX_THREADS 64
+
+/* stages */
+#define LATENCY_READ 0                          // a frame from VNS, or the replay pcap
+#define LATENCY_HANDLE 1                        // sr_handlepacket, per frame of a burst
+#define LATENCY_ROUTE 2                         // route lookup
+#define LATENCY_ADJACENCY 3                     // arp cache lookup
+#define LATENCY_HOLD 4                          // waiting in the packet cache for arp
+#define LATENCY_SEND 5                          // sr_send_packet
+#define LATENCY_STAGES 6
+
+struct latency_histogram {
+    uint64_t        counts[LATENCY_BUCKETS];
+    uint64_t        total;
+    uint64_t        sum;                        // cycles
+    uint64_t        max;
+};
+
+struct latency_block {
+    struct latency_histogram stages[LATENCY_STAGES];
+};
+
+/* -- cycles now while histograms are on, else 0, which LatencyEnd skips -- */
+#define LatencyStart() (__builtin_expect(latencyEnabled, 0) ? dispatchCycles() : 0)
+
+#define LatencyEnd(stage, start) LatencyEndBurst(stage, start, 1)
+
+/* -- n frames that shared start, each charged an equal part -- */
+#define LatencyEndBurst(stage, start, n) \
+    do { \
+        if (start) \
+            latencyRecord(stage, dispatchCycles() - (start), n); \
+    } while (0)
+
+extern int latencyEnabled;
+
+int latencyStart();
+void latencyRecord(int, uint64_t, unsigned int );
+void latencyDump();
+
+#endif
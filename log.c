@@ -0,0 +1,293 @@
+/*******************************************************************************
+ * file: log.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the message log. a call site that passes its level check
+ * formats its line straight into a record and pushes it onto one ring that
+ * every thread shares, so the only thing it ever waits on is vsnprintf.
+ * the writer thread pops lines and puts them out on stdout, or stderr for
+ * errors. until logStart, and after logStop, lines are written at once
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "ring.h"
+#include "log.h"
+
+#define LOG_ADDR_BUFS 4                         // addresses per line
+
+struct log_record {
+    int             level;
+    unsigned long   suppressed;                 // lines before this one left out
+    char            text[LOG_LINE_MAX];
+};
+
+int logLevels[LOG_SUBSYSTEMS] = { LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO };
+
+static const char* logSubsystems[LOG_SUBSYSTEMS] = { "packet", "arp", "ip", "icmp", "forward", "neighbor" };
+static const char* logLevelNames[] = { "off", "error", "warn", "info", "debug" };
+static unsigned long logRate = LOG_RATE;
+static struct sr_ring logRing;
+static pthread_t logThread;
+static int logRunning = 0;
+static unsigned long logDropped = 0;
+static unsigned long logSuppressed = 0;
+
+static void* logWriter(void* );
+static int logAllow(struct log_site*, unsigned long* );
+static void logEmit(const struct log_record* );
+static int logLevel(const char* );
+
+/*-----------------------------------------------------------------------------
+ * Method: int logConfigure(char* opts)
+ *
+ * sets up the log from opts, a comma separated list of level=<level> for
+ * every subsystem, <subsystem>=<level> for one of them, and rate=<lines a
+ * second each call site may print>, 0 for no limit. levels are off, error,
+ * warn, info and debug. opts is cut up in the process. returns 0 on
+ * success, -1 on an option we do not know
+ *---------------------------------------------------------------------------*/
+int logConfigure(char* opts)
+{
+    char* opt;
+    char* val;
+    char* save;
+    char* end;
+    long rate;
+    int level, i;
+
+    for (opt = strtok_r(opts, ",", &save); opt; opt = strtok_r(NULL, ",", &save)) {
+        val = strchr(opt, '=');
+        if (val)
+            *val++ = '\0';
+
+        if (strcmp(opt, "rate") == 0) {
+            rate = val ? strtol(val, &end, 10) : -1;
+            if (rate < 0 || end == val || *end != '\0') {
+                fprintf(stderr, "Error: bad log rate %s\n", val ? val : "");
+                return -1;
+            }
+            logRate = rate;
+            continue;
+        }
+
+        level = val ? logLevel(val) : LOG_OFF - 1;
+        if (level >= LOG_OFF && strcmp(opt, "level") == 0) {
+            for (i = 0; i < LOG_SUBSYSTEMS; i++)
+                logLevels[i] = level;
+            continue;
+        }
+        for (i = 0; i < LOG_SUBSYSTEMS; i++) {
+            if (strcmp(opt, logSubsystems[i]) == 0)
+                break;
+        }
+        if (level < LOG_OFF || i == LOG_SUBSYSTEMS) {
+            fprintf(stderr, "Error: bad log option %s%s%s\n", opt, val ? "=" : "", val ? val : "");
+            return -1;
+        }
+        logLevels[i] = level;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int logStart()
+ *
+ * starts the writer thread, from here on lines are queued. returns 0 on
+ * success, -1 on error
+ *---------------------------------------------------------------------------*/
+int logStart()
+{
+    if (ringInit(&logRing, LOG_RECORDS, sizeof(struct log_record)) != 0)
+        return -1;
+
+    __atomic_store_n(&logRunning, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&logThread, NULL, logWriter, NULL) != 0) {
+        perror("pthread_create");
+        __atomic_store_n(&logRunning, 0, __ATOMIC_RELEASE);
+        ringDestroy(&logRing);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void logStop()
+ *
+ * writes out whatever is queued and stops the writer thread
+ *---------------------------------------------------------------------------*/
+void logStop()
+{
+    if (!__atomic_load_n(&logRunning, __ATOMIC_ACQUIRE))
+        return;
+
+    __atomic_store_n(&logRunning, 0, __ATOMIC_RELEASE);
+    pthread_join(logThread, NULL);
+    ringDestroy(&logRing);
+
+    if (logDropped || logSuppressed)
+        printf("Log dropped %lu lines, rate limits held back %lu\n", logDropped, logSuppressed);
+    fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void logWrite(struct log_site* site, int level,
+ *                          const char* fmt, ...)
+ *
+ * formats a line, unless its call site is over the rate, and queues it.
+ * use the Log macros, which skip all of this for levels that are off
+ *---------------------------------------------------------------------------*/
+void logWrite(struct log_site* site, int level, const char* fmt, ...)
+{
+    struct log_record rec;
+    va_list ap;
+
+    if (!logAllow(site, &rec.suppressed))
+        return;
+
+    rec.level = level;
+    va_start(ap, fmt);
+    vsnprintf(rec.text, LOG_LINE_MAX, fmt, ap);
+    va_end(ap);
+
+    if (!__atomic_load_n(&logRunning, __ATOMIC_ACQUIRE))
+        logEmit(&rec);
+    else if (ringPush(&logRing, &rec) != 0)
+        __atomic_add_fetch(&logDropped, 1, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const char* logAddr(struct in_addr addr)
+ *
+ * dotted quad for addr, in a buffer of the calling thread's that is reused
+ * every LOG_ADDR_BUFS calls, so a line can hold that many addresses
+ *---------------------------------------------------------------------------*/
+const char* logAddr(struct in_addr addr)
+{
+    static __thread char bufs[LOG_ADDR_BUFS][INET_ADDRSTRLEN];
+    static __thread unsigned int next = 0;
+    char* buf = bufs[next++ % LOG_ADDR_BUFS];
+
+    return inet_ntop(AF_INET, &addr, buf, INET_ADDRSTRLEN);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const char* logMac(const uint8_t* mac)
+ *
+ * hex for an ethernet address, buffers reused as in logAddr
+ *---------------------------------------------------------------------------*/
+const char* logMac(const uint8_t* mac)
+{
+    static __thread char bufs[LOG_ADDR_BUFS][ETHER_ADDR_LEN * 2 + 1];
+    static __thread unsigned int next = 0;
+    char* buf = bufs[next++ % LOG_ADDR_BUFS];
+
+    snprintf(buf, ETHER_ADDR_LEN * 2 + 1, "%2.2x%2.2x%2.2x%2.2x%2.2x%2.2x",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    return buf;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* logWriter(void* arg)
+ *
+ * writer thread, empties the ring until logStop and the ring is empty
+ *---------------------------------------------------------------------------*/
+static void* logWriter(void* arg)
+{
+    struct log_record rec;
+
+    for (;;) {
+        if (ringPop(&logRing, &rec) != 0) {
+            fflush(stdout);
+            if (!__atomic_load_n(&logRunning, __ATOMIC_ACQUIRE) && ringCount(&logRing) == 0)
+                break;
+            usleep(LOG_NAP_US);
+            continue;
+        }
+
+        logEmit(&rec);
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int logAllow(struct log_site* site, unsigned long* suppressed)
+ *
+ * counts a line against its call site's rate for the current second.
+ * returns 1 if it may be printed, and then sets suppressed to how many
+ * lines the site lost since the last one that was
+ *---------------------------------------------------------------------------*/
+static int logAllow(struct log_site* site, unsigned long* suppressed)
+{
+    struct timespec now;
+    unsigned long second;
+
+    *suppressed = 0;
+    if (logRate == 0)
+        return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    second = __atomic_load_n(&site->second, __ATOMIC_RELAXED);
+
+    /* whoever moves the window on resets it, close enough when threads race */
+    if (second != (unsigned long)now.tv_sec &&
+            __atomic_compare_exchange_n(&site->second, &second, now.tv_sec, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+
+    if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > logRate) {
+        __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&logSuppressed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    *suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void logEmit(const struct log_record* rec)
+ *
+ * writes a line out
+ *---------------------------------------------------------------------------*/
+static void logEmit(const struct log_record* rec)
+{
+    FILE* out = rec->level == LOG_ERROR ? stderr : stdout;
+
+    if (rec->suppressed)
+        fprintf(out, "-- Log: %lu lines like the next one suppressed\n", rec->suppressed);
+    fputs(rec->text, out);
+    fputc('\n', out);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int logLevel(const char* name)
+ *
+ * level for a name, below LOG_OFF if there is no such level
+ *---------------------------------------------------------------------------*/
+static int logLevel(const char* name)
+{
+    int i;
+
+    for (i = 0; i <= LOG_DEBUG - LOG_OFF; i++) {
+        if (strcmp(name, logLevelNames[i]) == 0)
+            return i + LOG_OFF;
+    }
+
+    return LOG_OFF - 1;
+}
@@ -0,0 +1,76 @@
+/*******************************************************************************
+ * file: log.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the router's message log. every message has a level
+ * and a subsystem. levels above LOG_COMPILE_LEVEL are compiled out, and
+ * the rest are checked against the subsystem's runtime level (-L) before
+ * any argument is evaluated. each call site may print only so many lines a
+ * second. forwarding threads format a line into a ring and go on, and a
+ * background thread does the writing. a full ring drops the line
+ ******************************************************************************/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define LOG_OFF -1
+#define LOG_ERROR 0                             // to stderr
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3                             // per packet
+
+#ifndef LOG_COMPILE_LEVEL
+#ifdef _DEBUG_
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#else
+#define LOG_COMPILE_LEVEL LOG_INFO
+#endif
+#endif
+
+#define LOG_PACKET 0                            // receive and drop
+#define LOG_ARP 1
+#define LOG_IP 2
+#define LOG_ICMP 3
+#define LOG_FORWARD 4
+#define LOG_NEIGHBOR 5
+#define LOG_SUBSYSTEMS 6
+
+#define LOG_RECORDS 1024                        // lines in flight, power of two
+#define LOG_LINE_MAX 200
+#define LOG_RATE 100                            // default lines per second per site
+#define LOG_NAP_US 1000                         // writer sleep when idle
+
+struct log_site {
+    unsigned long   second;                     // window count is for
+    unsigned long   count;                      // lines in this window
+    unsigned long   suppressed;                 // over the rate, not yet reported
+};
+
+/* -- every call site keeps its own rate limit -- */
+#define Log(level, sub, fmt, args...) \
+    do { \
+        static struct log_site logSite_; \
+        if ((level) <= LOG_COMPILE_LEVEL && (level) <= logLevels[sub]) \
+            logWrite(&logSite_, level, fmt, ## args); \
+    } while (0)
+
+#define LogError(sub, fmt, args...) Log(LOG_ERROR, sub, fmt, ## args)
+#define LogWarn(sub, fmt, args...) Log(LOG_WARN, sub, fmt, ## args)
+#define LogInfo(sub, fmt, args...) Log(LOG_INFO, sub, fmt, ## args)
+#define LogDebug(sub, fmt, args...) Log(LOG_DEBUG, sub, fmt, ## args)
+
+extern int logLevels[LOG_SUBSYSTEMS];
+
+int logConfigure(char* );
+int logStart();
+void logStop();
+void logWrite(struct log_site*, int, const char*, ...) __attribute__((format(printf, 3, 4)));
+const char* logAddr(struct in_addr );
+const char* logMac(const uint8_t* );
+
+#endif
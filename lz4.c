@@ -0,0 +1,241 @@
+/*******************************************************************************
+ * file: lz4.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the LZ4 frame encoder. the block compressor is the usual
+ * single pass one: hash every 4 bytes into a table of recent positions, and
+ * when the position found there really starts the same 4 bytes, extend the
+ * match both ways and emit the literals before it plus the match. it only
+ * ever runs on the capture writer thread
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4.h"
+
+#define LZ4_MAGIC 0x184d2204
+#define LZ4_FLG 0x60                            // version 01, independent blocks
+#define LZ4_BD 0x60                             // 1MB blocks
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5                     // a block ends in this many literals
+#define LZ4_MF_LIMIT 12                         // no match starts this close to the end
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_UNCOMPRESSED 0x80000000
+
+#define XXH_PRIME1 2654435761U
+#define XXH_PRIME2 2246822519U
+#define XXH_PRIME3 3266489917U
+#define XXH_PRIME4 668265263U
+#define XXH_PRIME5 374761393U
+#define XXH_ROTL(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+static size_t lz4Compress(const uint8_t*, size_t, uint8_t* );
+static uint8_t* lz4Length(uint8_t*, size_t );
+static uint32_t lz4Read32(const uint8_t* );
+static void lz4Write32(uint8_t*, uint32_t );
+
+/*-----------------------------------------------------------------------------
+ * Method: void lz4FrameHeader(uint8_t* out)
+ *
+ * writes the LZ4_HEADER_LEN byte frame header to out
+ *---------------------------------------------------------------------------*/
+void lz4FrameHeader(uint8_t* out)
+{
+    lz4Write32(out, LZ4_MAGIC);
+    out[4] = LZ4_FLG;
+    out[5] = LZ4_BD;
+    out[6] = (lz4Xxh32(out + 4, 2, 0) >> 8) & 0xff;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: size_t lz4FrameBlock(const uint8_t* src, size_t len, uint8_t* out)
+ *
+ * compresses len bytes, at most LZ4_BLOCK_MAX, into a block at out, which
+ * must have room for 4 + LZ4_BOUND(len) bytes. data that does not compress
+ * is stored as it is. returns the size of the block
+ *---------------------------------------------------------------------------*/
+size_t lz4FrameBlock(const uint8_t* src, size_t len, uint8_t* out)
+{
+    size_t n = lz4Compress(src, len, out + 4);
+
+    if (n >= len) {
+        memcpy(out + 4, src, len);
+        lz4Write32(out, len | LZ4_UNCOMPRESSED);
+        return 4 + len;
+    }
+
+    lz4Write32(out, n);
+    return 4 + n;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: size_t lz4FrameEnd(uint8_t* out)
+ *
+ * writes the end mark that closes a frame, returns its size
+ *---------------------------------------------------------------------------*/
+size_t lz4FrameEnd(uint8_t* out)
+{
+    lz4Write32(out, 0);
+    return 4;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: uint32_t lz4Xxh32(const uint8_t* p, size_t len, uint32_t seed)
+ *
+ * xxHash32 of len bytes at p
+ *---------------------------------------------------------------------------*/
+uint32_t lz4Xxh32(const uint8_t* p, size_t len, uint32_t seed)
+{
+    const uint8_t* end = p + len;
+    uint32_t h, v[4];
+    int i;
+
+    if (len >= 16) {
+        v[0] = seed + XXH_PRIME1 + XXH_PRIME2;
+        v[1] = seed + XXH_PRIME2;
+        v[2] = seed;
+        v[3] = seed - XXH_PRIME1;
+        for (; end - p >= 16; p += 16) {
+            for (i = 0; i < 4; i++) {
+                v[i] += lz4Read32(p + 4 * i) * XXH_PRIME2;
+                v[i] = XXH_ROTL(v[i], 13) * XXH_PRIME1;
+            }
+        }
+        h = XXH_ROTL(v[0], 1) + XXH_ROTL(v[1], 7) + XXH_ROTL(v[2], 12) + XXH_ROTL(v[3], 18);
+    } else {
+        h = seed + XXH_PRIME5;
+    }
+    h += len;
+
+    for (; end - p >= 4; p += 4) {
+        h += lz4Read32(p) * XXH_PRIME3;
+        h = XXH_ROTL(h, 17) * XXH_PRIME4;
+    }
+    for (; p < end; p++) {
+        h += *p * XXH_PRIME5;
+        h = XXH_ROTL(h, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static size_t lz4Compress(const uint8_t* src, size_t len,
+ *                          uint8_t* dst)
+ *
+ * compresses len bytes into a raw LZ4 block at dst, returns its size
+ *---------------------------------------------------------------------------*/
+static size_t lz4Compress(const uint8_t* src, size_t len, uint8_t* dst)
+{
+    uint32_t table[1 << LZ4_HASH_BITS];
+    const uint8_t* end = src + len;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* ref;
+    uint8_t* op = dst;
+    uint8_t* token;
+    uint32_t seq, h;
+    size_t literals, match;
+    unsigned int misses = 0;
+
+    memset(table, 0, sizeof(table));
+
+    /* a table slot may hold a stale or unset position, so every candidate
+     * is checked before it is used */
+    while (len >= LZ4_MF_LIMIT + 1 && ip < end - LZ4_MF_LIMIT) {
+        seq = lz4Read32(ip);
+        h = (seq * XXH_PRIME1) >> (32 - LZ4_HASH_BITS);
+        ref = src + table[h];
+        table[h] = ip - src;
+
+        if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4Read32(ref) != seq) {
+            /* skip faster through data that will not compress */
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+        for (match = LZ4_MIN_MATCH; ip + match < end - LZ4_LAST_LITERALS && ip[match] == ref[match]; match++)
+            ;
+
+        literals = ip - anchor;
+        token = op++;
+        *token = (literals < 15 ? literals : 15) << 4;
+        if (literals >= 15)
+            op = lz4Length(op, literals - 15);
+        memcpy(op, anchor, literals);
+        op += literals;
+
+        *op++ = (ip - ref) & 0xff;
+        *op++ = (ip - ref) >> 8;
+        *token |= match - LZ4_MIN_MATCH < 15 ? match - LZ4_MIN_MATCH : 15;
+        if (match - LZ4_MIN_MATCH >= 15)
+            op = lz4Length(op, match - LZ4_MIN_MATCH - 15);
+
+        ip += match;
+        anchor = ip;
+    }
+
+    /* the rest goes out as literals */
+    literals = end - anchor;
+    token = op++;
+    *token = (literals < 15 ? literals : 15) << 4;
+    if (literals >= 15)
+        op = lz4Length(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - dst;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint8_t* lz4Length(uint8_t* op, size_t n)
+ *
+ * writes the extra bytes of a literal or match length, returns what follows
+ *---------------------------------------------------------------------------*/
+static uint8_t* lz4Length(uint8_t* op, size_t n)
+{
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = n;
+
+    return op;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint32_t lz4Read32(const uint8_t* p)
+ *
+ * reads a little-endian 32 bit word, as LZ4 and xxHash store them
+ *---------------------------------------------------------------------------*/
+static uint32_t lz4Read32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void lz4Write32(uint8_t* p, uint32_t v)
+ *
+ * writes a little-endian 32 bit word
+ *---------------------------------------------------------------------------*/
+static void lz4Write32(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
@@ -0,0 +1,27 @@
+/*******************************************************************************
+ * file: lz4.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for an LZ4 frame encoder, enough to write files that the
+ * lz4 tool and liblz4 decompress. blocks are independent and carry no
+ * checksums, so the only hashing needed is xxh32 over the frame header
+ ******************************************************************************/
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ4_BLOCK_MAX (1 << 20)                 // frame descriptor says 1MB
+#define LZ4_HEADER_LEN 7
+#define LZ4_BOUND(n) ((n) + (n) / 255 + 16)     // worst case compressed size
+
+void lz4FrameHeader(uint8_t* );
+size_t lz4FrameBlock(const uint8_t*, size_t, uint8_t* );
+size_t lz4FrameEnd(uint8_t* );
+uint32_t lz4Xxh32(const uint8_t*, size_t, uint32_t );
+
+#endif
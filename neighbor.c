@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * file: neighbor.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the neighbor liveness table. a slot is never emptied, so a
+ * reader can probe the table while a writer fills in a new slot. a neighbor
+ * that is no longer a next hop is marked stale when a fib is published, and
+ * its slot is handed to the next new neighbor whose probe passes it, which
+ * leaves every other probe chain as it was. writers serialize on
+ * neighborLock. deadCount lets the forwarding path skip the table entirely
+ * while every neighbor is alive, which is almost always
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "neighbor.h"
+#include "fib.h"
+#include "flow.h"
+#include "vclock.h"
+#include "log.h"
+
+static struct neighbor_entry neighbors[NEIGHBOR_TABLE_SIZE];
+static int deadCount = 0;
+static pthread_mutex_t neighborLock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct neighbor_entry* neighborFind(uint32_t, int );
+
+/*-----------------------------------------------------------------------------
+ * Method: void neighborDown(uint32_t ip)
+ *
+ * declares the next hop ip dead, traffic through it moves elsewhere on the
+ * next packet. declaring it dead again restarts its hold time
+ *---------------------------------------------------------------------------*/
+void neighborDown(uint32_t ip)
+{
+    struct neighbor_entry* entry;
+    struct in_addr addr;
+
+    pthread_mutex_lock(&neighborLock);
+    if ((entry = neighborFind(ip, 1)) == NULL) {
+        pthread_mutex_unlock(&neighborLock);
+        LogError(LOG_NEIGHBOR, "Error: neighbor table full");
+        return;
+    }
+
+    __atomic_store_n(&entry->since, vclockNow(), __ATOMIC_RELAXED);
+    if (!entry->dead) {
+        __atomic_store_n(&entry->dead, 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&deadCount, 1, __ATOMIC_RELEASE);
+
+        addr.s_addr = ip;
+        LogWarn(LOG_NEIGHBOR, "-- Neighbor %s is down", logAddr(addr));
+    }
+    pthread_mutex_unlock(&neighborLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void neighborUp(uint32_t ip)
+ *
+ * we heard from the next hop ip, traffic can use it again
+ *---------------------------------------------------------------------------*/
+void neighborUp(uint32_t ip)
+{
+    struct neighbor_entry* entry;
+    struct in_addr addr;
+
+    /* nothing to do for neighbors that were never down */
+    if (!neighborAnyDead())
+        return;
+
+    pthread_mutex_lock(&neighborLock);
+    entry = neighborFind(ip, 0);
+    if (entry && entry->dead) {
+        __atomic_store_n(&entry->dead, 0, __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&deadCount, 1, __ATOMIC_RELEASE);
+
+        addr.s_addr = ip;
+        LogInfo(LOG_NEIGHBOR, "-- Neighbor %s is up", logAddr(addr));
+    }
+    pthread_mutex_unlock(&neighborLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int neighborIsDead(uint32_t ip)
+ *
+ * returns 1 if traffic should avoid the next hop ip. once its hold time is
+ * up a dead neighbor gets traffic again, so arp can find out if it is back
+ *---------------------------------------------------------------------------*/
+int neighborIsDead(uint32_t ip)
+{
+    struct neighbor_entry* entry;
+
+    if (!neighborAnyDead())
+        return 0;
+
+    entry = neighborFind(ip, 0);
+    if (entry == NULL || !__atomic_load_n(&entry->dead, __ATOMIC_ACQUIRE))
+        return 0;
+
+    return difftime(vclockNow(), __atomic_load_n(&entry->since, __ATOMIC_RELAXED))
+        < NEIGHBOR_HOLD_TIME;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int neighborAnyDead()
+ *
+ * returns nonzero if some neighbor may be dead
+ *---------------------------------------------------------------------------*/
+int neighborAnyDead()
+{
+    return __atomic_load_n(&deadCount, __ATOMIC_ACQUIRE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void neighborPrune(const struct fib_hdr* hdr)
+ *
+ * marks every neighbor that is not a next hop of hdr stale, and forgets
+ * that it was dead. called once hdr is the published table
+ *---------------------------------------------------------------------------*/
+void neighborPrune(const struct fib_hdr* hdr)
+{
+    const struct fib_nexthop* nexthops = fibNexthops(hdr);
+    struct neighbor_entry* entry;
+    uint32_t s, i;
+
+    pthread_mutex_lock(&neighborLock);
+    for (s = 0; s < NEIGHBOR_TABLE_SIZE; s++) {
+        entry = &neighbors[s];
+        if (entry->ip == 0)
+            continue;
+
+        for (i = 0; i < hdr->nnexthops && nexthops[i].gw != entry->ip; i++)
+            ;
+        entry->stale = (i == hdr->nnexthops);
+        if (entry->stale && entry->dead) {
+            __atomic_store_n(&entry->dead, 0, __ATOMIC_RELEASE);
+            __atomic_sub_fetch(&deadCount, 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&neighborLock);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct neighbor_entry* neighborFind(uint32_t ip, int add)
+ *
+ * returns the entry for ip, or 0 if it has none. with add set a missing
+ * entry is created, in the first stale slot on ip's probe chain if there
+ * is one, which needs neighborLock
+ *---------------------------------------------------------------------------*/
+static struct neighbor_entry* neighborFind(uint32_t ip, int add)
+{
+    struct neighbor_entry* reuse = NULL;
+    uint32_t s, i, cur;
+
+    /* 0 marks a free slot */
+    if (ip == 0)
+        return 0;
+
+    s = flowMix(ip) & (NEIGHBOR_TABLE_SIZE - 1);
+    for (i = 0; i < NEIGHBOR_TABLE_SIZE; i++, s = (s + 1) & (NEIGHBOR_TABLE_SIZE - 1)) {
+        cur = __atomic_load_n(&neighbors[s].ip, __ATOMIC_ACQUIRE);
+        if (cur == ip) {
+            if (add)
+                neighbors[s].stale = 0;
+            return &neighbors[s];
+        }
+        if (cur == 0)
+            break;
+        if (add && reuse == NULL && neighbors[s].stale)
+            reuse = &neighbors[s];
+    }
+    if (!add)
+        return 0;
+
+    /* ip is not on its chain: before the first free slot is as good as in
+     * it, readers walk that far */
+    if (reuse == NULL) {
+        if (i == NEIGHBOR_TABLE_SIZE)
+            return 0;
+        reuse = &neighbors[s];
+    }
+
+    /* the ip goes in last, a reader that finds it sees the rest */
+    reuse->dead = 0;
+    reuse->since = 0;
+    reuse->stale = 0;
+    __atomic_store_n(&reuse->ip, ip, __ATOMIC_RELEASE);
+    return reuse;
+}
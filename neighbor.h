@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * file: neighbor.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the neighbor liveness table. a next hop is declared
+ * dead when it stops answering arp (or a liveness probe), and fibSelect
+ * steers around dead next hops to the other paths of the prefix or to its
+ * backup. forwarding threads only ever read the table, without locks.
+ * next hops that leave the fib give up their slots to new ones
+ ******************************************************************************/
+
+#ifndef NEIGHBOR_H
+#define NEIGHBOR_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define NEIGHBOR_TABLE_SIZE 256         // must be a power of two
+#define NEIGHBOR_HOLD_TIME 10           // seconds before a dead neighbor is retried
+
+struct neighbor_entry {
+    uint32_t        ip;                 // network order, 0 if the slot is free
+    int             dead;
+    time_t          since;              // when it was declared dead
+    int             stale;              // not a next hop any more, slot reusable
+};
+
+struct fib_hdr;
+
+void neighborDown(uint32_t );
+void neighborUp(uint32_t );
+int neighborIsDead(uint32_t );
+int neighborAnyDead();
+void neighborPrune(const struct fib_hdr* );
+
+#endif
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * file: parse.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the packet parser. it reads each header once, checks that the
+ * frame really holds it and records where it is. frames that claim more
+ * than they carry, or whose ip header is wrong, are refused here so the
+ * handlers never read past the end of a truncated frame
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "checksum.h"
+#include "parse.h"
+
+#define PARSE_ETH_LEN 14
+#define PARSE_ARP_LEN 28
+
+/*-----------------------------------------------------------------------------
+ * Method: int parsePacket(struct packet_desc* desc, uint8_t* packet,
+ *                          unsigned int len)
+ *
+ * fills in desc for the frame packet. returns 0 if the frame can be
+ * handled, -1 if it has to be dropped, with desc->error saying why. frames
+ * that are neither arp nor ip are not ours to judge and pass with no flags
+ *---------------------------------------------------------------------------*/
+int parsePacket(struct packet_desc* desc, uint8_t* packet, unsigned int len)
+{
+    struct sr_ethernet_hdr* ethernetHdr = (struct sr_ethernet_hdr*)packet;
+    struct sr_arphdr* arpHdr;
+    struct ip* ipHdr;
+    unsigned int iplen, l4min;
+    int i;
+
+    memset(desc, 0, sizeof(struct packet_desc));
+    desc->packet = packet;
+    desc->len = len;
+
+    if (len < PARSE_ETH_LEN) {
+        desc->error = "runt frame";
+        return -1;
+    }
+    desc->ethertype = ntohs(ethernetHdr->ether_type);
+    desc->l3 = PARSE_ETH_LEN;
+
+    for (i = 0; i < ETHER_ADDR_LEN && ethernetHdr->ether_dhost[i] == 0xff; i++)
+        ;
+    if (i == ETHER_ADDR_LEN)
+        desc->flags |= PARSE_BROADCAST;
+
+    if (desc->ethertype == ETHERTYPE_ARP) {
+        arpHdr = (struct sr_arphdr*)(packet + PARSE_ETH_LEN);
+        if (len < PARSE_ETH_LEN + PARSE_ARP_LEN) {
+            desc->error = "truncated arp";
+            return -1;
+        }
+        if (ntohs(arpHdr->ar_hrd) != ARPHDR_ETHER || ntohs(arpHdr->ar_pro) != ETHERTYPE_IP ||
+                arpHdr->ar_hln != ETHER_ADDR_LEN || arpHdr->ar_pln != 4) {
+            desc->error = "arp is not ethernet/ipv4";
+            return -1;
+        }
+        desc->src = arpHdr->ar_sip;
+        desc->dst = arpHdr->ar_tip;
+        desc->flags |= PARSE_ARP;
+        return 0;
+    }
+
+    if (desc->ethertype != ETHERTYPE_IP)
+        return 0;
+
+    ipHdr = (struct ip*)(packet + PARSE_ETH_LEN);
+    if (len < PARSE_ETH_LEN + 20) {
+        desc->error = "truncated ip header";
+        return -1;
+    }
+    desc->ihl = ipHdr->ip_hl * 4;
+    iplen = ntohs(ipHdr->ip_len);
+    if (ipHdr->ip_v != 4 || desc->ihl < 20) {
+        desc->error = "not ipv4";
+        return -1;
+    }
+    /* ethernet may pad the frame, but never cut the packet short */
+    if (iplen < desc->ihl || iplen > len - PARSE_ETH_LEN) {
+        desc->error = "bad ip length";
+        return -1;
+    }
+    if (in_checksum((uint16_t*)(packet + PARSE_ETH_LEN), desc->ihl) != 0) {
+        desc->error = "bad ip checksum";
+        return -1;
+    }
+
+    desc->proto = ipHdr->ip_p;
+    desc->src = ipHdr->ip_src.s_addr;
+    desc->dst = ipHdr->ip_dst.s_addr;
+    desc->l4 = PARSE_ETH_LEN + desc->ihl;
+    desc->l4len = iplen - desc->ihl;
+    desc->flags |= PARSE_IP;
+
+    /* only the first fragment carries the transport header */
+    if (ntohs(ipHdr->ip_off) & IP_OFFMASK)
+        return 0;
+
+    switch (desc->proto) {
+        case IPPROTO_ICMP:  l4min = 8; break;
+        case IPPROTO_UDP:   l4min = 8; break;
+        case IPPROTO_TCP:   l4min = 20; break;
+        default:            l4min = 0; break;
+    }
+    if (l4min && desc->l4len >= l4min)
+        desc->flags |= PARSE_L4;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int parseCheckL4(struct packet_desc* desc)
+ *
+ * checks the icmp checksum, which covers the whole message and so is only
+ * worth summing for packets addressed to us. returns 1 if it is right
+ *---------------------------------------------------------------------------*/
+int parseCheckL4(struct packet_desc* desc)
+{
+    if (!(desc->flags & PARSE_L4) || desc->proto != IPPROTO_ICMP)
+        return 0;
+
+    if (in_checksum((uint16_t*)(desc->packet + desc->l4), desc->l4len) == 0)
+        desc->flags |= PARSE_L4_CSUM_OK;
+
+    return (desc->flags & PARSE_L4_CSUM_OK) != 0;
+}
@@ -0,0 +1,44 @@
+/*******************************************************************************
+ * file: parse.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the packet parser. every frame is parsed once, as
+ * it arrives, into a descriptor that the handlers read instead of working
+ * out header offsets and lengths again. a header is only marked present
+ * once the frame is long enough to hold it
+ ******************************************************************************/
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdint.h>
+
+#include "sr_protocol.h"
+
+#define PARSE_BROADCAST     0x01        // ethernet destination is broadcast
+#define PARSE_ARP           0x02        // complete ethernet/ipv4 arp header
+#define PARSE_IP            0x04        // ipv4 header, sane lengths and checksum
+#define PARSE_L4            0x10        // icmp, udp or tcp header fits
+#define PARSE_L4_CSUM_OK    0x20        // icmp checksum is right, see parseCheckL4
+
+struct packet_desc {
+    uint8_t*        packet;
+    unsigned int    len;                // of the frame
+    uint16_t        ethertype;          // host order
+    uint16_t        l3;                 // offset of the arp or ip header
+    uint16_t        l4;                 // offset of what follows the ip header
+    uint16_t        l4len;              // bytes from l4 to the end of the ip packet
+    uint8_t         ihl;                // ip header length in bytes
+    uint8_t         proto;              // ip protocol
+    uint32_t        src;                // ip or arp sender address, network order
+    uint32_t        dst;                // ip or arp target address, network order
+    uint32_t        flags;              // PARSE_*
+    const char*     error;              // why parsePacket refused the frame
+};
+
+int parsePacket(struct packet_desc*, uint8_t*, unsigned int );
+int parseCheckL4(struct packet_desc* );
+
+#endif
@@ -0,0 +1,321 @@
+/*******************************************************************************
+ * file: pipeline.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the multi-threaded packet pipeline. the RX side is whoever
+ * calls pipelineEnqueue (the VNS read loop), each worker owns one ring fed
+ * only by RX, and every worker feeds the single TX ring. RX picks the worker
+ * by flow hash, so each worker is a shard that sees whole flows
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "ring.h"
+#include "pipeline.h"
+#include "flow.h"
+#include "shard.h"
+#include "rcu.h"
+#include "log.h"
+#include "trace.h"
+#include "counter.h"
+
+#define PIPELINE_SPINS 128                      // empty polls before we yield
+#define PIPELINE_NAP_US 50                      // sleep once we have yielded too
+
+struct pipeline_tx {
+    void*           buf;                        // malloc'd VNS packet command
+    unsigned int    len;
+};
+
+static void* pipelineWorker(void* );
+static void* pipelineTx(void* );
+static void pipelineIdle(int* );
+
+/*-----------------------------------------------------------------------------
+ * Method: int pipelineStart(struct sr_instance* sr, int nworkers)
+ *
+ * creates the rings and spawns nworkers worker threads plus the TX thread.
+ * returns 0 on success, -1 on error, with whatever was started stopped
+ * and freed again
+ *---------------------------------------------------------------------------*/
+int pipelineStart(struct sr_instance* sr, int nworkers)
+{
+    struct sr_pipeline* pl;
+    int i, started = 0, txStarted = 0;
+
+    if (nworkers < 1 || nworkers > PIPELINE_MAX_WORKERS) {
+        fprintf(stderr, "Error: pipeline needs 1 to %d workers\n", PIPELINE_MAX_WORKERS);
+        return -1;
+    }
+
+    pl = calloc(1, sizeof(struct sr_pipeline));
+    if (pl == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for pipeline\n");
+        return -1;
+    }
+    pl->workers = calloc(nworkers, sizeof(struct pipeline_worker));
+    if (pl->workers == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for pipeline\n");
+        free(pl);
+        return -1;
+    }
+    pl->nworkers = nworkers;
+    pl->running = 1;
+
+    if (ringInit(&pl->tx, PIPELINE_RING_SIZE, sizeof(struct pipeline_tx)) != 0)
+        goto fail;
+    for (i = 0; i < nworkers; i++) {
+        if (ringInit(&pl->workers[i].rx, PIPELINE_RING_SIZE, sizeof(struct pipeline_frame*)) != 0)
+            goto fail;
+        pl->workers[i].sr = sr;
+        pl->workers[i].id = i;
+    }
+
+    /* publish before any thread can look at it */
+    sr->pipeline = pl;
+
+    if (pthread_create(&pl->txThread, NULL, pipelineTx, sr) != 0) {
+        perror("pthread_create");
+        goto fail;
+    }
+    txStarted = 1;
+    for (started = 0; started < nworkers; started++) {
+        if (pthread_create(&pl->workers[started].thread, NULL, pipelineWorker,
+                    &pl->workers[started]) != 0) {
+            perror("pthread_create");
+            goto fail;
+        }
+    }
+
+    printf("Pipeline started with %d workers\n", nworkers);
+
+    return 0;
+
+fail:
+    /* no frame has been queued yet, so this is pipelineStop on what ran */
+    __atomic_store_n(&pl->running, 0, __ATOMIC_RELEASE);
+    for (i = 0; i < started; i++)
+        pthread_join(pl->workers[i].thread, NULL);
+    __atomic_store_n(&sr->pipeline, NULL, __ATOMIC_RELEASE);
+    if (txStarted)
+        pthread_join(pl->txThread, NULL);
+
+    for (i = 0; i < nworkers; i++)
+        ringDestroy(&pl->workers[i].rx);
+    ringDestroy(&pl->tx);
+    free(pl->workers);
+    free(pl);
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void pipelineStop(struct sr_instance* sr)
+ *
+ * lets the workers drain their rings and exit, then does the same for the
+ * TX thread, then frees everything. the probe and reload threads send too,
+ * so they must be stopped first
+ *---------------------------------------------------------------------------*/
+void pipelineStop(struct sr_instance* sr)
+{
+    struct sr_pipeline* pl = sr->pipeline;
+    int i;
+
+    if (pl == NULL)
+        return;
+
+    __atomic_store_n(&pl->running, 0, __ATOMIC_RELEASE);
+
+    for (i = 0; i < pl->nworkers; i++)
+        pthread_join(pl->workers[i].thread, NULL);
+
+    /* workers are gone, and so are probe and reload, nothing else can
+     * queue a frame */
+    __atomic_store_n(&sr->pipeline, NULL, __ATOMIC_RELEASE);
+    pthread_join(pl->txThread, NULL);
+
+    for (i = 0; i < pl->nworkers; i++) {
+        printf("Pipeline worker %d handled %lu packets\n", i, pl->workers[i].packets);
+        ringDestroy(&pl->workers[i].rx);
+    }
+    if (pl->rxDrops || pl->txDrops)
+        printf("Pipeline dropped %lu received and %lu outgoing packets\n",
+                pl->rxDrops, pl->txDrops);
+    ringDestroy(&pl->tx);
+
+    free(pl->workers);
+    free(pl);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int pipelineEnqueue(struct sr_instance* sr, uint8_t* packet,
+ *                              unsigned int len, const char* interface,
+ *                              int wait)
+ *
+ * copies a received frame and hands it to a worker. a full ring drops the
+ * frame unless wait is set, in which case we back off until there is room
+ * (offline replay wants every frame handled). returns 0 if queued, -1 if
+ * dropped
+ *---------------------------------------------------------------------------*/
+int pipelineEnqueue(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+        const char* interface, int wait)
+{
+    struct sr_pipeline* pl = sr->pipeline;
+    struct pipeline_worker* worker;
+    struct pipeline_frame* frame;
+    int spins = 0;
+
+    frame = malloc(sizeof(struct pipeline_frame) + len);
+    if (frame == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for packet storage\n");
+        return -1;
+    }
+    frame->len = len;
+    strncpy(frame->iface, interface, sr_IFACE_NAMELEN);
+    memcpy(frame->data, packet, len);
+
+    /* keep every packet of a flow on one worker, in order */
+    worker = &pl->workers[flowHash(packet, len) % pl->nworkers];
+
+    while (ringPush(&worker->rx, &frame) != 0) {
+        if (!wait) {
+            __atomic_add_fetch(&pl->rxDrops, 1, __ATOMIC_RELAXED);
+            CounterInc(COUNTER_DROP_RX_QUEUE);
+            Trace(TRACE_DROP, sr_get_interface(sr, interface), len, 0, TRACE_DROP_QUEUE_FULL);
+            free(frame);
+            return -1;
+        }
+        pipelineIdle(&spins);
+    }
+    Trace(TRACE_QUEUE, sr_get_interface(sr, interface), len, 0, worker->id);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int pipelineTransmit(struct sr_instance* sr, void* buf,
+ *                                  unsigned int len)
+ *
+ * queues a complete VNS packet command for the TX thread, which takes
+ * ownership of buf. returns 0 if queued, -1 if dropped
+ *---------------------------------------------------------------------------*/
+int pipelineTransmit(struct sr_instance* sr, void* buf, unsigned int len)
+{
+    struct sr_pipeline* pl = sr->pipeline;
+    struct pipeline_tx tx;
+
+    tx.buf = buf;
+    tx.len = len;
+
+    if (ringPush(&pl->tx, &tx) != 0) {
+        __atomic_add_fetch(&pl->txDrops, 1, __ATOMIC_RELAXED);
+        CounterInc(COUNTER_DROP_TX_QUEUE);
+        free(buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* pipelineWorker(void* arg)
+ *
+ * worker thread body, runs sr_handlepackets on bursts of whatever is in
+ * its ring until the pipeline stops and the ring is empty. under load the
+ * bursts fill up, when idle each one is a single frame and nothing waits
+ *---------------------------------------------------------------------------*/
+static void* pipelineWorker(void* arg)
+{
+    struct pipeline_worker* worker = arg;
+    struct sr_pipeline* pl = worker->sr->pipeline;
+    struct pipeline_frame* frames[SR_BURST_MAX];
+    uint8_t* packets[SR_BURST_MAX];
+    unsigned int lens[SR_BURST_MAX];
+    char* interfaces[SR_BURST_MAX];
+    int i, n, spins = 0;
+
+    shardAttach(worker->id);
+
+    for (;;) {
+        /* take whatever is waiting, up to a burst */
+        for (n = 0; n < SR_BURST_MAX && ringPop(&worker->rx, &frames[n]) == 0; n++) {
+            packets[n] = frames[n]->data;
+            lens[n] = frames[n]->len;
+            interfaces[n] = frames[n]->iface;
+        }
+        if (n == 0) {
+            if (!__atomic_load_n(&pl->running, __ATOMIC_ACQUIRE) && ringCount(&worker->rx) == 0)
+                break;
+            pipelineIdle(&spins);
+            continue;
+        }
+        spins = 0;
+
+        sr_handlepackets(worker->sr, packets, lens, interfaces, n);
+        worker->packets += n;
+        for (i = 0; i < n; i++)
+            free(frames[i]);
+    }
+
+    shardDump(shardCurrent());
+    shardDetach();
+    rcuUnregister();
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* pipelineTx(void* arg)
+ *
+ * TX thread body, the only writer on the server socket while the pipeline
+ * runs. exits once the workers are gone and the ring is empty
+ *---------------------------------------------------------------------------*/
+static void* pipelineTx(void* arg)
+{
+    struct sr_instance* sr = arg;
+    struct sr_pipeline* pl = sr->pipeline;
+    struct pipeline_tx tx;
+    int spins = 0;
+
+    for (;;) {
+        if (ringPop(&pl->tx, &tx) != 0) {
+            if (__atomic_load_n(&sr->pipeline, __ATOMIC_ACQUIRE) == NULL && ringCount(&pl->tx) == 0)
+                break;
+            pipelineIdle(&spins);
+            continue;
+        }
+        spins = 0;
+
+        if (write(sr->sockfd, tx.buf, tx.len) < tx.len)
+            LogError(LOG_PACKET, "Error writing packet");
+        free(tx.buf);
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void pipelineIdle(int* spins)
+ *
+ * backs off when a ring is empty: spin for a while, then yield, then nap so
+ * an idle router does not burn a core per thread
+ *---------------------------------------------------------------------------*/
+static void pipelineIdle(int* spins)
+{
+    if (++(*spins) < PIPELINE_SPINS)
+        return;
+
+    if (*spins < 2 * PIPELINE_SPINS)
+        sched_yield();
+    else
+        usleep(PIPELINE_NAP_US);
+}
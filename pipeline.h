@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * file: pipeline.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the multi-threaded packet pipeline. the thread reading
+ * from the VNS server hands frames to N worker threads over lock-free rings,
+ * the workers run sr_handlepacket and queue outgoing frames on a ring owned
+ * by a single TX thread that does all the socket writes. offline replay with
+ * workers (-R with -w) is not deterministic: the virtual clock still follows
+ * the capture, but frames of different flows leave in whatever order the
+ * workers finish them, so the output can differ from run to run
+ ******************************************************************************/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+#include "ring.h"
+
+#define PIPELINE_MAX_WORKERS 64
+#define PIPELINE_RING_SIZE 1024
+
+struct pipeline_frame {
+    unsigned int    len;                        // length of data
+    char            iface[sr_IFACE_NAMELEN];    // receiving interface
+    uint8_t         data[];                     // ethernet frame
+};
+
+struct pipeline_worker {
+    struct sr_instance*     sr;
+    pthread_t               thread;
+    int                     id;
+    struct sr_ring          rx;                 // frames from the RX thread
+    unsigned long           packets;            // frames handled
+};
+
+struct sr_pipeline {
+    int                     nworkers;
+    struct pipeline_worker* workers;
+    struct sr_ring          tx;                 // VNS frames for the TX thread
+    pthread_t               txThread;
+    int                     running;
+    unsigned long           rxDrops;            // RX ring full
+    unsigned long           txDrops;            // TX ring full
+};
+
+int pipelineStart(struct sr_instance*, int );
+void pipelineStop(struct sr_instance* );
+int pipelineEnqueue(struct sr_instance*, uint8_t*, unsigned int, const char*, int );
+int pipelineTransmit(struct sr_instance*, void*, unsigned int );
+
+#endif
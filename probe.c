@@ -0,0 +1,232 @@
+/*******************************************************************************
+ * file: probe.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements gateway liveness probing. the probe thread owns the session
+ * table, the only thing anyone else writes is lastHeard, from handleArp.
+ * each tick it picks up the gateways of the fib in use, judges every
+ * session by when it last answered, and sends the next round of probes.
+ * a gateway going down or coming back re-routes the packet cache
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "arp.h"
+#include "fib.h"
+#include "rcu.h"
+#include "forward.h"
+#include "neighbor.h"
+#include "probe.h"
+#include "log.h"
+
+struct probe_state {
+    struct sr_instance*     sr;
+    int                     interval;           // ms
+    int                     multiplier;
+    int                     nsessions;
+    struct probe_session    sessions[PROBE_MAX_SESSIONS];
+    pthread_t               thread;
+    int                     running;
+    int                     stopping;           // set by probeStop
+};
+
+static struct probe_state probeState;
+
+static void* probeThread(void* );
+static void probeSync(struct probe_state*, uint64_t );
+static uint64_t probeNow();
+
+/*-----------------------------------------------------------------------------
+ * Method: int probeStart(struct sr_instance* sr, int interval, int multiplier)
+ *
+ * starts probing every gateway each interval milliseconds. a gateway is
+ * down after multiplier intervals without a reply. returns 0 on success,
+ * -1 on error
+ *---------------------------------------------------------------------------*/
+int probeStart(struct sr_instance* sr, int interval, int multiplier)
+{
+    if (interval < 1 || multiplier < 1) {
+        fprintf(stderr, "Error: probe interval and multiplier must be positive\n");
+        return -1;
+    }
+
+    probeState.sr = sr;
+    probeState.interval = interval;
+    probeState.multiplier = multiplier;
+    probeState.nsessions = 0;
+    probeState.stopping = 0;
+
+    if (pthread_create(&probeState.thread, NULL, probeThread, &probeState) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    probeState.running = 1;
+
+    printf("Probing gateways every %d ms, down after %d misses\n", interval, multiplier);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void probeStop()
+ *
+ * waits for the probe thread to finish its tick and exit, so no probe is
+ * sent once the router shuts down
+ *---------------------------------------------------------------------------*/
+void probeStop()
+{
+    if (!probeState.running)
+        return;
+
+    __atomic_store_n(&probeState.stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(probeState.thread, NULL);
+    probeState.running = 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void probeHeard(uint32_t ip)
+ *
+ * called for every arp reply, if ip is a gateway we probe it is alive. the
+ * session table only changes on the probe thread, and sessions are never
+ * freed, so reading it here without a lock is safe
+ *---------------------------------------------------------------------------*/
+void probeHeard(uint32_t ip)
+{
+    int i, n = __atomic_load_n(&probeState.nsessions, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < n; i++) {
+        if (probeState.sessions[i].gw == ip) {
+            __atomic_store_n(&probeState.sessions[i].lastHeard, probeNow(), __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* probeThread(void* arg)
+ *
+ * probe thread body, runs until probeStop
+ *---------------------------------------------------------------------------*/
+static void* probeThread(void* arg)
+{
+    struct probe_state* ps = arg;
+    struct probe_session* session;
+    struct sr_if* iface;
+    struct timespec tick;
+    struct in_addr addr;
+    uint64_t now, detect = (uint64_t)ps->interval * ps->multiplier;
+    int i, changed;
+
+    tick.tv_sec = ps->interval / 1000;
+    tick.tv_nsec = (ps->interval % 1000) * 1000000L;
+
+    for (;;) {
+        nanosleep(&tick, NULL);
+        if (__atomic_load_n(&ps->stopping, __ATOMIC_ACQUIRE))
+            break;
+        now = probeNow();
+        changed = 0;
+
+        probeSync(ps, now);
+
+        for (i = 0; i < ps->nsessions; i++) {
+            session = &ps->sessions[i];
+            if (!session->seen)
+                continue;
+
+            if (now - __atomic_load_n(&session->lastHeard, __ATOMIC_RELAXED) > detect) {
+                /* refreshes the hold time too, so it stays down while silent */
+                neighborDown(session->gw);
+                if (session->up) {
+                    addr.s_addr = session->gw;
+                    LogWarn(LOG_NEIGHBOR, "-- Probe: %s missed %d probes", logAddr(addr), ps->multiplier);
+                    session->up = 0;
+                    changed = 1;
+                }
+            } else if (!session->up) {
+                neighborUp(session->gw);
+                session->up = 1;
+                changed = 1;
+            }
+
+            if ((iface = sr_get_interface(ps->sr, session->interface)) != NULL)
+                arpSendRequest(ps->sr, iface, session->gw);
+        }
+
+        /* packets waiting on arp follow the new state now, not after their
+         * own arps run out */
+        if (changed)
+            requeueCachedPackets(ps->sr);
+    }
+
+    rcuUnregister();
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void probeSync(struct probe_state* ps, uint64_t now)
+ *
+ * matches the sessions to the gateways of the fib in use. new gateways
+ * start out up, with a full detect time to answer their first probe.
+ * gateways no longer routed to stop being probed but keep their slot
+ *---------------------------------------------------------------------------*/
+static void probeSync(struct probe_state* ps, uint64_t now)
+{
+    const struct fib_nexthop* nexthops;
+    struct probe_session* session;
+    struct fib* fib;
+    uint32_t i;
+    int j;
+
+    for (j = 0; j < ps->nsessions; j++)
+        ps->sessions[j].seen = 0;
+
+    rcuReadLock();
+    if ((fib = fibCurrent()) != NULL) {
+        nexthops = fibNexthops(fib->hdr);
+        for (i = 0; i < fib->hdr->nnexthops; i++) {
+            /* directly connected, nobody to probe */
+            if (nexthops[i].gw == 0)
+                continue;
+
+            for (j = 0; j < ps->nsessions && ps->sessions[j].gw != nexthops[i].gw; j++)
+                ;
+            if (j == ps->nsessions) {
+                if (ps->nsessions == PROBE_MAX_SESSIONS)
+                    continue;
+                session = &ps->sessions[j];
+                session->gw = nexthops[i].gw;
+                session->lastHeard = now;
+                session->up = 1;
+                /* probeHeard may look at it as soon as it is counted */
+                __atomic_store_n(&ps->nsessions, j + 1, __ATOMIC_RELEASE);
+            }
+            strncpy(ps->sessions[j].interface, nexthops[i].interface, sr_IFACE_NAMELEN);
+            ps->sessions[j].seen = 1;
+        }
+    }
+    rcuReadUnlock();
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t probeNow()
+ *
+ * returns a monotonic time in milliseconds
+ *---------------------------------------------------------------------------*/
+static uint64_t probeNow()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
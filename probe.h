@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * file: probe.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for gateway liveness probing. every gateway in the
+ * routing table gets an arp request each interval, in the spirit of BFD.
+ * one that misses multiplier replies in a row is declared dead, and the
+ * forwarding path steers around it right away
+ ******************************************************************************/
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdint.h>
+
+#include "sr_if.h"
+
+#define PROBE_MAX_SESSIONS 64
+#define PROBE_INTERVAL_MS 100           // default time between probes
+#define PROBE_MULTIPLIER 3              // default missed probes before down
+
+struct sr_instance;
+
+struct probe_session {
+    uint32_t        gw;                 // network order
+    char            interface[sr_IFACE_NAMELEN];
+    uint64_t        lastHeard;          // ms, written by whoever saw the reply
+    int             up;
+    int             seen;               // still in the routing table
+};
+
+int probeStart(struct sr_instance*, int, int );
+void probeStop();
+void probeHeard(uint32_t );
+
+#endif
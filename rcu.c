@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * file: rcu.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements epoch based read-copy-update. each reader thread owns a cache
+ * line holding the global epoch it saw when it entered its read section.
+ * rcuSynchronize bumps the epoch and waits until every reader is either
+ * outside a section or inside one that started after the bump, at which
+ * point nobody can still hold a pointer to the old version
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "rcu.h"
+
+static unsigned long globalEpoch = 1;
+static struct rcu_reader* readers = NULL;       // every registered thread
+static pthread_mutex_t readersLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct rcu_reader* self = NULL;
+
+/*-----------------------------------------------------------------------------
+ * Method: void rcuRegister()
+ *
+ * makes the calling thread a reader. rcuReadLock does this on first use
+ *---------------------------------------------------------------------------*/
+void rcuRegister()
+{
+    struct rcu_reader* reader;
+
+    if (self)
+        return;
+
+    if (posix_memalign((void**)&reader, RCU_CACHE_LINE, sizeof(struct rcu_reader)) != 0) {
+        fprintf(stderr, "Error: could not find memory for rcu reader\n");
+        exit(1);
+    }
+    reader->epoch = 0;
+
+    pthread_mutex_lock(&readersLock);
+    reader->next = readers;
+    readers = reader;
+    pthread_mutex_unlock(&readersLock);
+
+    self = reader;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void rcuUnregister()
+ *
+ * removes the calling thread from the reader list, call before it exits
+ *---------------------------------------------------------------------------*/
+void rcuUnregister()
+{
+    struct rcu_reader** walker;
+
+    if (self == NULL)
+        return;
+
+    pthread_mutex_lock(&readersLock);
+    for (walker = &readers; *walker; walker = &(*walker)->next) {
+        if (*walker == self) {
+            *walker = self->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&readersLock);
+
+    free(self);
+    self = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void rcuReadLock()
+ *
+ * enters a read section. the fence orders our epoch store before any load
+ * of a protected pointer, so a writer that sees us outside a section knows
+ * our next load will find its new version
+ *---------------------------------------------------------------------------*/
+void rcuReadLock()
+{
+    if (self == NULL)
+        rcuRegister();
+
+    __atomic_store_n(&self->epoch, __atomic_load_n(&globalEpoch, __ATOMIC_RELAXED),
+            __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void rcuReadUnlock()
+ *
+ * leaves a read section, nothing read inside may be used after this
+ *---------------------------------------------------------------------------*/
+void rcuReadUnlock()
+{
+    __atomic_store_n(&self->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void rcuSynchronize()
+ *
+ * waits for every read section that could have seen the old version to
+ * finish. must not be called from inside a read section
+ *---------------------------------------------------------------------------*/
+void rcuSynchronize()
+{
+    struct rcu_reader* reader;
+    unsigned long epoch, seen;
+
+    epoch = __atomic_add_fetch(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&readersLock);
+    for (reader = readers; reader; reader = reader->next) {
+        for (;;) {
+            seen = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+            if (seen == 0 || seen >= epoch)
+                break;
+            sched_yield();
+        }
+    }
+    pthread_mutex_unlock(&readersLock);
+}
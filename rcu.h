@@ -0,0 +1,30 @@
+/*******************************************************************************
+ * file: rcu.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for epoch based read-copy-update. readers bracket their
+ * use of shared tables with rcuReadLock/rcuReadUnlock, which are plain
+ * stores to a per-thread slot. writers publish a new version with a pointer
+ * swap and call rcuSynchronize before freeing the old one
+ ******************************************************************************/
+
+#ifndef RCU_H
+#define RCU_H
+
+#define RCU_CACHE_LINE 64
+
+struct rcu_reader {
+    unsigned long       epoch;                  // 0 while outside a read section
+    struct rcu_reader*  next;
+    char                pad[RCU_CACHE_LINE - sizeof(unsigned long) - sizeof(void*)];
+};
+
+void rcuRegister();
+void rcuUnregister();
+void rcuReadLock();
+void rcuReadUnlock();
+void rcuSynchronize();
+
+#endif
@@ -0,0 +1,381 @@
+/*******************************************************************************
+ * file: reload.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements routing table hot reload. the signal handler only writes a
+ * byte to a pipe, the reload thread does the rest: read the file into a
+ * new list, compile it, diff it against the table in use, publish it and
+ * re-route whatever is waiting in the packet cache. arp state survives
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <libgen.h>
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <sys/inotify.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "fib.h"
+#include "forward.h"
+#include "rcu.h"
+#include "reload.h"
+
+struct reload_state {
+    struct sr_instance*     sr;
+    char                    filename[BUFSIZ];
+    int                     source;             // RELOAD_RTABLE, ...
+    int                     pipefd[2];          // SIGHUP -> reload thread
+    int                     inotifyfd;          // -1 without inotify
+    pthread_t               thread;
+    int                     running;
+    int                     stopping;           // set by reloadStop
+};
+
+static struct reload_state reloadState;
+static pthread_mutex_t reloadMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void reloadSignal(int );
+static void* reloadThread(void* );
+static int reloadSwap(struct sr_instance*, const char*, int );
+static int reloadCheckInterfaces(struct sr_instance*, const struct fib_hdr* );
+static int reloadDiff(const struct fib_hdr*, const struct fib_hdr*, int* );
+
+/*-----------------------------------------------------------------------------
+ * Method: int reloadStart(struct sr_instance* sr, const char* filename,
+ *                              int source)
+ *
+ * installs the SIGHUP handler, watches filename and starts the reload
+ * thread. source says what filename is: an rtable, a snapshot written by
+ * fibSave, or the name of a shared fib. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int reloadStart(struct sr_instance* sr, const char* filename, int source)
+{
+    struct sigaction sa;
+    char dir[BUFSIZ];
+
+    reloadState.sr = sr;
+    strncpy(reloadState.filename, filename, BUFSIZ - 1);
+    reloadState.source = source;
+    reloadState.inotifyfd = -1;
+    reloadState.stopping = 0;
+
+    if (pipe(reloadState.pipefd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+#ifdef _LINUX_
+    /* editors usually write a new file and rename it over the old one, so
+     * watch the directory and match on the name */
+    strncpy(dir, filename, BUFSIZ - 1);
+    dir[BUFSIZ - 1] = '\0';
+    if (source != RELOAD_SHARED && ((reloadState.inotifyfd = inotify_init1(IN_NONBLOCK)) < 0 ||
+            inotify_add_watch(reloadState.inotifyfd, dirname(dir), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)) {
+        perror("inotify");
+        if (reloadState.inotifyfd >= 0)
+            close(reloadState.inotifyfd);
+        reloadState.inotifyfd = -1;
+    }
+#endif /* _LINUX_ */
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = reloadSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGHUP, &sa, NULL) != 0) {
+        perror("sigaction");
+        return -1;
+    }
+
+    if (pthread_create(&reloadState.thread, NULL, reloadThread, &reloadState) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    reloadState.running = 1;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void reloadStop()
+ *
+ * wakes the reload thread through its pipe and waits for it to finish, so
+ * no reload can send from the packet cache once the router shuts down
+ *---------------------------------------------------------------------------*/
+void reloadStop()
+{
+    char c = 's';
+
+    if (!reloadState.running)
+        return;
+
+    __atomic_store_n(&reloadState.stopping, 1, __ATOMIC_RELEASE);
+    if (write(reloadState.pipefd[1], &c, 1) != 1)
+        perror("write");
+
+    pthread_join(reloadState.thread, NULL);
+    reloadState.running = 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void reloadLock()
+ *
+ * keeps reloads out. held by a reload from reading the new table until the
+ * old list is freed, so anything else that walks sr->routing_table, uses
+ * fibCurrent() outside a read section or changes sr->if_list once the
+ * reload thread runs takes it too
+ *---------------------------------------------------------------------------*/
+void reloadLock()
+{
+    pthread_mutex_lock(&reloadMutex);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void reloadUnlock()
+ *---------------------------------------------------------------------------*/
+void reloadUnlock()
+{
+    pthread_mutex_unlock(&reloadMutex);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int reloadRoutingTable(struct sr_instance* sr, const char* filename,
+ *                                  int source)
+ *
+ * swaps in the routing table in filename, as described by source. the
+ * table in use is kept if the new one cannot be loaded or names an
+ * interface we do not have. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int reloadRoutingTable(struct sr_instance* sr, const char* filename, int source)
+{
+    int ret;
+
+    reloadLock();
+    ret = reloadSwap(sr, filename, source);
+    reloadUnlock();
+
+    return ret;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int reloadSwap(struct sr_instance* sr, const char* filename,
+ *                                  int source)
+ *
+ * the body of reloadRoutingTable. needs reloadLock
+ *---------------------------------------------------------------------------*/
+static int reloadSwap(struct sr_instance* sr, const char* filename, int source)
+{
+    struct sr_rt* table = 0;
+    struct sr_rt* old;
+    struct fib* fib;
+    int added, removed, changed;
+
+    if (source == RELOAD_SHARED) {
+        if ((fib = fibShmAttach(filename)) == NULL) {
+            fprintf(stderr, "-- Reload: keeping old routing table, cannot attach %s\n", filename);
+            return -1;
+        }
+    } else if (source == RELOAD_SNAPSHOT) {
+        if ((fib = fibMap(filename)) == NULL) {
+            fprintf(stderr, "-- Reload: keeping old routing table, cannot map %s\n", filename);
+            return -1;
+        }
+    } else {
+        if (sr_read_rt(filename, &table) != 0) {
+            fprintf(stderr, "-- Reload: keeping old routing table, cannot read %s\n", filename);
+            return -1;
+        }
+        if ((fib = fibBuild(table)) == NULL) {
+            fprintf(stderr, "-- Reload: keeping old routing table, cannot compile %s\n", filename);
+            sr_free_rt(table);
+            return -1;
+        }
+    }
+    if (reloadCheckInterfaces(sr, fib->hdr) != 0) {
+        fprintf(stderr, "-- Reload: keeping old routing table, %s names unknown interfaces\n", filename);
+        fibRelease(fib);
+        sr_free_rt(table);
+        return -1;
+    }
+
+    /* the only writer is us, so the current table cannot go away here */
+    added = reloadDiff(fib->hdr, fibCurrent()->hdr, &changed);
+    removed = reloadDiff(fibCurrent()->hdr, fib->hdr, NULL);
+
+    /* a shared fib is moved to even if nothing changed, so we stop polling
+     * it and share pages with processes attached to the new generation */
+    if (added == 0 && removed == 0 && changed == 0 && source != RELOAD_SHARED) {
+        printf("-- Reload: routing table unchanged\n");
+        fibRelease(fib);
+        sr_free_rt(table);
+        return 0;
+    }
+
+    forwardWeighNexthops(sr, fib);
+    fibPublish(fib);
+
+    /* the forwarding path only uses the fib, everything else that walks
+     * the list holds reloadLock */
+    old = sr->routing_table;
+    sr->routing_table = table;
+    sr_free_rt(old);
+
+    printf("-- Reload: %d routes added, %d removed, %d changed\n", added, removed, changed);
+
+    requeueCachedPackets(sr);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void reloadSignal(int sig)
+ *
+ * SIGHUP handler, wakes up the reload thread
+ *---------------------------------------------------------------------------*/
+static void reloadSignal(int sig)
+{
+    char c = 'h';
+
+    if (write(reloadState.pipefd[1], &c, 1) != 1)
+        return;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* reloadThread(void* arg)
+ *
+ * waits for a SIGHUP or a write to the rtable file, or for a shared fib to
+ * move to a new generation, then reloads. runs until reloadStop
+ *---------------------------------------------------------------------------*/
+static void* reloadThread(void* arg)
+{
+    struct reload_state* state = arg;
+    struct pollfd fds[2];
+    char buf[4096];
+    char base[BUFSIZ];
+    const char* name;
+    int nfds, reload;
+    ssize_t n, off;
+
+    strncpy(base, state->filename, BUFSIZ - 1);
+    base[BUFSIZ - 1] = '\0';
+    name = basename(base);
+
+    fds[0].fd = state->pipefd[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = state->inotifyfd;
+    fds[1].events = POLLIN;
+    nfds = (state->inotifyfd >= 0) ? 2 : 1;
+
+    for (;;) {
+        /* shm has nothing to wait on, check the generation now and then */
+        if (poll(fds, nfds, (state->source == RELOAD_SHARED) ? RELOAD_POLL_MS : -1) < 0)
+            continue;
+
+        if (__atomic_load_n(&state->stopping, __ATOMIC_ACQUIRE))
+            break;
+
+        reload = 0;
+
+        if (state->source == RELOAD_SHARED && fibShmGeneration(state->filename) != fibCurrent()->shared) {
+            printf("-- Reload: shared fib %s has a new generation\n", state->filename);
+            reload = 1;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            if (read(state->pipefd[0], buf, sizeof(buf)) > 0) {
+                printf("-- Reload: SIGHUP, rereading %s\n", state->filename);
+                reload = 1;
+            }
+        }
+
+#ifdef _LINUX_
+        if (nfds > 1 && (fds[1].revents & POLLIN)) {
+            while ((n = read(state->inotifyfd, buf, sizeof(buf))) > 0) {
+                for (off = 0; off < n; ) {
+                    struct inotify_event* ev = (struct inotify_event*)(buf + off);
+                    if (ev->len > 0 && strcmp(ev->name, name) == 0) {
+                        printf("-- Reload: %s changed\n", state->filename);
+                        reload = 1;
+                    }
+                    off += sizeof(struct inotify_event) + ev->len;
+                }
+            }
+        }
+#else
+        (void)n; (void)off; (void)name;
+#endif /* _LINUX_ */
+
+        if (reload)
+            reloadRoutingTable(state->sr, state->filename, state->source);
+    }
+
+    rcuUnregister();
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int reloadCheckInterfaces(struct sr_instance* sr,
+ *                                              const struct fib_hdr* hdr)
+ *
+ * same check as sr_verify_routing_table, but on a table we have not
+ * installed yet. returns the number of next hops on unknown interfaces
+ *---------------------------------------------------------------------------*/
+static int reloadCheckInterfaces(struct sr_instance* sr, const struct fib_hdr* hdr)
+{
+    const struct fib_nexthop* nexthops = fibNexthops(hdr);
+    uint32_t i;
+    int missing = 0;
+
+    /* before hwinfo we have nothing to check against */
+    if (sr->if_list == 0)
+        return 0;
+
+    for (i = 0; i < hdr->nnexthops; i++) {
+        if (sr_get_interface(sr, nexthops[i].interface) == 0) {
+            fprintf(stderr, "-- Reload: no interface %s\n", nexthops[i].interface);
+            missing++;
+        }
+    }
+
+    return missing;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int reloadDiff(const struct fib_hdr* a,
+ *                                  const struct fib_hdr* b, int* changed)
+ *
+ * returns the number of prefixes in a that b does not have. if changed is
+ * given, it gets the number of prefixes both have with different paths
+ *---------------------------------------------------------------------------*/
+static int reloadDiff(const struct fib_hdr* a, const struct fib_hdr* b, int* changed)
+{
+    const struct fib_prefix* prefixes = fibPrefixes(a);
+    const struct fib_prefix* other;
+    uint32_t i;
+    int missing = 0;
+
+    if (changed)
+        *changed = 0;
+
+    for (i = 0; i < a->nprefixes; i++) {
+        other = fibFind(b, prefixes[i].dest, prefixes[i].mask);
+        if (other == NULL)
+            missing++;
+        else if (changed && !fibSameGroup(a, &fibGroups(a)[prefixes[i].group], b, &fibGroups(b)[other->group]))
+            (*changed)++;
+    }
+
+    return missing;
+}
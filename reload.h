@@ -0,0 +1,31 @@
+/*******************************************************************************
+ * file: reload.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for reloading the routing table while the router runs.
+ * a SIGHUP, or on linux any write to the rtable file, wakes a thread that
+ * parses and compiles the new table off the forwarding path and swaps it in.
+ * a compiled snapshot is mapped instead of parsed, and a shared fib is
+ * polled for new generations
+ ******************************************************************************/
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#define RELOAD_RTABLE 0                         // rtable text file
+#define RELOAD_SNAPSHOT 1                       // file written by fibSave
+#define RELOAD_SHARED 2                         // name of a shared fib
+
+#define RELOAD_POLL_MS 1000                     // shared fib generation check
+
+struct sr_instance;
+
+int reloadStart(struct sr_instance*, const char*, int );
+void reloadStop();
+void reloadLock();
+void reloadUnlock();
+int reloadRoutingTable(struct sr_instance*, const char*, int );
+
+#endif
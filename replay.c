@@ -0,0 +1,356 @@
+/*******************************************************************************
+ * file: replay.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements offline replay of pcap files through the router. every frame
+ * read is handed to sr_handlepacket as if it came from the VNS server, and
+ * every frame the router sends is written to an output pcap. the router
+ * clock follows the capture timestamps so runs are repeatable
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_dumper.h"
+#include "vclock.h"
+#include "capture.h"
+#include "replay.h"
+#include "pipeline.h"
+#include "latency.h"
+
+#define PCAP_SWAPPED_MAGIC      0xd4c3b2a1
+#define PCAP_NSEC_MAGIC         0xa1b23c4d
+#define PCAP_NSEC_SWAPPED_MAGIC 0x4d3cb2a1
+
+static int replayMapSource(struct replay_source*, const char* );
+static int replayPeek(struct replay_source* );
+static uint32_t replayField(struct replay_source*, uint32_t );
+
+/*-----------------------------------------------------------------------------
+ * Method: int replayOpen(struct sr_instance* sr, const char* config,
+ *                          const char* outfile)
+ *
+ * reads the interface config, one interface per line:
+ *
+ *      <name> <hwaddr> <ip> <pcap file> [<speed>]
+ *
+ * adds each interface to the router, maps its pcap and opens the output pcap.
+ * returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int replayOpen(struct sr_instance* sr, const char* config, const char* outfile)
+{
+    FILE* fp;
+    char line[BUFSIZ];
+    char name[sr_IFACE_NAMELEN], hwaddr[32], ip[32], pcap[BUFSIZ];
+    unsigned int speed;
+    unsigned char mac[ETHER_ADDR_LEN];
+    struct in_addr ipaddr;
+    struct sr_replay* replay;
+
+    replay = calloc(1, sizeof(struct sr_replay));
+    if (replay == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for replay state\n");
+        return -1;
+    }
+    sr->replay = replay;
+
+    if ((fp = fopen(config, "r")) == NULL) {
+        perror("replay config");
+        return -1;
+    }
+
+    while (fgets(line, BUFSIZ, fp) != 0) {
+        speed = 0;
+        if (line[0] == '#' || sscanf(line, "%31s %31s %31s %s %u", name, hwaddr, ip, pcap, &speed) < 4)
+            continue;
+
+        if (replay->nsources == REPLAY_MAX_IFACES) {
+            fprintf(stderr, "Error: replay supports at most %d interfaces\n", REPLAY_MAX_IFACES);
+            fclose(fp);
+            return -1;
+        }
+
+        if (sscanf(hwaddr, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+                    &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 6) {
+            fprintf(stderr, "Error: replay config, cannot convert %s to hwaddr\n", hwaddr);
+            fclose(fp);
+            return -1;
+        }
+        if (inet_aton(ip, &ipaddr) == 0) {
+            fprintf(stderr, "Error: replay config, cannot convert %s to valid IP\n", ip);
+            fclose(fp);
+            return -1;
+        }
+
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, ipaddr.s_addr);
+        sr_set_ether_speed(sr, speed);
+
+        strncpy(replay->sources[replay->nsources].iface, name, sr_IFACE_NAMELEN);
+        if (replayMapSource(&replay->sources[replay->nsources], pcap) != 0) {
+            fclose(fp);
+            return -1;
+        }
+        replay->nsources++;
+    }
+    fclose(fp);
+
+    if (replay->nsources == 0) {
+        fprintf(stderr, "Error: replay config %s defines no interfaces\n", config);
+        return -1;
+    }
+
+    if (outfile) {
+        replay->out = sr_dump_open(outfile, 0, IP_MAXPACKET);
+        if (replay->out == NULL)
+            return -1;
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int replayRun(struct sr_instance* sr)
+ *
+ * feeds every frame of every source pcap to sr_handlepacket in timestamp
+ * order, then prints how fast we went. returns the number of frames replayed
+ *---------------------------------------------------------------------------*/
+int replayRun(struct sr_instance* sr)
+{
+    struct sr_replay* replay = sr->replay;
+    static uint8_t packet[IP_MAXPACKET];
+    struct replay_source* src;
+    struct timespec start, end;
+    uint32_t caplen;
+    uint64_t readStart;
+    double elapsed;
+    int i;
+
+    vclockEnable();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (;;) {
+        readStart = LatencyStart();
+
+        /* pick the source whose next frame is oldest */
+        src = NULL;
+        for (i = 0; i < replay->nsources; i++) {
+            if (!replayPeek(&replay->sources[i]))
+                continue;
+            if (src == NULL || timercmp(&replay->sources[i].ts, &src->ts, <))
+                src = &replay->sources[i];
+        }
+        if (src == NULL)
+            break;
+
+        caplen = replayField(src, ((struct pcap_sf_pkthdr*)(src->map + src->off))->caplen);
+        src->off += sizeof(struct pcap_sf_pkthdr);
+
+        /* large snaplen and GRO/TSO captures can hold more than one ip
+         * packet's worth, which would not fit the copy */
+        if (caplen > sizeof(packet)) {
+            src->off += caplen;
+            replay->oversized++;
+            LatencyEnd(LATENCY_READ, readStart);
+            continue;
+        }
+
+        /* the router rewrites frames in place, so hand it a copy */
+        memcpy(packet, src->map + src->off, caplen);
+        src->off += caplen;
+        LatencyEnd(LATENCY_READ, readStart);
+
+        if (caplen < sizeof(struct sr_ethernet_hdr))
+            continue;
+
+        vclockSet(&src->ts);
+        replay->rxPackets++;
+        captureFrame(sr, packet, caplen, src->iface, CAPTURE_IN);
+        if (sr->pipeline)
+            pipelineEnqueue(sr, packet, caplen, src->iface, 1);
+        else
+            sr_handlepacket(sr, packet, caplen, src->iface);
+    }
+
+    /* count the time it takes the workers to finish, too */
+    pipelineStop(sr);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "replay: %lu packets in, %lu packets out, %.6f s\n",
+            replay->rxPackets, replay->txPackets, elapsed);
+    if (replay->oversized > 0)
+        fprintf(stderr, "replay: skipped %lu records longer than %u bytes\n",
+                replay->oversized, (unsigned int)sizeof(packet));
+    if (replay->rxPackets > 0 && elapsed > 0)
+        fprintf(stderr, "replay: %.0f pps, %.1f ns/packet\n",
+                replay->rxPackets / elapsed, elapsed * 1e9 / replay->rxPackets);
+
+    return replay->rxPackets;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void replayClose(struct sr_instance* sr)
+ *
+ * unmaps the source pcaps and closes the output pcap
+ *---------------------------------------------------------------------------*/
+void replayClose(struct sr_instance* sr)
+{
+    struct sr_replay* replay = sr->replay;
+    int i;
+
+    if (replay == NULL)
+        return;
+
+    for (i = 0; i < replay->nsources; i++) {
+        if (replay->sources[i].map)
+            munmap(replay->sources[i].map, replay->sources[i].size);
+    }
+    if (replay->out)
+        sr_dump_close(replay->out);
+
+    free(replay);
+    sr->replay = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int replaySendPacket(struct sr_instance* sr, uint8_t* buf,
+ *                                  unsigned int len, const char* iface)
+ *
+ * stands in for the VNS socket when replaying, the frame goes to the output
+ * pcap stamped with the virtual clock
+ *---------------------------------------------------------------------------*/
+int replaySendPacket(struct sr_instance* sr, uint8_t* buf, unsigned int len, const char* iface)
+{
+    struct sr_replay* replay = sr->replay;
+    struct pcap_pkthdr h;
+
+    __atomic_add_fetch(&replay->txPackets, 1, __ATOMIC_RELAXED);
+
+    if (replay->out == NULL)
+        return 0;
+
+    vclockGetTime(&h.ts);
+    h.caplen = len;
+    h.len = len;
+
+    /* workers may be sending at the same time */
+    flockfile(replay->out);
+    sr_dump(replay->out, &h, buf);
+    funlockfile(replay->out);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int replayMapSource(struct replay_source* src, const char* fn)
+ *
+ * maps a pcap file and checks its header
+ *---------------------------------------------------------------------------*/
+static int replayMapSource(struct replay_source* src, const char* fn)
+{
+    struct pcap_file_header* hdr;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(fn, O_RDONLY)) < 0) {
+        perror(fn);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct pcap_file_header)) {
+        fprintf(stderr, "Error: %s is not a pcap file\n", fn);
+        close(fd);
+        return -1;
+    }
+
+    src->size = st.st_size;
+    src->map = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (src->map == MAP_FAILED) {
+        perror("mmap");
+        src->map = NULL;
+        return -1;
+    }
+    madvise(src->map, src->size, MADV_SEQUENTIAL);
+
+    hdr = (struct pcap_file_header*)src->map;
+    switch (hdr->magic) {
+        case TCPDUMP_MAGIC:             break;
+        case PCAP_SWAPPED_MAGIC:        src->swapped = 1; break;
+        case PCAP_NSEC_MAGIC:           src->nsec = 1; break;
+        case PCAP_NSEC_SWAPPED_MAGIC:   src->swapped = 1; src->nsec = 1; break;
+        default:
+            fprintf(stderr, "Error: %s is not a pcap file\n", fn);
+            goto fail;
+    }
+    if (replayField(src, hdr->linktype) != LINKTYPE_ETHERNET) {
+        fprintf(stderr, "Error: %s is not an ethernet capture\n", fn);
+        goto fail;
+    }
+
+    src->off = sizeof(struct pcap_file_header);
+
+    return 0;
+
+fail:
+    munmap(src->map, src->size);
+    src->map = NULL;
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int replayPeek(struct replay_source* src)
+ *
+ * loads the timestamp of the next record, returns 0 once the source is
+ * exhausted or truncated
+ *---------------------------------------------------------------------------*/
+static int replayPeek(struct replay_source* src)
+{
+    struct pcap_sf_pkthdr* rec;
+
+    if (src->off + sizeof(struct pcap_sf_pkthdr) > src->size)
+        return 0;
+
+    rec = (struct pcap_sf_pkthdr*)(src->map + src->off);
+    if (src->off + sizeof(struct pcap_sf_pkthdr) + replayField(src, rec->caplen) > src->size)
+        return 0;
+
+    src->ts.tv_sec = replayField(src, rec->ts.tv_sec);
+    src->ts.tv_usec = replayField(src, rec->ts.tv_usec);
+    if (src->nsec)
+        src->ts.tv_usec /= 1000;
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint32_t replayField(struct replay_source* src, uint32_t v)
+ *
+ * returns a pcap header field in host byte order
+ *---------------------------------------------------------------------------*/
+static uint32_t replayField(struct replay_source* src, uint32_t v)
+{
+    if (src->swapped)
+        return __builtin_bswap32(v);
+
+    return v;
+}
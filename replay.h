@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * file: replay.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for offline replay. instead of talking to the VNS server
+ * the router reads interface definitions from a config file and feeds the
+ * frames from one pcap per interface straight into sr_handlepacket
+ ******************************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+#include "sr_if.h"
+
+#define REPLAY_MAX_IFACES 16
+
+struct replay_source {
+    char            iface[sr_IFACE_NAMELEN];    // interface frames arrive on
+    uint8_t*        map;                        // mmap'd pcap file
+    size_t          size;                       // size of the mapping
+    size_t          off;                        // offset of the next record
+    int             swapped;                    // file written on other endian
+    int             nsec;                       // timestamps are nanoseconds
+    struct timeval  ts;                         // timestamp of the next record
+};
+
+struct sr_replay {
+    struct replay_source    sources[REPLAY_MAX_IFACES];
+    int                     nsources;
+    FILE*                   out;                // pcap of transmitted frames
+    unsigned long           rxPackets;
+    unsigned long           txPackets;
+    unsigned long           oversized;          // records skipped, too big to copy
+};
+
+int replayOpen(struct sr_instance*, const char*, const char* );
+int replayRun(struct sr_instance* );
+void replayClose(struct sr_instance* );
+int replaySendPacket(struct sr_instance*, uint8_t*, unsigned int, const char* );
+
+#endif
@@ -0,0 +1,144 @@
+/*******************************************************************************
+ * file: ring.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements a bounded lock-free ring (Vyukov's array queue). each slot
+ * carries a sequence number that tells a producer whether the slot is free
+ * and a consumer whether it holds data, so the only shared writes are one
+ * compare-and-swap on head or tail per operation
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+#define SLOT_SEQ(r, pos)    ((size_t*)((r)->slots + ((pos) & (r)->mask) * (r)->stride))
+#define SLOT_DATA(r, pos)   ((uint8_t*)SLOT_SEQ(r, pos) + sizeof(size_t))
+
+/*-----------------------------------------------------------------------------
+ * Method: int ringInit(struct sr_ring* ring, size_t nslots, size_t elemsize)
+ *
+ * sets up a ring of nslots elements of elemsize bytes. nslots must be a power
+ * of two. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int ringInit(struct sr_ring* ring, size_t nslots, size_t elemsize)
+{
+    size_t i;
+
+    if (nslots < 2 || (nslots & (nslots - 1)) != 0) {
+        fprintf(stderr, "Error: ring size %lu is not a power of two\n", (unsigned long)nslots);
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(struct sr_ring));
+    ring->mask = nslots - 1;
+    ring->elemsize = elemsize;
+    ring->stride = (sizeof(size_t) + elemsize + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+
+    ring->slots = malloc(nslots * ring->stride);
+    if (ring->slots == NULL) {
+        fprintf(stderr, "Error: malloc could not find memory for ring\n");
+        return -1;
+    }
+
+    for (i = 0; i < nslots; i++)
+        *SLOT_SEQ(ring, i) = i;
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void ringDestroy(struct sr_ring* ring)
+ *
+ * frees the ring's slots, anything still queued is lost
+ *---------------------------------------------------------------------------*/
+void ringDestroy(struct sr_ring* ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int ringPush(struct sr_ring* ring, const void* elem)
+ *
+ * copies elem into the ring. returns 0 on success, -1 if the ring is full
+ *---------------------------------------------------------------------------*/
+int ringPush(struct sr_ring* ring, const void* elem)
+{
+    size_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    size_t seq;
+    intptr_t diff;
+
+    for (;;) {
+        seq = __atomic_load_n(SLOT_SEQ(ring, pos), __ATOMIC_ACQUIRE);
+        diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            /* slot is free, try to claim it */
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            return -1;                          // full
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(SLOT_DATA(ring, pos), elem, ring->elemsize);
+    __atomic_store_n(SLOT_SEQ(ring, pos), pos + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int ringPop(struct sr_ring* ring, void* elem)
+ *
+ * copies the oldest element out of the ring. returns 0 on success, -1 if the
+ * ring is empty
+ *---------------------------------------------------------------------------*/
+int ringPop(struct sr_ring* ring, void* elem)
+{
+    size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    size_t seq;
+    intptr_t diff;
+
+    for (;;) {
+        seq = __atomic_load_n(SLOT_SEQ(ring, pos), __ATOMIC_ACQUIRE);
+        diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            /* slot holds data, try to claim it */
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            return -1;                          // empty
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(elem, SLOT_DATA(ring, pos), ring->elemsize);
+    __atomic_store_n(SLOT_SEQ(ring, pos), pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: size_t ringCount(struct sr_ring* ring)
+ *
+ * approximate number of queued elements, only exact when the ring is quiet
+ *---------------------------------------------------------------------------*/
+size_t ringCount(struct sr_ring* ring)
+{
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    return (head >= tail) ? head - tail : 0;
+}
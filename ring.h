@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * file: ring.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for a bounded lock-free ring. any number of threads may
+ * push and pop, so the same ring serves as an SPSC or MPSC queue. elements
+ * are fixed size and copied in and out of the ring
+ ******************************************************************************/
+
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_CACHE_LINE 64
+
+struct sr_ring {
+    uint8_t*    slots;                          // nslots * stride bytes
+    size_t      mask;                           // nslots - 1
+    size_t      elemsize;                       // bytes per element
+    size_t      stride;                         // bytes per slot, incl. sequence
+    char        pad0[RING_CACHE_LINE];
+    size_t      head;                           // next slot to push
+    char        pad1[RING_CACHE_LINE];
+    size_t      tail;                           // next slot to pop
+    char        pad2[RING_CACHE_LINE];
+};
+
+int ringInit(struct sr_ring*, size_t, size_t );
+void ringDestroy(struct sr_ring* );
+int ringPush(struct sr_ring*, const void* );
+int ringPop(struct sr_ring*, void* );
+size_t ringCount(struct sr_ring* );
+
+#endif
@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * file: rtcompile.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * compiles an rtable text file into a fib snapshot that sr -F maps at
+ * startup, so big tables are parsed and built once instead of on every
+ * restart. the snapshot is the in-memory image itself, it only loads on
+ * machines with the same byte order. with -s the table is published as a
+ * new generation of a shared fib instead, for sr -S to attach to
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_rt.h"
+#include "fib.h"
+
+static double elapsedMs(struct timespec* );
+
+int main(int argc, char** argv)
+{
+    struct sr_rt* table;
+    struct fib* fib;
+    struct timespec start;
+    const char* shared = NULL;
+    const char* input;
+    const char* output = NULL;
+
+    if (argc == 4 && strcmp(argv[1], "-s") == 0) {
+        shared = argv[2];
+        input = argv[3];
+    } else if (argc == 3 && argv[1][0] != '-') {
+        input = argv[1];
+        output = argv[2];
+    } else {
+        fprintf(stderr, "usage: %s <rtable> <snapshot>\n", argv[0]);
+        fprintf(stderr, "       %s -s <shared name> <rtable>\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (sr_read_rt(input, &table) != 0)
+        return 1;
+
+    if ((fib = fibBuild(table)) == NULL)
+        return 1;
+    printf("Compiled %u prefixes, %u next hop groups, %u next hops, %u masks in %.1f ms\n",
+            fib->hdr->nprefixes, fib->hdr->ngroups, fib->hdr->nnexthops, fib->hdr->nlevels,
+            elapsedMs(&start));
+
+    if (shared) {
+        if (fibShmPublish(fib, shared) != 0)
+            return 1;
+        printf("Published %lu bytes as generation %llu of %s\n",
+                (unsigned long)fib->hdr->size, (unsigned long long)fibShmGeneration(shared), shared);
+        fibRelease(fib);
+        sr_free_rt(table);
+        return 0;
+    }
+
+    if (fibSave(fib, output) != 0)
+        return 1;
+    printf("Wrote %lu bytes to %s\n", (unsigned long)fib->hdr->size, output);
+
+    fibRelease(fib);
+    sr_free_rt(table);
+
+    /* make sure what we wrote is what sr will accept */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((fib = fibMap(output)) == NULL)
+        return 1;
+    printf("Mapped it back in %.3f ms\n", elapsedMs(&start));
+    fibRelease(fib);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static double elapsedMs(struct timespec* start)
+ *
+ * returns the milliseconds since start
+ *---------------------------------------------------------------------------*/
+static double elapsedMs(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
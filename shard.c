@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * file: shard.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements per-thread forwarding shards. the caches are direct mapped and
+ * owned by a single thread, so lookups take no locks. a miss falls through
+ * to the shared routing table and arp cache
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sr_router.h"
+#include "arp.h"
+#include "flow.h"
+#include "fib.h"
+#include "shard.h"
+
+static unsigned long arpGeneration = 1;     // bumped on every arp change
+static __thread struct sr_shard* currentShard = NULL;
+
+static void shardSync(struct sr_shard* );
+
+/*-----------------------------------------------------------------------------
+ * Method: struct sr_shard* shardAttach(int id)
+ *
+ * gives the calling thread a fresh shard
+ *---------------------------------------------------------------------------*/
+struct sr_shard* shardAttach(int id)
+{
+    struct sr_shard* shard = calloc(1, sizeof(struct sr_shard));
+
+    if (shard == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for shard\n");
+        exit(1);
+    }
+    shard->id = id;
+    currentShard = shard;
+
+    return shard;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: struct sr_shard* shardCurrent()
+ *
+ * returns the calling thread's shard, threads that never attached get one
+ * the first time they forward
+ *---------------------------------------------------------------------------*/
+struct sr_shard* shardCurrent()
+{
+    if (currentShard == NULL)
+        return shardAttach(-1);
+
+    return currentShard;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void shardDetach()
+ *
+ * frees the calling thread's shard
+ *---------------------------------------------------------------------------*/
+void shardDetach()
+{
+    free(currentShard);
+    currentShard = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void shardPublishArp()
+ *
+ * tells every shard an arp entry was added, changed or expired
+ *---------------------------------------------------------------------------*/
+void shardPublishArp()
+{
+    __atomic_add_fetch(&arpGeneration, 1, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: const struct fib_nexthop* shardLookupRoute(uint32_t dst,
+ *                                                      uint32_t hash)
+ *
+ * returns the nexthop for dst, from the shard's cache if we can. hash is
+ * the packet's flow hash, it picks the path when there are several.
+ * returns 0 if there is no route
+ *---------------------------------------------------------------------------*/
+const struct fib_nexthop* shardLookupRoute(uint32_t dst, uint32_t hash)
+{
+    struct sr_shard* shard = shardCurrent();
+    struct shard_route_entry* entry;
+
+    shardSync(shard);
+    shard->packets++;
+
+    entry = &shard->routes[flowMix(dst) & (SHARD_ROUTE_CACHE_SIZE - 1)];
+    if (entry->prefix && entry->dst == dst) {
+        shard->routeHits++;
+        return fibSelect(shard->fib, entry->prefix, hash);
+    }
+
+    shard->routeMisses++;
+    entry->dst = dst;
+    entry->prefix = fibLookup(shard->fib, dst);
+    if (entry->prefix == NULL)
+        return 0;
+
+    return fibSelect(shard->fib, entry->prefix, hash);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: int shardLookupAdjacency(uint32_t ip, uint8_t* mac)
+ *
+ * copies the hardware address of next hop ip into mac. returns 1 if we have
+ * one, 0 if the next hop still needs to be arp'd
+ *---------------------------------------------------------------------------*/
+int shardLookupAdjacency(uint32_t ip, uint8_t* mac)
+{
+    struct sr_shard* shard = shardCurrent();
+    struct shard_adj_entry* entry;
+
+    shardSync(shard);
+
+    entry = &shard->adjs[flowMix(ip) & (SHARD_ADJ_CACHE_SIZE - 1)];
+    if (entry->valid && entry->ip == ip) {
+        shard->adjHits++;
+        memcpy(mac, entry->mac, ETHER_ADDR_LEN);
+        return 1;
+    }
+
+    /* misses are not cached, the arp reply will bump the generation anyway */
+    shard->adjMisses++;
+    if (arpSearchCache(ip, mac) < 0)
+        return 0;
+
+    entry->ip = ip;
+    memcpy(entry->mac, mac, ETHER_ADDR_LEN);
+    entry->valid = 1;
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void shardDump(struct sr_shard* shard)
+ *
+ * prints the shard's counters to stdout
+ *---------------------------------------------------------------------------*/
+void shardDump(struct sr_shard* shard)
+{
+    printf("Shard %d: %lu packets, route cache %lu hits %lu misses, "
+            "adjacency cache %lu hits %lu misses\n",
+            shard->id, shard->packets, shard->routeHits, shard->routeMisses,
+            shard->adjHits, shard->adjMisses);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void shardSync(struct sr_shard* shard)
+ *
+ * flushes whichever of the shard's caches is older than the shared tables
+ *---------------------------------------------------------------------------*/
+static void shardSync(struct sr_shard* shard)
+{
+    struct fib* fib = fibCurrent();
+    unsigned long gen;
+
+    /* every published fib has a new generation, and the old one is not
+     * freed until this read section is over */
+    gen = fib ? fib->generation : 0;
+    if (gen != shard->routeGen) {
+        memset(shard->routes, 0, sizeof(shard->routes));
+        shard->routeGen = gen;
+    }
+    shard->fib = fib;
+
+    gen = __atomic_load_n(&arpGeneration, __ATOMIC_ACQUIRE);
+    if (gen != shard->arpGen) {
+        memset(shard->adjs, 0, sizeof(shard->adjs));
+        shard->arpGen = gen;
+    }
+}
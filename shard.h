@@ -0,0 +1,61 @@
+/*******************************************************************************
+ * file: shard.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for per-thread forwarding shards. every thread that
+ * forwards packets keeps its own route and adjacency caches plus counters,
+ * so a hit never touches memory another core is writing. the shared tables
+ * carry a generation number, the fib's own and one bumped on every arp
+ * change, and a shard flushes a cache as soon as its generation is stale.
+ * cached groups point into the fib, so lookups must happen inside an rcu
+ * read section
+ ******************************************************************************/
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+
+#include "sr_protocol.h"
+#include "fib.h"
+
+#define SHARD_ROUTE_CACHE_SIZE 256          // must be a power of two
+#define SHARD_ADJ_CACHE_SIZE 64             // must be a power of two
+
+struct shard_route_entry {
+    uint32_t                    dst;        // destination ip, network order
+    const struct fib_prefix*    prefix;     // what it matched, 0 if empty
+};
+
+struct shard_adj_entry {
+    uint32_t        ip;                     // next hop ip, network order
+    uint8_t         mac[ETHER_ADDR_LEN];    // its hardware address
+    int             valid;
+};
+
+struct sr_shard {
+    int                         id;
+    const struct fib*           fib;        // the fib the cache points into
+    unsigned long               routeGen;   // fib generation of the cache
+    unsigned long               arpGen;     // arp generation of the cache
+    struct shard_route_entry    routes[SHARD_ROUTE_CACHE_SIZE];
+    struct shard_adj_entry      adjs[SHARD_ADJ_CACHE_SIZE];
+
+    unsigned long               packets;
+    unsigned long               routeHits;
+    unsigned long               routeMisses;
+    unsigned long               adjHits;
+    unsigned long               adjMisses;
+};
+
+struct sr_shard* shardAttach(int );
+struct sr_shard* shardCurrent();
+void shardDetach();
+void shardPublishArp();
+const struct fib_nexthop* shardLookupRoute(uint32_t, uint32_t );
+int shardLookupAdjacency(uint32_t, uint8_t* );
+void shardDump(struct sr_shard* );
+
+#endif
@@ -24,6 +24,7 @@
 #include <unistd.h>
 #include <pwd.h>
 #include <sys/types.h>
+#include <time.h>
 
 #ifdef _LINUX_
 #include <getopt.h>
@@ -32,6 +33,19 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_if.h"
+#include "replay.h"
+#include "pipeline.h"
+#include "reload.h"
+#include "probe.h"
+#include "dispatch.h"
+#include "capture.h"
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
+#include "counter.h"
+#include "stats.h"
+#include "fib.h"
 
 extern char* optarg;
 
@@ -44,6 +58,7 @@ extern char* optarg;
 #define DEFAULT_HOST "vrhost"
 #define DEFAULT_SERVER "171.67.71.18"
 #define DEFAULT_RTABLE "rtable"
+#define RTABLE_PRINT_MAX 64
 #define DEFAULT_TOPO 0
 
 static void usage(char* );
@@ -51,6 +66,7 @@ static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
+static void sr_load_fib_wrap(char* name, int source);
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -66,12 +82,26 @@ int main(int argc, char **argv)
     char *template = NULL;
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
+    int workers = 0;
+    int weighted = 0;
+    int probe_interval = PROBE_INTERVAL_MS;
+    int probe_multiplier = PROBE_MULTIPLIER;
+    int ret;
     char *logfile = 0;
+    char *tracefile = 0;
+    int histograms = 0;
+    char *counters = 0;
+    char *stats = 0;
+    struct capture_config capture = { CAPTURE_PCAP };
+    char *replay = 0;
+    char *replay_out = 0;
+    char *snapshot = 0;
+    char *shared = 0;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "ha:s:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "ha:s:v:p:u:t:r:l:c:f:L:X:HM:G:T:R:o:w:F:S:WP:")) != EOF)
     {
         switch (c)
         {
@@ -100,22 +130,91 @@ int main(int argc, char **argv)
             case 'l':
                 logfile = optarg;
                 break;
+            case 'c':
+                if(captureConfigure(&capture, optarg) != 0)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                if(captureAddFilter(&capture, optarg) != 0)
+                { exit(1); }
+                break;
+            case 'L':
+                if(logConfigure(optarg) != 0)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'X':
+                tracefile = optarg;
+                break;
+            case 'H':
+                histograms = 1;
+                break;
+            case 'M':
+                counters = optarg;
+                break;
+            case 'G':
+                stats = optarg;
+                break;
             case 'r':
                 rtable = optarg;
                 break;
             case 'T':
                 template = optarg;
                 break;
+            case 'R':
+                replay = optarg;
+                break;
+            case 'o':
+                replay_out = optarg;
+                break;
+            case 'w':
+                workers = atoi((char *) optarg);
+                break;
+            case 'F':
+                snapshot = optarg;
+                break;
+            case 'S':
+                shared = optarg;
+                break;
+            case 'W':
+                weighted = 1;
+                break;
+            case 'P':
+                if(sscanf(optarg, "%d:%d", &probe_interval, &probe_multiplier) < 1)
+                {
+                    fprintf(stderr,"Bad probe setting %s, want interval_ms[:multiplier]\n", optarg);
+                    exit(1);
+                }
+                break;
         } /* switch */
     } /* -- while -- */
 
+    /* -- messages from here on are written by the log thread -- */
+    if(logStart() != 0)
+    { exit(1); }
+
+    /* -- time each stage of the packet path, kill -USR1 prints it -- */
+    if(histograms && latencyStart() != 0)
+    { exit(1); }
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.ecmp_weighted = weighted;
 
-    /* -- set up routing table from file -- */
+    /* -- set up routing table from file, or map the compiled table -- */
     if(template == NULL) {
         sr.template[0] = '\0';
-        sr_load_rt_wrap(&sr, rtable);
+        if(shared != 0)
+        { sr_load_fib_wrap(shared, RELOAD_SHARED); }
+        else if(snapshot != 0)
+        { sr_load_fib_wrap(snapshot, RELOAD_SNAPSHOT); }
+        else
+        { sr_load_rt_wrap(&sr, rtable); }
     }
     else
         strncpy(sr.template, template, 30);
@@ -132,8 +231,8 @@ int main(int argc, char **argv)
     /* -- set up file pointer for logging of raw packets -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        /* -- offline replay logs every frame, live traffic may drop -- */
+        if(captureStart(&sr, logfile, &capture, replay != 0) != 0)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -141,6 +240,42 @@ int main(int argc, char **argv)
         }
     }
 
+    /* replay pcaps offline instead of connecting to the server */
+    if(replay != 0)
+    {
+        if(template != NULL)
+        {
+            fprintf(stderr,"Replay needs a routing table, not a template\n");
+            exit(1);
+        }
+        if(replayOpen(&sr, replay, replay_out) != 0)
+        {
+            fprintf(stderr,"Error setting up replay from %s\n", replay);
+            exit(1);
+        }
+        if(sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with hardware\n");
+            exit(1);
+        }
+
+        if(tracefile != 0 && traceStart(&sr, tracefile) != 0)
+        { exit(1); }
+        if(counters != 0 && counterServe(&sr, counters) != 0)
+        { exit(1); }
+        if(stats != 0 && statsStart(&sr, stats) != 0)
+        { exit(1); }
+
+        sr_init(&sr);
+        if(workers > 0 && pipelineStart(&sr, workers) != 0)
+        { exit(1); }
+        replayRun(&sr);
+
+        replayClose(&sr);
+        sr_destroy_instance(&sr);
+        return 0;
+    }
+
     Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
     if(template)
         Debug("Requesting topology template %s\n", template);
@@ -157,14 +292,51 @@ int main(int argc, char **argv)
     if(template != NULL) { /* we've recv'd the rtable now, so read it in */
         Debug("Connected to new instantiation of topology template %s\n", template);
         sr_load_rt_wrap(&sr, "rtable.vrhost");
+        rtable = "rtable.vrhost";
     }
 
+    /* -- the interfaces are known now, so tracing can number them -- */
+    if(tracefile != 0 && traceStart(&sr, tracefile) != 0)
+    { return 1; }
+
+    /* -- and the counters can name them -- */
+    if(counters != 0 && counterServe(&sr, counters) != 0)
+    { return 1; }
+
+    /* -- and publish them for srstat -- */
+    if(stats != 0 && statsStart(&sr, stats) != 0)
+    { return 1; }
+
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
 
+    /* -- hand packets to worker threads, this thread keeps reading -- */
+    if(workers > 0 && pipelineStart(&sr, workers) != 0)
+    { return 1; }
+
+    /* -- SIGHUP or editing the rtable swaps in the new routes -- */
+    if(shared != 0)
+    { ret = reloadStart(&sr, shared, RELOAD_SHARED); }
+    else if(snapshot != 0)
+    { ret = reloadStart(&sr, snapshot, RELOAD_SNAPSHOT); }
+    else
+    { ret = reloadStart(&sr, rtable, RELOAD_RTABLE); }
+    if(ret != 0)
+    { return 1; }
+
+    /* -- watch the gateways, -P 0 turns it off -- */
+    if(probe_interval > 0 && probeStart(&sr, probe_interval, probe_multiplier) != 0)
+    { return 1; }
+
     /* -- whizbang main loop ;-) */
     while( sr_read_from_server(&sr) == 1);
 
+    /* -- nothing may send through the pipeline once it is stopped -- */
+    probeStop();
+    reloadStop();
+
+    pipelineStop(&sr);
+
     sr_destroy_instance(&sr);
 
     return 0;
@@ -180,8 +352,18 @@ static void usage(char* argv0)
     printf("Simple Router Client\n");
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] [-a auth_key_filename]\n");
-    printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-t topo id] [-r routing table] [-F compiled routing table]\n");
+    printf("           [-S shared routing table name] \n");
+    printf("           [-l log file] [-c format=pcap|pcapng,compress=lz4,size=MB,time=s,files=n,prealloc]\n");
+    printf("           [-f \"[snaplen n] [sample n] filter expression|@tcpdump -ddd file\"]\n");
+    printf("           [-L level=off|error|warn|info|debug,<subsystem>=<level>,rate=n]\n");
+    printf("              subsystems packet arp ip icmp forward neighbor\n");
+    printf("           [-X event trace file, see srtrace] [-H latency histograms]\n");
+    printf("           [-M counter unix socket, Prometheus text format]\n");
+    printf("           [-G statistics shm name[:interval_ms], see srstat]\n");
+    printf("           [-R replay interface config] [-o replay output pcap]\n");
+    printf("           [-w worker threads] [-W weigh multipath by link speed]\n");
+    printf("           [-P gateway probe interval_ms[:multiplier], 0 for none]\n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -223,10 +405,19 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
-    {
-        sr_dump_close(sr->logfile);
-    }
+    captureStop(sr);
+
+    counterStop();
+
+    statsStop();
+
+    logStop();
+
+    traceStop();
+
+    latencyDump();
+
+    dispatchDump();
 
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
@@ -251,7 +442,10 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->topo_id = 0;
     sr->if_list = 0;
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->capture = 0;
+    sr->replay = 0;
+    sr->pipeline = 0;
+    sr->ecmp_weighted = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -278,7 +472,28 @@ int sr_verify_routing_table(struct sr_instance* sr)
     /* -- REQUIRES --*/
     assert(sr);
 
-    if( (sr->if_list == 0) || (sr->routing_table == 0))
+    if( sr->if_list == 0 )
+    {
+        return 999; /* doh! */
+    }
+
+    /* -- once compiled, check the fib's next hops: they are what the
+     * router uses, and the list is freed by every reload -- */
+    if( fibCurrent() != 0 )
+    {
+        const struct fib_hdr* hdr = fibCurrent()->hdr;
+        const struct fib_nexthop* nexthops = fibNexthops(hdr);
+        uint32_t i;
+
+        for(i = 0; i < hdr->nnexthops; i++)
+        {
+            if(sr_get_interface(sr, nexthops[i].interface) == 0)
+            { ret++; } /* -- interface not found! -- */
+        }
+        return ret;
+    }
+
+    if( sr->routing_table == 0 )
     {
         return 999; /* doh! */
     }
@@ -306,6 +521,9 @@ int sr_verify_routing_table(struct sr_instance* sr)
 } /* -- sr_verify_routing_table -- */
 
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
+    struct sr_rt* rt_walker;
+    int n;
+
     if(sr_load_rt(sr, rtable) != 0) {
         fprintf(stderr,"Error setting up routing table from file %s\n",
                 rtable);
@@ -313,8 +531,34 @@ static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
     }
 
 
+    /* -- full tables are far too big to print -- */
+    for(n = 0, rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
+    { n++; }
+    if(n > RTABLE_PRINT_MAX)
+    { return; }
+
     printf("Loading routing table\n");
     printf("---------------------------------------------\n");
     sr_print_routing_table(sr);
     printf("---------------------------------------------\n");
 }
+
+static void sr_load_fib_wrap(char* name, int source) {
+    struct timespec start, stop;
+    struct fib* fib;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(source == RELOAD_SHARED)
+    { fib = fibShmAttach(name); }
+    else
+    { fib = fibMap(name); }
+    if(fib == 0) {
+        fprintf(stderr,"Error setting up routing table from %s\n", name);
+        exit(1);
+    }
+    fibPublish(fib);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    printf("Mapped %u routes from %s in %.3f ms\n", fib->hdr->nprefixes, name,
+            (stop.tv_sec - start.tv_sec) * 1e3 + (stop.tv_nsec - start.tv_nsec) / 1e6);
+}
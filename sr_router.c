@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "sr_if.h"
@@ -22,9 +23,22 @@
 #include "sr_protocol.h"
 #include "ethernet.h"
 #include "ip.h"
+#include "icmp.h"
 #include "arp.h"
 #include "forward.h"
 #include "checksum.h"
+#include "fib.h"
+#include "rcu.h"
+#include "parse.h"
+#include "dispatch.h"
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
+#include "counter.h"
+
+static void inputArp(struct sr_instance*, struct packet_desc*, char* );
+static void inputIp(struct sr_instance*, struct packet_desc*, char* );
+static void countReceived(const struct sr_if*, unsigned int );
 
 /*--------------------------------------------------------------------- 
  * Method: sr_init(void)
@@ -36,6 +50,8 @@
 
 void sr_init(struct sr_instance* sr) 
 {
+    struct fib* fib;
+
     /* REQUIRES */
     assert(sr);
 
@@ -45,6 +61,26 @@ void sr_init(struct sr_instance* sr)
     arpInitCache();
     initPacketCache();
 
+    /* the core protocols, anything else plugs in the same way */
+    dispatchRegister(DISPATCH_ETHER, ETHERTYPE_ARP, "arp", inputArp);
+    dispatchRegister(DISPATCH_ETHER, ETHERTYPE_IP, "ip", inputIp);
+    dispatchRegister(DISPATCH_IP, IPPROTO_ICMP, "icmp", handleIcmp);
+    dispatchRegister(DISPATCH_IP, IPPROTO_TCP, "tcp", ipPortUnreachable);
+    dispatchRegister(DISPATCH_IP, IPPROTO_UDP, "udp", ipPortUnreachable);
+
+    /* compile the routing table for the forwarding path, unless we
+     * started from a snapshot that is already compiled */
+    if (fibCurrent() == NULL) {
+        if ((fib = fibBuild(sr->routing_table)) == NULL) {
+            fprintf(stderr, "Error: could not compile the routing table\n");
+            exit(1);
+        }
+        fibPublish(fib);
+    }
+
+    /* speeds are known by now, unless hwinfo is still to come */
+    forwardWeighNexthops(sr, fibCurrent());
+
 } /* -- sr_init -- */
 
 
@@ -75,72 +111,181 @@ void sr_handlepacket(struct sr_instance* sr,
     assert(packet);
     assert(interface);
 
-    printf("*** -> Received packet of length %d \n",len);
+    uint64_t start = LatencyStart();
 
-    struct sr_ethernet_hdr * ethernetHdr = (struct sr_ethernet_hdr *)packet;
+    /* looked up once, for the counters and the tracepoints */
+    struct sr_if* rx = sr_get_interface(sr, interface);
+
+    LogDebug(LOG_PACKET, "*** -> Received packet of length %d", len);
+    Trace(TRACE_RECEIVE, rx, len, 0, 0);
+    countReceived(rx, len);
+
+    /* every header is found, and checked against len, once */
+    struct packet_desc desc;
+    if (parsePacket(&desc, packet, len) != 0) {
+        LogInfo(LOG_PACKET, "*** -> Dropping packet: %s", desc.error);
+        Trace(TRACE_DROP, rx, len, 0, TRACE_DROP_PARSE);
+        CounterInc(COUNTER_DROP_PARSE);
+        Trace(TRACE_DONE, rx, len, 0, 0);
+        LatencyEnd(LATENCY_HANDLE, start);
+        return;
+    }
+    Trace(TRACE_PARSE, rx, len, desc.dst, desc.flags);
+
+    /* the fib and anything we looked up in it is only ours until unlock */
+    rcuReadLock();
 
     arpUpdateCache();
 
-    if (dstIsBroadcast(ethernetHdr)) {
-        if (ntohs(ethernetHdr->ether_type) == ETHERTYPE_ARP) {
-            fprintf(stdout, "- Ethernet Type: %4.4x -> ARP\n", ntohs(ethernetHdr->ether_type));
-            handleArp(sr, packet, len, interface);
-        }
-    } else if (weAreTarget(sr, packet, interface)) {
-        if (ntohs(ethernetHdr->ether_type) == ETHERTYPE_IP) {
-            fprintf(stdout, "- Ethernet Type: %4.4x -> IP\n", ntohs(ethernetHdr->ether_type));
-            handleIp(sr, packet, len, interface);
+    dispatchEther(sr, &desc, interface);
+
+    rcuReadUnlock();
+
+    Trace(TRACE_DONE, rx, len, 0, 0);
+    LatencyEnd(LATENCY_HANDLE, start);
+
+}/* end sr_ForwardPacket */
+
+/*-----------------------------------------------------------------------------
+ * Method: void sr_handlepackets(struct sr_instance* sr, uint8_t** packets,
+ *                      unsigned int* lens, char** interfaces, int n)
+ *
+ * handles a burst of up to SR_BURST_MAX frames, lent as for
+ * sr_handlepacket. runs of transit packets are forwarded a stage at a
+ * time, all lookups, then all rewrites, then all sends, so each stage keeps
+ * its code and tables hot for the whole run. anything else goes through
+ * dispatch one frame at a time, in arrival order
+ *---------------------------------------------------------------------------*/
+void sr_handlepackets(struct sr_instance* sr, uint8_t** packets, unsigned int* lens,
+        char** interfaces, int n)
+{
+    struct packet_desc descs[SR_BURST_MAX];
+    struct packet_desc* fwd[SR_BURST_MAX];
+    char* fwdInterfaces[SR_BURST_MAX];
+    struct packet_desc* desc;
+    struct sr_if* rx;
+    uint64_t start, burstStart;
+    int i, nfwd = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(n <= SR_BURST_MAX);
+
+    burstStart = LatencyStart();
+    Trace(TRACE_BURST, NULL, n, 0, 0);
+
+    rcuReadLock();
+
+    arpUpdateCache();
+
+    for (i = 0; i < n; i++) {
+        if (i + 1 < n)
+            __builtin_prefetch(packets[i + 1]);
+
+        rx = sr_get_interface(sr, interfaces[i]);
+
+        LogDebug(LOG_PACKET, "*** -> Received packet of length %d", lens[i]);
+        Trace(TRACE_RECEIVE, rx, lens[i], 0, 0);
+        countReceived(rx, lens[i]);
+
+        desc = &descs[i];
+        if (parsePacket(desc, packets[i], lens[i]) != 0) {
+            LogInfo(LOG_PACKET, "*** -> Dropping packet: %s", desc->error);
+            Trace(TRACE_DROP, rx, lens[i], 0, TRACE_DROP_PARSE);
+            CounterInc(COUNTER_DROP_PARSE);
+            continue;
         }
+        Trace(TRACE_PARSE, rx, lens[i], desc->dst, desc->flags);
 
-        if (ntohs(ethernetHdr->ether_type) == ETHERTYPE_ARP) {
-            fprintf(stdout, "- Ethernet Type: %4.4x -> ARP\n", ntohs(ethernetHdr->ether_type));
-            handleArp(sr, packet, len, interface);
+        /* transit ip stays for the burst, the rest goes the usual way */
+        if ((desc->flags & PARSE_IP) && !(desc->flags & PARSE_BROADCAST) &&
+                !weAreTarget(sr, desc, interfaces[i])) {
+            fwd[nfwd] = desc;
+            fwdInterfaces[nfwd++] = interfaces[i];
+            continue;
         }
-    } else {
-        if (ntohs(ethernetHdr->ether_type) == ETHERTYPE_IP) {
-            fprintf(stdout, "- Ethernet Type: %4.4x -> IP\n", ntohs(ethernetHdr->ether_type));
-            handleForward(sr, packet, len, interface);
+
+        /* but not ahead of what came before it, an arp reply must not
+         * let earlier packets skip their wait */
+        if (nfwd) {
+            start = dispatchCycles();
+            handleForwardBurst(sr, fwd, fwdInterfaces, nfwd);
+            dispatchCharge(DISPATCH_ETHER, ETHERTYPE_IP, nfwd, start);
+            nfwd = 0;
         }
+        dispatchEther(sr, desc, interfaces[i]);
     }
 
-}/* end sr_ForwardPacket */
+    if (nfwd) {
+        start = dispatchCycles();
+        handleForwardBurst(sr, fwd, fwdInterfaces, nfwd);
+        dispatchCharge(DISPATCH_ETHER, ETHERTYPE_IP, nfwd, start);
+    }
+
+    rcuReadUnlock();
+
+    Trace(TRACE_DONE, NULL, n, 0, 0);
+    LatencyEndBurst(LATENCY_HANDLE, burstStart, n);
+}
 
 /*-----------------------------------------------------------------------------
- * Method: int weAreTarget(struct sr_instance* sr, struct sr_ethernet_hdr * ethernetHdr)
+ * Method: static void inputArp(struct sr_instance* sr,
+ *                      struct packet_desc* desc, char* interface)
  *
- * determines if are the destination interface for our packet
+ * arp handler, takes broadcasts and arp addressed to this interface
  *---------------------------------------------------------------------------*/
-int weAreTarget(struct sr_instance* sr, uint8_t* packet, const char* interface)
+static void inputArp(struct sr_instance* sr, struct packet_desc* desc, char* interface)
 {
-    struct sr_ethernet_hdr* ethernetHdr = (struct sr_ethernet_hdr*)packet;
-    struct sr_if* incoming_if = sr_get_interface(sr, interface);
-
-    if (ntohs(ethernetHdr->ether_type) == ETHERTYPE_ARP) {
-        struct sr_arphdr* arpHdr = (struct sr_arphdr*)(packet+14);
-        if (incoming_if->ip == arpHdr->ar_tip)
-            return 1;
-    } else if (ntohs(ethernetHdr->ether_type) == ETHERTYPE_IP) {
-        struct ip* ipHdr = (struct ip*)(packet+14);
-        if (incoming_if->ip == ipHdr->ip_dst.s_addr)
-            return 1;
+    if ((desc->flags & PARSE_BROADCAST) || weAreTarget(sr, desc, interface)) {
+        LogDebug(LOG_PACKET, "- Ethernet Type: %4.4x -> ARP", desc->ethertype);
+        handleArp(sr, desc, interface);
     }
+}
 
-    return 0;
+/*-----------------------------------------------------------------------------
+ * Method: static void inputIp(struct sr_instance* sr,
+ *                      struct packet_desc* desc, char* interface)
+ *
+ * ip handler, delivers packets addressed to this interface and forwards
+ * the rest. broadcasts are not forwarded
+ *---------------------------------------------------------------------------*/
+static void inputIp(struct sr_instance* sr, struct packet_desc* desc, char* interface)
+{
+    if (desc->flags & PARSE_BROADCAST)
+        return;
+
+    LogDebug(LOG_PACKET, "- Ethernet Type: %4.4x -> IP", desc->ethertype);
+    if (weAreTarget(sr, desc, interface))
+        handleIp(sr, desc, interface);
+    else
+        handleForward(sr, desc, interface);
 }
 
 /*-----------------------------------------------------------------------------
- * Method: int dstIsBroadcast(struct sr_ethernet_hdr* ethernetHdr)
+ * Method: int weAreTarget(struct sr_instance* sr, struct packet_desc* desc,
+ *                          const char* interface)
  *
- * determines if the incoming packet is broadcast
+ * determines if are the destination interface for our packet, the parser
+ * already found its arp or ip target
  *---------------------------------------------------------------------------*/
-int dstIsBroadcast(struct sr_ethernet_hdr* ethernetHdr)
+int weAreTarget(struct sr_instance* sr, struct packet_desc* desc, const char* interface)
 {
-    int i;
+    struct sr_if* incoming_if = sr_get_interface(sr, interface);
 
-    for (i = 0; i < ETHER_ADDR_LEN; i++) {
-        if (ethernetHdr->ether_dhost[i] != 0xff)
-            return 0;
-    }
+    if ((desc->flags & (PARSE_ARP | PARSE_IP)) && incoming_if->ip == desc->dst)
+        return 1;
 
-    return 1;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void countReceived(const struct sr_if* iface,
+ *                      unsigned int len)
+ *
+ * counts a frame in against the interface it came in on
+ *---------------------------------------------------------------------------*/
+static void countReceived(const struct sr_if* iface, unsigned int len)
+{
+    CounterIfaceAdd(iface, COUNTER_RX_PACKETS, 1);
+    CounterIfaceAdd(iface, COUNTER_RX_BYTES, len);
 }
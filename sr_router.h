@@ -29,10 +29,14 @@
 
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
+#define SR_BURST_MAX 32                 /* frames per sr_handlepackets call */
 
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_replay;
+struct sr_pipeline;
+struct packet_desc;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -52,7 +56,10 @@ struct sr_instance
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
     struct sr_rt* routing_table; /* routing table */
-    FILE* logfile;
+    struct sr_capture* capture; /* packet log, if logging */
+    struct sr_replay* replay; /* offline replay state, if replaying */
+    struct sr_pipeline* pipeline; /* worker threads, if pipelining */
+    int ecmp_weighted; /* weigh multipath next hops by link speed */
 };
 
 /* -- sr_main.c -- */
@@ -66,8 +73,8 @@ int sr_read_from_server(struct sr_instance* );
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
-int weAreTarget(struct sr_instance*, uint8_t*, const char* );
-int dstIsBroadcast(struct sr_ethernet_hdr* );
+void sr_handlepackets(struct sr_instance* , uint8_t** , unsigned int* , char** , int );
+int weAreTarget(struct sr_instance*, struct packet_desc*, const char* );
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
@@ -38,6 +38,8 @@ struct sr_rt
 
 
 int sr_load_rt(struct sr_instance*,const char*);
+int sr_read_rt(const char*, struct sr_rt**);
+void sr_free_rt(struct sr_rt*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr,char*);
 void sr_print_routing_table(struct sr_instance* sr);
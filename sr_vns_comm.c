@@ -35,16 +35,32 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "replay.h"
+#include "pipeline.h"
+#include "capture.h"
+#include "forward.h"
+#include "fib.h"
+#include "reload.h"
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
+#include "counter.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+/* the reload thread sends too, keep whole commands together on the socket */
+static pthread_mutex_t sr_send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sr_log_packet(struct sr_instance* , uint8_t* , int , const char* , int );
+static int  sr_write_packet(struct sr_instance* , uint8_t* , unsigned int , const char* ,
+        const struct sr_if* );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
@@ -190,6 +206,9 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
             case HWSPEED:
                 /* Debug("Speed: %d\n",
                         ntohl(*((unsigned int*)hwinfo->mHWInfo[i].value))); */
+                /* -- weights multipath next hops -- */
+                sr_set_ether_speed(sr,
+                        ntohl(*((unsigned int*)hwinfo->mHWInfo[i].value)));
                 break;
             case HWSUBNET:
                 /* Debug("Subnet: %s\n",inet_ntoa(
@@ -325,7 +344,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     int command, len;
     unsigned char *buf = 0;
     c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
+    int ret = 0, bytes_read = 0, missing;
+    uint64_t start;
 
     /* REQUIRES */
     assert(sr);
@@ -356,6 +376,9 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }
 
+    /* -- the wait for a frame is not part of reading it -- */
+    start = LatencyStart();
+
     len = ntohl(len);
 
     if ( len > 10000 || len < 0 )
@@ -395,6 +418,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         } while (errno == EINTR); /* be mindful of signals */
     }
 
+    LatencyEnd(LATENCY_READ, start);
+
     /* My entry for most unreadable line of code - guido */
     /* ... you win - mc                                  */
     command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
@@ -425,14 +450,26 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
             /* -- log packet -- */
             sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
+                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header),
+                    (char*)(buf + sizeof(c_base)), CAPTURE_IN);
 
             /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+            if ( sr->pipeline )
+            {
+                pipelineEnqueue(sr,
+                        (buf+sizeof(c_packet_header)),
+                        len - sizeof(c_packet_ethernet_header) +
+                        sizeof(struct sr_ethernet_hdr),
+                        (char*)(buf + sizeof(c_base)), 0);
+            }
+            else
+            {
+                sr_handlepacket(sr,
+                        (buf+sizeof(c_packet_header)),
+                        len - sizeof(c_packet_ethernet_header) +
+                        sizeof(struct sr_ethernet_hdr),
+                        (char*)(buf + sizeof(c_base)));
+            }
 
             break;
 
@@ -456,8 +493,13 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             /* -------------     VNSHWINFO     -------------------- */
 
         case VNSHWINFO:
+            /* -- a reload may be swapping the table and reading if_list -- */
+            reloadLock();
             sr_handle_hwinfo(sr,(c_hwinfo*)buf);
-            if(sr_verify_routing_table(sr) != 0)
+            forwardWeighNexthops(sr, fibCurrent());
+            missing = sr_verify_routing_table(sr);
+            reloadUnlock();
+            if(missing != 0)
             {
                 fprintf(stderr,"Routing table not consistent with hardware\n");
                 return -1;
@@ -521,13 +563,13 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 
     if ( iface == 0 )
     {
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
+        LogError(LOG_PACKET, "** Error, interface %s, does not exist", name);
         return 0;
     }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 )
     {
-        fprintf( stderr, "** Error, source address does not match interface\n");
+        LogError(LOG_PACKET, "** Error, source address does not match interface");
         return 0;
     }
 
@@ -554,6 +596,33 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
                          const char* iface /* borrowed */)
+{
+    uint64_t start = LatencyStart();
+    struct sr_if* ifp = sr_get_interface(sr, iface);
+    int ret = sr_write_packet(sr, buf, len, iface, ifp);
+
+    LatencyEnd(LATENCY_SEND, start);
+
+    if (ret == 0) {
+        CounterIfaceAdd(ifp, COUNTER_TX_PACKETS, 1);
+        CounterIfaceAdd(ifp, COUNTER_TX_BYTES, len);
+    }
+    return ret;
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_write_packet(..)
+ * Scope: Local
+ *
+ * the work of sr_send_packet, ifp is iface looked up
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_write_packet(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const char* iface /* borrowed */,
+                         const struct sr_if* ifp /* borrowed */)
 {
     c_packet_header *sr_pkt;
     unsigned int total_len =  len + (sizeof(c_packet_header));
@@ -566,10 +635,25 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) )
     {
-        fprintf(stderr , "** Error: packet is wayy to short \n");
+        LogError(LOG_PACKET, "** Error: packet is wayy to short");
         return -1;
     }
 
+    /* -- log packet -- */
+    sr_log_packet(sr,buf,len,iface,CAPTURE_OUT);
+
+    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) )
+    {
+        LogError(LOG_PACKET, "*** Error: problem with ethernet header, check log");
+        return -1;
+    }
+
+    Trace(TRACE_TRANSMIT, ifp, len, 0, 0);
+
+    /* -- no server when replaying, frames go to the replay output -- */
+    if ( sr->replay )
+    { return replaySendPacket(sr, buf, len, iface); }
+
     /* Create packet */
     sr_pkt = (c_packet_header *)malloc(len +
             sizeof(c_packet_header));
@@ -580,27 +664,24 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
-    /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
-
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) )
-    {
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
-        return -1;
-    }
+    /* -- the TX thread owns the socket when pipelining -- */
+    if ( sr->pipeline )
+    { return pipelineTransmit(sr, sr_pkt, total_len); }
 
+    pthread_mutex_lock(&sr_send_lock);
     if( write(sr->sockfd, sr_pkt, total_len) < total_len )
     {
-        fprintf(stderr, "Error writing packet\n");
+        pthread_mutex_unlock(&sr_send_lock);
+        LogError(LOG_PACKET, "Error writing packet");
         free(sr_pkt);
         return -1;
     }
+    pthread_mutex_unlock(&sr_send_lock);
 
     free(sr_pkt);
 
     return 0;
-} /* -- sr_send_packet -- */
+} /* -- sr_write_packet -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
@@ -608,25 +689,14 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
  *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+        const char* iface, int direction )
 {
-    struct pcap_pkthdr h;
-    int size;
-
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
-    {return; }
-
-    size = min(PACKET_DUMP_SIZE, len);
-
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
-
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    /* -- the capture writer does the file work, off this thread -- */
+    captureFrame(sr, buf, len, iface, direction);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
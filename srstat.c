@@ -0,0 +1,207 @@
+/*******************************************************************************
+ * file: srstat.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * reads the statistics segment published by sr -G and prints rates: every
+ * interval, per interface packets and megabits a second each way, then
+ * every router-wide counter a second and the gauges. rates are over the
+ * router's own publish times, so a late wakeup here does not skew them.
+ * reading is a memory copy under the sequence lock, the router is never
+ * asked for anything
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+
+#define SRSTAT_RETRIES 1000
+
+static const char* globalNames[COUNTER_GLOBALS] = { "forwarded", "arp-hit", "arp-miss",
+    "arp-request", "arp-reply", "held", "drop-parse", "drop-ttl", "drop-no-route",
+    "drop-hold-full", "drop-rx-queue", "drop-tx-queue", "icmp-echo-reply",
+    "icmp-time-exceeded", "icmp-net-unreach", "icmp-host-unreach", "icmp-port-unreach" };
+
+static struct stats_shm* attach(const char* );
+static int snapshot(const struct stats_shm*, struct stats_shm* );
+static void printRates(const struct stats_shm*, const struct stats_shm* );
+
+int main(int argc, char** argv)
+{
+    struct stats_shm* seg;
+    struct stats_shm prev, cur;
+    double interval = 1.0;
+    long count = -1;
+    int c;
+
+    while ((c = getopt(argc, argv, "i:c:")) != EOF) {
+        switch (c) {
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'c':
+                count = atol(optarg);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (optind != argc - 1 || interval <= 0) {
+        fprintf(stderr, "usage: %s [-i seconds] [-c count] <name given to sr -G>\n", argv[0]);
+        return 1;
+    }
+
+    if ((seg = attach(argv[optind])) == NULL)
+        return 1;
+
+    if (snapshot(seg, &prev) != 0) {
+        fprintf(stderr, "Error: the router never left the segment readable\n");
+        return 1;
+    }
+
+    while (count != 0) {
+        usleep(interval * 1000000);
+
+        if (snapshot(seg, &cur) != 0) {
+            fprintf(stderr, "Error: the router never left the segment readable\n");
+            return 1;
+        }
+        printRates(&prev, &cur);
+        prev = cur;
+
+        if (__atomic_load_n(&seg->pid, __ATOMIC_ACQUIRE) == 0) {
+            printf("router exited\n");
+            break;
+        }
+        if (count > 0)
+            count--;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct stats_shm* attach(const char* name)
+ *
+ * maps the segment for name read-only, NULL if it is missing or is not a
+ * segment this srstat understands
+ *---------------------------------------------------------------------------*/
+static struct stats_shm* attach(const char* name)
+{
+    char seg[BUFSIZ];
+    struct stats_shm* s;
+    struct stat st;
+    int fd;
+
+    snprintf(seg, sizeof(seg), STATS_SHM_PREFIX "%s", name);
+    if ((fd = shm_open(seg, O_RDONLY, 0)) < 0 || fstat(fd, &st) != 0) {
+        perror(seg);
+        return NULL;
+    }
+    if (st.st_size < sizeof(struct stats_shm)) {
+        fprintf(stderr, "Error: %s is too small to be a statistics segment\n", seg);
+        close(fd);
+        return NULL;
+    }
+
+    s = mmap(NULL, sizeof(struct stats_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+    if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+            s->version != STATS_VERSION || s->size != sizeof(struct stats_shm)) {
+        fprintf(stderr, "Error: %s is not a version %d statistics segment\n", seg, STATS_VERSION);
+        munmap(s, sizeof(struct stats_shm));
+        return NULL;
+    }
+
+    return s;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int snapshot(const struct stats_shm* s, struct stats_shm* copy)
+ *
+ * a consistent copy of s: retried until seq is even and unchanged across
+ * the copy. returns 0, or -1 if the writer never got out of the way
+ *---------------------------------------------------------------------------*/
+static int snapshot(const struct stats_shm* s, struct stats_shm* copy)
+{
+    uint64_t seq;
+    int tries, i;
+
+    memcpy(copy, s, offsetof(struct stats_shm, seq));
+
+    for (tries = 0; tries < SRSTAT_RETRIES; tries++) {
+        seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        copy->updated = __atomic_load_n(&s->updated, __ATOMIC_RELAXED);
+        copy->arpEntries = __atomic_load_n(&s->arpEntries, __ATOMIC_RELAXED);
+        copy->held = __atomic_load_n(&s->held, __ATOMIC_RELAXED);
+        copy->routes = __atomic_load_n(&s->routes, __ATOMIC_RELAXED);
+        for (i = 0; i < COUNTER_SLOTS; i++)
+            copy->counters[i] = __atomic_load_n(&s->counters[i], __ATOMIC_RELAXED);
+
+        /* the data loads stay before the second look at seq */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+            copy->seq = seq;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void printRates(const struct stats_shm* prev,
+ *                  const struct stats_shm* cur)
+ *
+ * prints what changed between two snapshots, a second
+ *---------------------------------------------------------------------------*/
+static void printRates(const struct stats_shm* prev, const struct stats_shm* cur)
+{
+    const uint64_t* a = prev->counters;
+    const uint64_t* b = cur->counters;
+    double secs;
+    uint32_t i;
+
+    if (cur->updated == prev->updated) {
+        printf("no update from the router since the last sample\n");
+        return;
+    }
+    secs = (cur->updated - prev->updated) / 1e9;
+
+    printf("%-12s %12s %12s %12s %12s\n", "interface", "rx pkt/s", "rx Mbit/s", "tx pkt/s", "tx Mbit/s");
+    for (i = 0; i < cur->nifaces; i++) {
+        printf("%-12.*s %12.1f %12.3f %12.1f %12.3f\n", sr_IFACE_NAMELEN, cur->ifaces[i],
+                (b[COUNTER_IFACE(i, COUNTER_RX_PACKETS)] - a[COUNTER_IFACE(i, COUNTER_RX_PACKETS)]) / secs,
+                (b[COUNTER_IFACE(i, COUNTER_RX_BYTES)] - a[COUNTER_IFACE(i, COUNTER_RX_BYTES)]) * 8 / secs / 1e6,
+                (b[COUNTER_IFACE(i, COUNTER_TX_PACKETS)] - a[COUNTER_IFACE(i, COUNTER_TX_PACKETS)]) / secs,
+                (b[COUNTER_IFACE(i, COUNTER_TX_BYTES)] - a[COUNTER_IFACE(i, COUNTER_TX_BYTES)]) * 8 / secs / 1e6);
+    }
+
+    printf("per second:");
+    for (i = 0; i < COUNTER_GLOBALS; i++)
+        printf("%s%s %.1f", i % 4 == 0 ? "\n  " : "  ", globalNames[i], (b[i] - a[i]) / secs);
+    printf("\narp cache %u/%u  held %u/%u  routes %u\n\n", cur->arpEntries, cur->arpCapacity,
+            cur->held, cur->heldCapacity, cur->routes);
+    fflush(stdout);
+}
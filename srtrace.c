@@ -0,0 +1,293 @@
+/*******************************************************************************
+ * file: srtrace.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * decodes an event trace dumped by sr -X. events from every thread are put
+ * back in time order and printed one per line, with the time since the
+ * thread's previous event, or written as Chrome trace JSON (-j) for
+ * chrome://tracing or Perfetto. there a burst, or a packet handled on its
+ * own, is a slice from its first event to TRACE_DONE, and everything in
+ * between is an instant event on the same thread
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "trace.h"
+
+struct srtrace_event {
+    struct trace_event  e;
+    uint32_t            thread;
+};
+
+static const char* eventNames[TRACE_IDS] = { "?", "receive", "burst", "parse", "route",
+    "arp-hit", "arp-miss", "queue", "hold", "transmit", "drop", "done" };
+static const char* dropNames[] = { "?", "parse", "ttl", "no-route", "hold-full", "queue-full" };
+
+static char (*ifaces)[sr_IFACE_NAMELEN];
+static uint32_t nifaces;
+static double nsPerTick;
+
+static int readTrace(FILE*, struct trace_header*, struct srtrace_event**, unsigned long* );
+static int compareEvents(const void*, const void* );
+static const char* eventName(uint16_t );
+static const char* ifaceName(uint16_t );
+static const char* addrName(uint32_t );
+static void printText(struct srtrace_event*, unsigned long, uint32_t );
+static void printJson(struct srtrace_event*, unsigned long, uint32_t );
+
+int main(int argc, char** argv)
+{
+    struct trace_header hdr;
+    struct srtrace_event* events;
+    unsigned long n;
+    int json = 0;
+    FILE* fp;
+
+    if (argc == 3 && strcmp(argv[1], "-j") == 0) {
+        json = 1;
+        argv++;
+    } else if (argc != 2) {
+        fprintf(stderr, "usage: %s [-j] <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (readTrace(fp, &hdr, &events, &n) != 0) {
+        fprintf(stderr, "Error: %s is not a readable trace\n", argv[1]);
+        return 1;
+    }
+    fclose(fp);
+
+    /* calibrate the cycle counter against the clock read beside it */
+    nsPerTick = 1.0;
+    if (hdr.tscEnd > hdr.tscStart && hdr.nsEnd > hdr.nsStart)
+        nsPerTick = (double)(hdr.nsEnd - hdr.nsStart) / (hdr.tscEnd - hdr.tscStart);
+
+    qsort(events, n, sizeof(struct srtrace_event), compareEvents);
+
+    if (json)
+        printJson(events, n, hdr.nthreads);
+    else
+        printText(events, n, hdr.nthreads);
+
+    free(events);
+    free(ifaces);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int readTrace(FILE* fp, struct trace_header* hdr,
+ *                  struct srtrace_event** events, unsigned long* n)
+ *
+ * reads a whole trace, every thread's events into one array. returns 0 on
+ * success, -1 if the file is short or not a trace
+ *---------------------------------------------------------------------------*/
+static int readTrace(FILE* fp, struct trace_header* hdr, struct srtrace_event** events,
+        unsigned long* n)
+{
+    struct trace_thread th;
+    struct trace_event e;
+    unsigned long size = 0;
+    uint32_t i, j;
+
+    *events = NULL;
+    *n = 0;
+
+    if (fread(hdr, sizeof(*hdr), 1, fp) != 1 || memcmp(hdr->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+            hdr->version != TRACE_VERSION || hdr->nifaces > TRACE_MAX_IFACES)
+        return -1;
+
+    nifaces = hdr->nifaces;
+    ifaces = calloc(nifaces + 1, sr_IFACE_NAMELEN);
+    if (ifaces == NULL || fread(ifaces, sr_IFACE_NAMELEN, nifaces, fp) != nifaces)
+        return -1;
+    for (i = 0; i < nifaces; i++)
+        ifaces[i][sr_IFACE_NAMELEN - 1] = '\0';
+
+    for (i = 0; i < hdr->nthreads; i++) {
+        if (fread(&th, sizeof(th), 1, fp) != 1)
+            return -1;
+        if (th.lost)
+            fprintf(stderr, "thread %u: oldest %llu events were overwritten\n",
+                    th.thread, (unsigned long long)th.lost);
+
+        for (j = 0; j < th.count; j++) {
+            if (fread(&e, sizeof(e), 1, fp) != 1)
+                return -1;
+            if (*n == size) {
+                size = size ? size * 2 : TRACE_EVENTS;
+                *events = realloc(*events, size * sizeof(struct srtrace_event));
+                if (*events == NULL)
+                    return -1;
+            }
+            (*events)[*n].e = e;
+            (*events)[(*n)++].thread = th.thread;
+        }
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static int compareEvents(const void* a, const void* b)
+ *
+ * orders events by time, keeping each thread's own order on ties
+ *---------------------------------------------------------------------------*/
+static int compareEvents(const void* a, const void* b)
+{
+    const struct srtrace_event* x = a;
+    const struct srtrace_event* y = b;
+
+    if (x->e.tsc != y->e.tsc)
+        return x->e.tsc < y->e.tsc ? -1 : 1;
+    if (x->thread != y->thread)
+        return x->thread < y->thread ? -1 : 1;
+
+    /* same thread, same tick: where they sit in the array is their order */
+    return x < y ? -1 : x > y;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void printText(struct srtrace_event* events,
+ *                  unsigned long n, uint32_t nthreads)
+ *
+ * one line per event: microseconds since the first event, thread,
+ * nanoseconds since that thread's previous event, then the event
+ *---------------------------------------------------------------------------*/
+static void printText(struct srtrace_event* events, unsigned long n, uint32_t nthreads)
+{
+    uint64_t* last = calloc(nthreads + 1, sizeof(uint64_t));
+    struct trace_event* e;
+    unsigned long i;
+
+    if (last == NULL)
+        return;
+
+    for (i = 0; i < n; i++) {
+        e = &events[i].e;
+        printf("%12.3f t%-2u %+9.0f %-9s", (e->tsc - events[0].e.tsc) * nsPerTick / 1000,
+                events[i].thread,
+                last[events[i].thread] ? (e->tsc - last[events[i].thread]) * nsPerTick : 0.0,
+                eventName(e->id));
+        last[events[i].thread] = e->tsc;
+
+        if (e->iface != TRACE_NO_IFACE)
+            printf(" %s", ifaceName(e->iface));
+        printf(" len %u", e->len);
+        if (e->addr)
+            printf(" %s", addrName(e->addr));
+
+        switch (e->id) {
+            case TRACE_PARSE:   printf(" flags 0x%x", e->arg); break;
+            case TRACE_ROUTE:   printf(" via %s", addrName(e->arg)); break;
+            case TRACE_QUEUE:   printf(" worker %u", e->arg); break;
+            case TRACE_HOLD:    printf(" slot %u", e->arg); break;
+            case TRACE_DROP:
+                printf(" %s", e->arg < sizeof(dropNames) / sizeof(dropNames[0]) ? dropNames[e->arg] : "?");
+                break;
+        }
+        printf("\n");
+    }
+
+    free(last);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void printJson(struct srtrace_event* events,
+ *                  unsigned long n, uint32_t nthreads)
+ *
+ * writes the Chrome trace event format, timestamps in microseconds
+ *---------------------------------------------------------------------------*/
+static void printJson(struct srtrace_event* events, unsigned long n, uint32_t nthreads)
+{
+    int* open = calloc(nthreads + 1, sizeof(int));
+    struct trace_event* e;
+    const char* ph;
+    const char* name;
+    unsigned long i;
+    uint32_t t;
+
+    if (open == NULL)
+        return;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (t = 0; t < nthreads; t++)
+        printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"thread %u\"}},\n", t, t);
+
+    for (i = 0; i < n; i++) {
+        e = &events[i].e;
+        t = events[i].thread;
+        name = eventName(e->id);
+
+        /* a burst, or a packet outside one, opens a slice that done closes */
+        if ((e->id == TRACE_BURST || e->id == TRACE_RECEIVE) && !open[t]) {
+            ph = "B";
+            name = e->id == TRACE_BURST ? "burst" : "packet";
+            open[t] = 1;
+        } else if (e->id == TRACE_DONE && open[t]) {
+            ph = "E";
+            open[t] = 0;
+        } else {
+            ph = "i";
+        }
+
+        printf("{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,%s\"args\":{\"len\":%u",
+                name, ph, (e->tsc - events[0].e.tsc) * nsPerTick / 1000, t,
+                ph[0] == 'i' ? "\"s\":\"t\"," : "", e->len);
+        if (e->iface != TRACE_NO_IFACE)
+            printf(",\"iface\":\"%s\"", ifaceName(e->iface));
+        if (e->addr)
+            printf(",\"addr\":\"%s\"", addrName(e->addr));
+        if (e->id == TRACE_ROUTE)
+            printf(",\"via\":\"%s\"", addrName(e->arg));
+        else if (e->id == TRACE_DROP)
+            printf(",\"reason\":\"%s\"",
+                    e->arg < sizeof(dropNames) / sizeof(dropNames[0]) ? dropNames[e->arg] : "?");
+        else if (e->arg)
+            printf(",\"arg\":%u", e->arg);
+        printf("}}%s\n", i + 1 < n ? "," : "");
+    }
+    printf("]}\n");
+
+    free(open);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static const char* eventName(uint16_t id)
+ *---------------------------------------------------------------------------*/
+static const char* eventName(uint16_t id)
+{
+    return id < TRACE_IDS ? eventNames[id] : "?";
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static const char* ifaceName(uint16_t i)
+ *---------------------------------------------------------------------------*/
+static const char* ifaceName(uint16_t i)
+{
+    return i < nifaces ? ifaces[i] : "?";
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static const char* addrName(uint32_t addr)
+ *
+ * dotted quad for a network order address, good until the next call
+ *---------------------------------------------------------------------------*/
+static const char* addrName(uint32_t addr)
+{
+    static char buf[INET_ADDRSTRLEN];
+
+    return inet_ntop(AF_INET, &addr, buf, sizeof(buf));
+}
@@ -0,0 +1,200 @@
+/*******************************************************************************
+ * file: stats.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the statistics segment. the publishing thread gathers the
+ * totals and gauges first, taking whatever locks that needs, and only then
+ * opens the write window, so a reader spinning on an odd seq waits for a
+ * memory copy and nothing else. only the publishing thread writes, seq
+ * needs no locked increment
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "arp.h"
+#include "forward.h"
+#include "fib.h"
+#include "rcu.h"
+#include "counter.h"
+#include "stats.h"
+
+static struct stats_shm* statsSeg = NULL;
+static char statsName[BUFSIZ];
+static pthread_t statsThread;
+static int statsStopping = 0;
+
+static void statsPublish();
+static void* statsRun(void* );
+static uint64_t statsNs();
+
+/*-----------------------------------------------------------------------------
+ * Method: int statsStart(struct sr_instance* sr, const char* spec)
+ *
+ * creates the segment for spec, name[:interval_ms], replacing any left by
+ * an earlier router, and starts publishing. returns 0 on success, -1 on
+ * error
+ *---------------------------------------------------------------------------*/
+int statsStart(struct sr_instance* sr, const char* spec)
+{
+    struct stats_shm* s;
+    struct sr_if* iface;
+    const char* colon = strchr(spec, ':');
+    int interval = STATS_INTERVAL_MS;
+    int fd;
+
+    if (colon != NULL && (interval = atoi(colon + 1)) <= 0) {
+        fprintf(stderr, "Error: bad statistics interval in %s\n", spec);
+        return -1;
+    }
+    snprintf(statsName, sizeof(statsName), STATS_SHM_PREFIX "%.*s",
+            colon ? (int)(colon - spec) : (int)strlen(spec), spec);
+
+    shm_unlink(statsName);
+    if ((fd = shm_open(statsName, O_RDWR | O_CREAT | O_EXCL, 0444)) < 0 ||
+            ftruncate(fd, sizeof(struct stats_shm)) != 0) {
+        perror(statsName);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    s = mmap(NULL, sizeof(struct stats_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(statsName);
+        return -1;
+    }
+
+    /* the fixed part, written once before anyone can trust magic */
+    for (iface = sr->if_list; iface && iface->index < COUNTER_MAX_IFACES; iface = iface->next) {
+        strncpy(s->ifaces[iface->index], iface->name, sr_IFACE_NAMELEN - 1);
+        s->nifaces = iface->index + 1;
+    }
+    s->size = sizeof(struct stats_shm);
+    s->pid = getpid();
+    s->intervalMs = interval;
+    s->arpCapacity = ARP_CACHE_SIZE;
+    s->heldCapacity = PACKET_CACHE_SIZE;
+    s->version = STATS_VERSION;
+    __atomic_store_n(&s->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+    statsSeg = s;
+    statsPublish();
+
+    if (pthread_create(&statsThread, NULL, statsRun, NULL) != 0) {
+        perror("pthread_create");
+        munmap(s, sizeof(struct stats_shm));
+        shm_unlink(statsName);
+        statsSeg = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void statsStop()
+ *
+ * publishes the final totals, marks the router gone and removes the
+ * segment. readers that have it mapped keep the last copy
+ *---------------------------------------------------------------------------*/
+void statsStop()
+{
+    if (statsSeg == NULL)
+        return;
+
+    __atomic_store_n(&statsStopping, 1, __ATOMIC_RELEASE);
+    pthread_join(statsThread, NULL);
+
+    statsPublish();
+    __atomic_store_n(&statsSeg->pid, 0, __ATOMIC_RELEASE);
+
+    munmap(statsSeg, sizeof(struct stats_shm));
+    shm_unlink(statsName);
+    statsSeg = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void statsPublish()
+ *
+ * one seqlock write of the totals and gauges. only the publishing thread,
+ * or statsStop once it has gone, calls this
+ *---------------------------------------------------------------------------*/
+static void statsPublish()
+{
+    struct stats_shm* s = statsSeg;
+    uint64_t values[COUNTER_SLOTS];
+    uint32_t arpEntries, held, routes = 0;
+    struct fib* fib;
+    uint64_t seq;
+    int i;
+
+    counterSum(values);
+    arpEntries = arpCacheCount();
+    held = packetCacheCount();
+
+    rcuReadLock();
+    if ((fib = fibCurrent()) != NULL)
+        routes = fib->hdr->nprefixes;
+    rcuReadUnlock();
+
+    /* odd seq, then the data: the fence keeps the data stores after it */
+    seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&s->updated, statsNs(), __ATOMIC_RELAXED);
+    __atomic_store_n(&s->arpEntries, arpEntries, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->held, held, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->routes, routes, __ATOMIC_RELAXED);
+    for (i = 0; i < COUNTER_SLOTS; i++)
+        __atomic_store_n(&s->counters[i], values[i], __ATOMIC_RELAXED);
+
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static void* statsRun(void* arg)
+ *
+ * publishes every interval until statsStop
+ *---------------------------------------------------------------------------*/
+static void* statsRun(void* arg)
+{
+    struct timespec ts;
+
+    ts.tv_sec = statsSeg->intervalMs / 1000;
+    ts.tv_nsec = (statsSeg->intervalMs % 1000) * 1000000L;
+
+    while (!__atomic_load_n(&statsStopping, __ATOMIC_ACQUIRE)) {
+        nanosleep(&ts, NULL);
+        statsPublish();
+    }
+
+    rcuUnregister();
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t statsNs()
+ *
+ * monotonic nanoseconds, the same clock in every process on the host
+ *---------------------------------------------------------------------------*/
+static uint64_t statsNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ * file: stats.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the shared memory statistics segment (-G). a thread
+ * copies the counter totals and a few gauges into the posix shm segment
+ * /sr-stats-<name> every interval, so a monitor can sample the router as
+ * often as it likes by reading memory, without a syscall and without the
+ * packet path noticing. the copy is guarded by a sequence lock: seq is odd
+ * while the router writes, and a reader that saw the same even seq before
+ * and after its copy has a consistent one. srstat is the reader
+ ******************************************************************************/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "sr_if.h"
+#include "counter.h"
+
+#define STATS_MAGIC 0x53525354                  // "SRST"
+#define STATS_VERSION 1
+#define STATS_SHM_PREFIX "/sr-stats-"
+#define STATS_INTERVAL_MS 100
+
+struct stats_shm {
+    uint32_t        magic;
+    uint32_t        version;
+    uint32_t        size;                       // bytes in the segment
+    uint32_t        pid;                        // 0 once the router has exited
+    uint32_t        intervalMs;
+    uint32_t        nifaces;                    // up to COUNTER_MAX_IFACES
+    uint32_t        arpCapacity;
+    uint32_t        heldCapacity;
+    char            ifaces[COUNTER_MAX_IFACES][sr_IFACE_NAMELEN];
+
+    /* -- everything below is under seq -- */
+    uint64_t        seq;
+    uint64_t        updated;                    // CLOCK_MONOTONIC ns
+    uint32_t        arpEntries;
+    uint32_t        held;                       // waiting in the packet cache
+    uint32_t        routes;                     // prefixes in the fib
+    uint32_t        pad;
+    uint64_t        counters[COUNTER_SLOTS];
+};
+
+int statsStart(struct sr_instance*, const char* );
+void statsStop();
+
+#endif
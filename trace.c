@@ -0,0 +1,214 @@
+/*******************************************************************************
+ * file: trace.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the event trace. a thread's first event allocates its ring
+ * and claims a slot in traceBuffers, after that recording an event is a
+ * handful of stores into memory only that thread writes. interfaces are
+ * numbered by their place in the interface list when tracing starts, and
+ * the names go in the file so srtrace can put them back
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "dispatch.h"
+#include "trace.h"
+
+int traceEnabled = 0;
+
+static struct trace_buffer* traceBuffers[TRACE_MAX_THREADS];
+static unsigned int traceThreads = 0;
+static char traceIfaces[TRACE_MAX_IFACES][sr_IFACE_NAMELEN];
+static unsigned int traceNifaces = 0;
+static FILE* traceFp = NULL;
+static char traceName[256];
+static uint64_t traceTscStart;
+static uint64_t traceNsStart;
+
+static __thread struct trace_buffer* traceLocal = NULL;
+static __thread int traceNoRoom = 0;
+
+static struct trace_buffer* traceRegister();
+static uint64_t traceNs();
+
+/*-----------------------------------------------------------------------------
+ * Method: int traceStart(struct sr_instance* sr, const char* name)
+ *
+ * turns tracepoints on, to be dumped to the file name by traceStop. the
+ * interfaces must be known by now. returns 0 on success, -1 on error
+ *---------------------------------------------------------------------------*/
+int traceStart(struct sr_instance* sr, const char* name)
+{
+    struct sr_if* iface;
+
+    /* open it now, so a bad name fails at startup */
+    traceFp = fopen(name, "wb");
+    if (traceFp == NULL) {
+        perror(name);
+        return -1;
+    }
+    strncpy(traceName, name, sizeof(traceName) - 1);
+
+    /* events carry sr_if indexes, so the names go in index order */
+    for (iface = sr->if_list; iface && iface->index < TRACE_MAX_IFACES; iface = iface->next) {
+        strncpy(traceIfaces[iface->index], iface->name, sr_IFACE_NAMELEN - 1);
+        traceNifaces = iface->index + 1;
+    }
+
+    traceTscStart = dispatchCycles();
+    traceNsStart = traceNs();
+    __atomic_store_n(&traceEnabled, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void traceStop()
+ *
+ * turns tracepoints off and dumps every thread's ring, oldest event first.
+ * the threads must be done tracing
+ *---------------------------------------------------------------------------*/
+void traceStop()
+{
+    struct trace_header hdr;
+    struct trace_thread th;
+    struct trace_buffer* buf;
+    unsigned long events = 0;
+    uint64_t first;
+    unsigned int i, nthreads, split;
+
+    if (!__atomic_load_n(&traceEnabled, __ATOMIC_ACQUIRE))
+        return;
+    __atomic_store_n(&traceEnabled, 0, __ATOMIC_RELEASE);
+
+    nthreads = __atomic_load_n(&traceThreads, __ATOMIC_ACQUIRE);
+    if (nthreads > TRACE_MAX_THREADS)
+        nthreads = TRACE_MAX_THREADS;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    hdr.version = TRACE_VERSION;
+    hdr.nthreads = nthreads;
+    hdr.nifaces = traceNifaces;
+    hdr.tscStart = traceTscStart;
+    hdr.nsStart = traceNsStart;
+    hdr.tscEnd = dispatchCycles();
+    hdr.nsEnd = traceNs();
+
+    fwrite(&hdr, sizeof(hdr), 1, traceFp);
+    fwrite(traceIfaces, sr_IFACE_NAMELEN, traceNifaces, traceFp);
+
+    for (i = 0; i < nthreads; i++) {
+        buf = __atomic_load_n(&traceBuffers[i], __ATOMIC_ACQUIRE);
+        th.thread = i;
+        th.count = 0;
+        th.lost = 0;
+        if (buf) {
+            th.count = buf->head < TRACE_EVENTS ? buf->head : TRACE_EVENTS;
+            th.lost = buf->head - th.count;
+        }
+        fwrite(&th, sizeof(th), 1, traceFp);
+        if (buf == NULL)
+            continue;
+
+        /* the ring may have wrapped, the oldest event is then mid-ring */
+        first = buf->head - th.count;
+        split = first & (TRACE_EVENTS - 1);
+        if (split + th.count > TRACE_EVENTS) {
+            fwrite(&buf->events[split], sizeof(struct trace_event), TRACE_EVENTS - split, traceFp);
+            fwrite(&buf->events[0], sizeof(struct trace_event), split + th.count - TRACE_EVENTS, traceFp);
+        } else {
+            fwrite(&buf->events[split], sizeof(struct trace_event), th.count, traceFp);
+        }
+        events += th.count;
+
+        traceBuffers[i] = NULL;
+        free(buf);
+    }
+
+    if (fclose(traceFp) != 0)
+        perror(traceName);
+    traceFp = NULL;
+
+    printf("Trace wrote %lu events from %u threads to %s\n", events, nthreads, traceName);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void traceRecord(uint16_t id, const struct sr_if* iface,
+ *                  uint32_t len, uint32_t addr, uint32_t arg)
+ *
+ * records an event on the calling thread's ring, iface may be NULL. use
+ * the Trace macro, which skips this while tracing is off
+ *---------------------------------------------------------------------------*/
+void traceRecord(uint16_t id, const struct sr_if* iface, uint32_t len, uint32_t addr, uint32_t arg)
+{
+    struct trace_buffer* buf = traceLocal;
+    struct trace_event* e;
+
+    if (buf == NULL && (buf = traceRegister()) == NULL)
+        return;
+
+    e = &buf->events[buf->head & (TRACE_EVENTS - 1)];
+    e->tsc = dispatchCycles();
+    e->id = id;
+    e->iface = (iface && iface->index < TRACE_MAX_IFACES) ? iface->index : TRACE_NO_IFACE;
+    e->len = len;
+    e->addr = addr;
+    e->arg = arg;
+
+    __atomic_store_n(&buf->head, buf->head + 1, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static struct trace_buffer* traceRegister()
+ *
+ * gives the calling thread a ring, NULL once TRACE_MAX_THREADS have one
+ *---------------------------------------------------------------------------*/
+static struct trace_buffer* traceRegister()
+{
+    struct trace_buffer* buf;
+    unsigned int slot;
+
+    if (traceNoRoom)
+        return NULL;
+
+    slot = __atomic_fetch_add(&traceThreads, 1, __ATOMIC_ACQ_REL);
+    if (slot >= TRACE_MAX_THREADS) {
+        traceNoRoom = 1;
+        return NULL;
+    }
+
+    buf = calloc(1, sizeof(struct trace_buffer));
+    if (buf == NULL) {
+        fprintf(stderr, "Error: calloc could not find memory for a trace ring\n");
+        traceNoRoom = 1;
+        return NULL;
+    }
+    buf->thread = slot;
+
+    __atomic_store_n(&traceBuffers[slot], buf, __ATOMIC_RELEASE);
+    traceLocal = buf;
+
+    return buf;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: static uint64_t traceNs()
+ *
+ * monotonic nanoseconds, read next to the cycle counter to calibrate it
+ *---------------------------------------------------------------------------*/
+static uint64_t traceNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * file: trace.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the event trace (-X). a tracepoint stores a fixed
+ * size binary event, the dispatchCycles counter and a few raw arguments,
+ * in a ring of the calling thread's own, overwriting the oldest once it
+ * wraps. there is no formatting or locking when recording, and a
+ * tracepoint is one predictable branch while tracing is off. an interface
+ * is passed as its sr_if, resolved by the caller, and recorded by index,
+ * which the file's name table is in the order of. the rings are
+ * dumped to a file at exit and srtrace turns that into text or Chrome
+ * trace JSON
+ ******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "sr_if.h"
+
+#define TRACE_EVENTS (1 << 16)                  // per thread, power of two
+#define TRACE_MAX_THREADS 64
+#define TRACE_MAX_IFACES 32                     // later interfaces trace as none
+#define TRACE_MAGIC "SRTRACE"
+#define TRACE_VERSION 1
+#define TRACE_NO_IFACE 0xffff
+
+/* event ids */
+#define TRACE_RECEIVE 1                         // iface, len, dst
+#define TRACE_BURST 2                           // len is frames in the burst
+#define TRACE_PARSE 3                           // len, dst, arg is the parse flags
+#define TRACE_ROUTE 4                           // out iface, dst, arg is the gateway
+#define TRACE_ARP_HIT 5                         // addr is the gateway
+#define TRACE_ARP_MISS 6
+#define TRACE_QUEUE 7                           // to a worker, arg is which
+#define TRACE_HOLD 8                            // waits for arp, arg is the cache slot
+#define TRACE_TRANSMIT 9                        // iface, len
+#define TRACE_DROP 10                           // arg is a TRACE_DROP_ reason
+#define TRACE_DONE 11                           // packet or burst handled
+#define TRACE_IDS 12
+
+/* drop reasons */
+#define TRACE_DROP_PARSE 1
+#define TRACE_DROP_TTL 2
+#define TRACE_DROP_NO_ROUTE 3
+#define TRACE_DROP_HOLD_FULL 4
+#define TRACE_DROP_QUEUE_FULL 5
+
+struct trace_event {
+    uint64_t        tsc;
+    uint16_t        id;
+    uint16_t        iface;                      // index into the file's names
+    uint32_t        len;
+    uint32_t        addr;                       // network byte order
+    uint32_t        arg;
+};
+
+struct trace_buffer {
+    uint32_t            thread;                 // order threads first traced in
+    uint64_t            head;                   // events ever recorded
+    struct trace_event  events[TRACE_EVENTS];
+};
+
+/* -- file layout: header, interface names, then each thread's
+ *    trace_thread followed by its events, oldest first -- */
+struct trace_header {
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        nthreads;
+    uint32_t        nifaces;
+    uint32_t        pad;
+    uint64_t        tscStart;                   // clocks read together at
+    uint64_t        nsStart;                    // start and at dump, to turn
+    uint64_t        tscEnd;                     // cycles into time
+    uint64_t        nsEnd;
+};
+
+struct trace_thread {
+    uint32_t        thread;
+    uint32_t        count;                      // events that follow
+    uint64_t        lost;                       // overwritten before the dump
+};
+
+#ifdef NO_TRACE
+#define Trace(id, iface, len, addr, arg) do{}while(0)
+#else
+#define Trace(id, iface, len, addr, arg) \
+    do { \
+        if (__builtin_expect(traceEnabled, 0)) \
+            traceRecord(id, iface, len, addr, arg); \
+    } while (0)
+#endif
+
+extern int traceEnabled;
+
+int traceStart(struct sr_instance*, const char* );
+void traceStop();
+void traceRecord(uint16_t, const struct sr_if*, uint32_t, uint32_t, uint32_t );
+
+#endif
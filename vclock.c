@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * file: vclock.c
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * implements the router clock. when the virtual clock is enabled time only
+ * moves when vclockSet is called, otherwise we fall through to gettimeofday.
+ * the virtual time is kept in a single word so worker threads can read it
+ * while the replay thread moves it along
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "vclock.h"
+
+static int virtualClock = 0;            // set once replay takes over the clock
+static int64_t virtualTime = 0;         // microseconds, last time from vclockSet
+
+/*-----------------------------------------------------------------------------
+ * Method: void vclockEnable()
+ *
+ * stops following the wall clock. time stands still at zero until the first
+ * call to vclockSet
+ *---------------------------------------------------------------------------*/
+void vclockEnable()
+{
+    __atomic_store_n(&virtualTime, 0, __ATOMIC_RELAXED);
+    virtualClock = 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void vclockSet(const struct timeval* tv)
+ *
+ * advances the virtual clock. the clock never runs backwards, so out of order
+ * timestamps in a capture just leave it where it was
+ *---------------------------------------------------------------------------*/
+void vclockSet(const struct timeval* tv)
+{
+    int64_t usec = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+    if (usec > __atomic_load_n(&virtualTime, __ATOMIC_RELAXED))
+        __atomic_store_n(&virtualTime, usec, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void vclockGetTime(struct timeval* tv)
+ *
+ * fills tv with the current router time
+ *---------------------------------------------------------------------------*/
+void vclockGetTime(struct timeval* tv)
+{
+    int64_t usec;
+
+    if (virtualClock) {
+        usec = __atomic_load_n(&virtualTime, __ATOMIC_RELAXED);
+        tv->tv_sec = usec / 1000000;
+        tv->tv_usec = usec % 1000000;
+    } else {
+        gettimeofday(tv, NULL);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: void vclockGetTimespec(struct timespec* ts)
+ *
+ * vclockGetTime to the nanosecond, as far as the clock behind it goes
+ *---------------------------------------------------------------------------*/
+void vclockGetTimespec(struct timespec* ts)
+{
+    int64_t usec;
+
+    if (virtualClock) {
+        usec = __atomic_load_n(&virtualTime, __ATOMIC_RELAXED);
+        ts->tv_sec = usec / 1000000;
+        ts->tv_nsec = (usec % 1000000) * 1000;
+    } else {
+        clock_gettime(CLOCK_REALTIME, ts);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: time_t vclockNow()
+ *
+ * drop in replacement for time(NULL)
+ *---------------------------------------------------------------------------*/
+time_t vclockNow()
+{
+    if (virtualClock)
+        return __atomic_load_n(&virtualTime, __ATOMIC_RELAXED) / 1000000;
+
+    return time(NULL);
+}
@@ -0,0 +1,24 @@
+/*******************************************************************************
+ * file: vclock.h
+ * date: 10/19/26
+ * Andrew Krawchyk
+ *
+ * Description:
+ * contains headers for the router clock. normally this is just wall clock
+ * time, but offline replay drives it from packet timestamps so that arp and
+ * packet cache timeouts behave the same on every run
+ ******************************************************************************/
+
+#ifndef VCLOCK_H
+#define VCLOCK_H
+
+#include <time.h>
+#include <sys/time.h>
+
+void vclockEnable();
+void vclockSet(const struct timeval* );
+void vclockGetTime(struct timeval* );
+void vclockGetTimespec(struct timespec* );
+time_t vclockNow();
+
+#endif